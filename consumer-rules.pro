@@ -0,0 +1,13 @@
+# ProGuard/R8 rules applied to apps that depend on AndFix, see README.
+
+# @MethodReplace is read by reflection from patch classes
+-keep class * extends java.lang.annotation.Annotation
+
+# natives are bound by RegisterNatives in JNI_OnLoad
+-keepclasseswithmembernames class * {
+    native <methods>;
+}
+
+# art_initLayout measures ArtMethod on the adjacent a(), b() and n(); nothing
+# calls them from Java, so without this they are removed or merged
+-keep class com.alipay.euler.andfix.AndFix$LayoutProbe { *; }
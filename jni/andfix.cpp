@@ -36,29 +36,90 @@
 
 #include <jni.h>
 #include <cstdio>
+#include <cstdint>
+#include <cstring>
 #include <cassert>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <string>
 
+#include "andfix.h"
+#include "apply_queue.h"
 #include "common.h"
+#include "hash/file_hash.h"
+#include "zip/zip_archive.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "trace.h"
 
 #define JNIREG_CLASS "com/alipay/euler/andfix/AndFix"
+#define ZIPREG_CLASS "com/alipay/euler/andfix/ZipArchive"
+
+#define ZIP_READ_CHUNK 32768
 
 // dalvik
 extern jboolean dalvik_setup(JNIEnv* env, int apilevel);
 extern void dalvik_replaceMethod(JNIEnv* env, jobject src, jobject dest);
+extern void dalvik_replaceDalvikMethod(void* src, void* dest);
 extern void dalvik_setFieldFlag(JNIEnv* env, jobject field);
+extern bool dalvik_reserveSnapshots(size_t count);
 //art
-extern jboolean art_setup(JNIEnv* env, int apilevel);
+extern jboolean art_setup(JNIEnv* env, int apilevel, const char* fingerprint, const char* layoutCache);
 extern void art_replaceMethod(JNIEnv* env, jobject method2, jobject method1);
+extern void art_replaceArtMethod(void* method1, void* method2);
+extern bool art_reserveSnapshots(size_t count);
 extern void art_setFieldFlag(JNIEnv* env, jobject field);
+extern void art_writeMethod(void* method, const void* bytes, size_t offset, size_t size);
+extern bool art_suspendAll();
+extern void art_resumeAll();
 
 static bool isArt;
 
-static jboolean setup(JNIEnv* env, jclass, jboolean isart, jint apilevel) {
+/*
+ * setup 成功后才能经由 andfix.h 的 C 接口替换
+ */
+static bool ready;
+
+/*
+ * 串行化所有改写方法与快照的操作. Java 层的 commit 不再同步，异步提交的批次由 apply_queue
+ * 唯一的 applier 线程写入，同步的 replaceMethod(s)、restore 与 andfix.h 的调用方则在各自的
+ * 线程写入，它们都只在持有这把锁时写(只包住写入，不包住解析)
+ */
+static std::mutex replaceLock;
+
+/*
+ * JNI_OnLoad 时保存，用于把 applier 线程 attach 到虚拟机
+ */
+static JavaVM* javaVM;
+
+/*
+ * 只由 applier 线程读写
+ */
+static bool applierAttached;
+
+static jboolean setup(JNIEnv* env, jclass, jboolean isart, jint apilevel,
+		jstring fingerprint, jstring layoutCache) {
+	StatScope scope(STAT_SETUP);
   isArt = isart;
 	LOGD("vm is: %s , apilevel is: %i", (isArt ? "art" : "dalvik"), (int) apilevel);
+	trace_record(TRACE_SETUP, (uint32_t) apilevel, (const void*) (uintptr_t) isArt, nullptr);
+	snapshot_setWriter(isArt ? art_writeMethod : nullptr);
 	if (isArt) {
-		return art_setup(env, (int) apilevel);
+		const char* fp = fingerprint ? env->GetStringUTFChars(fingerprint, nullptr) : nullptr;
+		const char* cache = layoutCache ? env->GetStringUTFChars(layoutCache, nullptr) : nullptr;
+		jboolean ret = art_setup(env, (int) apilevel, fp, cache);
+		if (fp != nullptr) {
+			env->ReleaseStringUTFChars(fingerprint, fp);
+		}
+		if (cache != nullptr) {
+			env->ReleaseStringUTFChars(layoutCache, cache);
+		}
+		ready = ret;
+		return ret;
 	} else {
+		// dalvik 的替换本身不依赖 dalvik_setup 解析的符号
+		ready = true;
 		return dalvik_setup(env, (int) apilevel);
 	}
 }
@@ -67,6 +128,8 @@ static jboolean setup(JNIEnv* env, jclass, jboolean isart, jint apilevel) {
  * dest替换src
  */
 static void replaceMethod(JNIEnv* env, jclass, jobject method1, jobject method2) {
+	StatScope scope(STAT_REPLACE_METHOD);
+	std::lock_guard<std::mutex> lock(replaceLock);
 	if (isArt) {
 		art_replaceMethod(env, method1, method2);
 	} else {
@@ -74,13 +137,662 @@ static void replaceMethod(JNIEnv* env, jclass, jobject method1, jobject method2)
 	}
 }
 
+/*
+ * 批量解析时每个 local frame 处理的条目数，每个条目占两个 local reference.
+ */
+#define BATCH_FRAME_SIZE 256
+
+/*
+ * 达到这个条目数的批量替换在挂起所有线程后写入；挂起一次要等所有线程到达 suspend point，
+ * 小批量不值得
+ */
+#define SUSPEND_MIN_BATCH 64
+
+/**
+ * 挂起窗口: count 达到 SUSPEND_MIN_BATCH 时在 art 上挂起所有线程，析构时恢复并把窗口时长
+ * (含等待线程挂起的时间)记入 STAT_SUSPEND. 没有挂起接口时什么也不做.
+ * 必须在持有 replaceLock 后构造.
+ * 构造的线程必须已 attach 到虚拟机(挂起接口以 Thread::Current() 为 self)，否则传入 canSuspend = false.
+ */
+class SuspendScope {
+public:
+	explicit SuspendScope(size_t count, bool canSuspend = true)
+			: count_(count), start_(stats_now()) {
+		suspended_ = canSuspend && isArt && count >= SUSPEND_MIN_BATCH && art_suspendAll();
+	}
+
+	~SuspendScope() {
+		if (suspended_) {
+			art_resumeAll();
+			stats_record(STAT_SUSPEND, count_, stats_now() - start_);
+		}
+	}
+
+private:
+	size_t count_;
+	uint64_t start_;
+	bool suspended_;
+};
+
+/**
+ * 被改写的那个方法：art 下是 method1，dalvik 下与 replaceMethod 保持一致，是 method2
+ */
+static inline uintptr_t writtenMethod(const ReplaceEntry& entry) {
+	return reinterpret_cast<uintptr_t>(isArt ? entry.method1 : entry.method2);
+}
+
+static inline void applyEntry(const ReplaceEntry& entry) {
+	if (isArt) {
+		art_replaceArtMethod(entry.method1, entry.method2);
+	} else {
+		dalvik_replaceDalvikMethod(entry.method2, entry.method1);
+	}
+}
+
+/**
+ * 按地址顺序写入，相邻的 ArtMethod 落在同一/相邻 cache line 上；
+ * stable_sort 保证同一个方法被替换多次时仍是数组中靠后的生效.
+ * art 上的大批量在一次挂起窗口内写完，不会有线程看到替换了一半的补丁；
+ * 快照在挂起之前预留，窗口内只有查找与 memcpy，不分配内存.
+ */
+static void applyEntries(std::vector<ReplaceEntry>& entries, bool canSuspend = true) {
+	std::stable_sort(entries.begin(), entries.end(),
+			[](const ReplaceEntry& a, const ReplaceEntry& b) {
+				return writtenMethod(a) < writtenMethod(b);
+			});
+	std::lock_guard<std::mutex> lock(replaceLock);
+	bool reserved = isArt ? art_reserveSnapshots(entries.size())
+			: dalvik_reserveSnapshots(entries.size());
+	if (!reserved) {
+		LOGW("applyEntries: can not reserve %zu snapshots", entries.size());
+	}
+	SuspendScope suspend(entries.size(), canSuspend);
+	for (const ReplaceEntry& entry : entries) {
+		applyEntry(entry);
+	}
+}
+
+/**
+ * 解析 targets[i] / replacements[i] 的 jmethodID，可替换的条目追加到 entries，
+ * 每一项的结果(REPLACE_*)写入 status.
+ *
+ * @return false 表示入参非法或出现了 OutOfMemoryError
+ */
+static bool resolveEntries(JNIEnv* env, const char* caller, jobjectArray targets,
+		jobjectArray replacements, std::vector<jint>& status, std::vector<ReplaceEntry>& entries) {
+	if (targets == nullptr || replacements == nullptr) {
+		return false;
+	}
+	jsize count = env->GetArrayLength(targets);
+	if (env->GetArrayLength(replacements) != count) {
+		LOGE("%s: length mismatch %d , %d", caller, (int) count,
+				(int) env->GetArrayLength(replacements));
+		return false;
+	}
+
+	status.assign(count, REPLACE_OK);
+	entries.reserve(count);
+
+	// 每 BATCH_FRAME_SIZE 个条目一个 local frame，避免大批量时撑爆 local reference 表
+	for (jsize begin = 0; begin < count; begin += BATCH_FRAME_SIZE) {
+		jsize end = std::min(count, begin + BATCH_FRAME_SIZE);
+		if (env->PushLocalFrame(2 * (end - begin)) < 0) {
+			return false; // OutOfMemoryError pending
+		}
+		for (jsize i = begin; i < end; ++i) {
+			jobject method1 = env->GetObjectArrayElement(targets, i);
+			jobject method2 = env->GetObjectArrayElement(replacements, i);
+			if (method1 == nullptr || method2 == nullptr) {
+				status[i] = REPLACE_NULL;
+				continue;
+			}
+			void* meth1 = env->FromReflectedMethod(method1);
+			void* meth2 = env->FromReflectedMethod(method2);
+			if (meth1 == nullptr || meth2 == nullptr) {
+				status[i] = REPLACE_UNRESOLVED;
+				continue;
+			}
+			entries.push_back({ meth1, meth2 });
+		}
+		env->PopLocalFrame(nullptr);
+	}
+	return true;
+}
+
+/**
+ * 批量替换：先一次性解析所有 jmethodID，再按地址顺序逐个替换.
+ * 返回与入参等长的状态数组(REPLACE_*)，入参非法时返回 null.
+ */
+static jintArray replaceMethods(JNIEnv* env, jclass, jobjectArray targets, jobjectArray replacements) {
+	if (targets == nullptr || replacements == nullptr) {
+		return nullptr;
+	}
+	StatScope scope(STAT_REPLACE_METHODS);
+	std::vector<jint> status;
+	std::vector<ReplaceEntry> entries;
+	if (!resolveEntries(env, "replaceMethods", targets, replacements, status, entries)) {
+		scope.setItems(0);
+		return nullptr;
+	}
+
+	applyEntries(entries);
+	scope.setItems(entries.size());
+	LOGD("replaceMethods: %d requested, %d replaced", (int) status.size(), (int) entries.size());
+
+	jsize count = (jsize) status.size();
+	jintArray result = env->NewIntArray(count);
+	if (result != nullptr) {
+		env->SetIntArrayRegion(result, 0, count, status.data());
+	}
+	return result;
+}
+
+/**
+ * applier 线程启动时 attach 到虚拟机: 5.0 ~ 6.0 的 Dbg::SuspendVM 与 7.0 的 ScopedSuspendAll
+ * 都以 Thread::Current() 为 self，未 attach 的线程上它是 null. attach 后线程处于 native 状态，
+ * 不持有 mutator lock，满足挂起所有线程的前提. applier 线程永不退出，所以不需要 detach.
+ */
+static void attachApplier() {
+	JNIEnv* env = nullptr;
+	JavaVMAttachArgs args = { JNI_VERSION_1_4, "AndFix-applier", nullptr };
+	applierAttached = javaVM != nullptr && javaVM->AttachCurrentThread(&env, &args) == JNI_OK;
+	if (!applierAttached) {
+		LOGE("applyQueue: can not attach the applier thread, batches are written without suspension");
+	}
+}
+
+/**
+ * applier 线程写入合并后的批次，与 replaceMethods 一样记入 STAT_REPLACE_METHODS
+ */
+static void applyQueued(std::vector<ReplaceEntry>& entries) {
+	StatScope scope(STAT_REPLACE_METHODS);
+	scope.setItems(entries.size());
+	applyEntries(entries, applierAttached);
+}
+
+/**
+ * replaceMethods 的异步形式: 在调用线程解析，写入交给 applier 线程，与其它线程同时提交的
+ * 批次合并写入. 每一项的解析结果(REPLACE_*)写入 status(与 targets 等长).
+ *
+ * @return 传给 awaitApplied 的 ticket，0 表示没有要写入的方法，-1 表示入参非法
+ */
+static jlong enqueueReplaceMethods(JNIEnv* env, jclass, jobjectArray targets,
+		jobjectArray replacements, jintArray status) {
+	std::vector<jint> results;
+	std::vector<ReplaceEntry> entries;
+	if (status == nullptr
+			|| !resolveEntries(env, "enqueueReplaceMethods", targets, replacements, results, entries)
+			|| env->GetArrayLength(status) != (jsize) results.size()) {
+		return -1;
+	}
+	env->SetIntArrayRegion(status, 0, (jsize) results.size(), results.data());
+	return (jlong) applyQueue_push(entries);
+}
+
+/**
+ * 等待 enqueueReplaceMethods 返回的 ticket 写入，在 native 状态中等待，不阻塞 GC
+ *
+ * @param timeoutNs 小于 0 表示一直等，0 表示只检查
+ */
+static jboolean awaitApplied(JNIEnv*, jclass, jlong ticket, jlong timeoutNs) {
+	if (ticket <= 0) {
+		return JNI_TRUE;
+	}
+	return applyQueue_await((uint64_t) ticket, (int64_t) timeoutNs) ? JNI_TRUE : JNI_FALSE;
+}
+
+/**
+ * 按 JNI 签名解析方法，GetMethodID / GetStaticMethodID 会先初始化该类.
+ * 找不到时清除 NoSuchMethodError 并返回 null
+ */
+static void* resolveMethod(JNIEnv* env, jclass clazz, jstring name, jstring sig, bool isStatic) {
+	const char* methodName = env->GetStringUTFChars(name, nullptr);
+	const char* methodSig = env->GetStringUTFChars(sig, nullptr);
+	jmethodID method = nullptr;
+	if (methodName != nullptr && methodSig != nullptr) {
+		method = isStatic ? env->GetStaticMethodID(clazz, methodName, methodSig)
+				: env->GetMethodID(clazz, methodName, methodSig);
+	}
+	if (methodName != nullptr) {
+		env->ReleaseStringUTFChars(name, methodName);
+	}
+	if (methodSig != nullptr) {
+		env->ReleaseStringUTFChars(sig, methodSig);
+	}
+	if (env->ExceptionCheck()) {
+		env->ExceptionClear();
+		method = nullptr;
+	}
+	return method;
+}
+
+/**
+ * 解析一对方法，成功时写入 entry
+ *
+ * @return REPLACE_*
+ */
+static jint resolveEntry(JNIEnv* env, jclass target, jstring name, jstring sig, bool isStatic,
+		jclass patch, jstring patchName, jstring patchSig, ReplaceEntry* entry) {
+	if (target == nullptr || name == nullptr || sig == nullptr || patch == nullptr
+			|| patchName == nullptr || patchSig == nullptr) {
+		return REPLACE_NULL;
+	}
+	entry->method1 = resolveMethod(env, target, name, sig, isStatic);
+	entry->method2 = resolveMethod(env, patch, patchName, patchSig, isStatic);
+	if (entry->method1 == nullptr || entry->method2 == nullptr) {
+		return REPLACE_UNRESOLVED;
+	}
+	return REPLACE_OK;
+}
+
+/**
+ * 不经过 java.lang.reflect.Method，按名字与 JNI 签名直接解析出 jmethodID 后替换:
+ * target.name(sig) 替换为 patch.patchName(patchSig)，两者同为 static 或非 static.
+ *
+ * @return REPLACE_*
+ */
+static jint replaceMethodBySignature(JNIEnv* env, jclass, jclass target, jstring name,
+		jstring sig, jboolean isStatic, jclass patch, jstring patchName, jstring patchSig) {
+	StatScope scope(STAT_REPLACE_METHOD);
+	ReplaceEntry entry;
+	jint status = resolveEntry(env, target, name, sig, isStatic, patch, patchName, patchSig, &entry);
+	if (status == REPLACE_OK) {
+		std::lock_guard<std::mutex> lock(replaceLock);
+		applyEntry(entry);
+	} else {
+		scope.setItems(0);
+	}
+	return status;
+}
+
+/**
+ * replaceMethodBySignature 的批量形式，各数组等长，第 i 项对应一次替换；
+ * 先全部解析，再与 replaceMethods 一样按地址顺序写入.
+ * 返回与入参等长的状态数组(REPLACE_*)，入参非法时返回 null.
+ */
+static jintArray replaceMethodsBySignature(JNIEnv* env, jclass, jobjectArray targets,
+		jobjectArray names, jobjectArray sigs, jbooleanArray isStatic, jobjectArray patches,
+		jobjectArray patchNames, jobjectArray patchSigs) {
+	if (targets == nullptr || names == nullptr || sigs == nullptr || isStatic == nullptr
+			|| patches == nullptr || patchNames == nullptr || patchSigs == nullptr) {
+		return nullptr;
+	}
+	jsize count = env->GetArrayLength(targets);
+	if (env->GetArrayLength(names) != count || env->GetArrayLength(sigs) != count
+			|| env->GetArrayLength(isStatic) != count || env->GetArrayLength(patches) != count
+			|| env->GetArrayLength(patchNames) != count || env->GetArrayLength(patchSigs) != count) {
+		LOGE("replaceMethodsBySignature: length mismatch");
+		return nullptr;
+	}
+	StatScope scope(STAT_REPLACE_METHODS);
+
+	std::vector<jboolean> statics(count);
+	env->GetBooleanArrayRegion(isStatic, 0, count, statics.data());
+	std::vector<jint> status(count, REPLACE_OK);
+	std::vector<ReplaceEntry> entries;
+	entries.reserve(count);
+
+	// 每个条目占 6 个 local reference
+	for (jsize begin = 0; begin < count; begin += BATCH_FRAME_SIZE) {
+		jsize end = std::min(count, begin + BATCH_FRAME_SIZE);
+		if (env->PushLocalFrame(6 * (end - begin)) < 0) {
+			return nullptr; // OutOfMemoryError pending
+		}
+		for (jsize i = begin; i < end; ++i) {
+			ReplaceEntry entry;
+			status[i] = resolveEntry(env,
+					(jclass) env->GetObjectArrayElement(targets, i),
+					(jstring) env->GetObjectArrayElement(names, i),
+					(jstring) env->GetObjectArrayElement(sigs, i),
+					statics[i],
+					(jclass) env->GetObjectArrayElement(patches, i),
+					(jstring) env->GetObjectArrayElement(patchNames, i),
+					(jstring) env->GetObjectArrayElement(patchSigs, i),
+					&entry);
+			if (status[i] == REPLACE_OK) {
+				entries.push_back(entry);
+			}
+		}
+		env->PopLocalFrame(nullptr);
+	}
+
+	applyEntries(entries);
+	scope.setItems(entries.size());
+	LOGD("replaceMethodsBySignature: %d requested, %d replaced", (int) count, (int) entries.size());
+
+	jintArray result = env->NewIntArray(count);
+	if (result != nullptr) {
+		env->SetIntArrayRegion(result, 0, count, status.data());
+	}
+	return result;
+}
+
 static void setFieldFlag(JNIEnv* env, jclass, jobject field) {
+	StatScope scope(STAT_SET_FIELD_FLAG);
 	if (isArt) {
 		art_setFieldFlag(env, field);
 	} else {
 		dalvik_setFieldFlag(env, field);
 	}
 }
+
+/**
+ * 一次 JNI 调用把 fields(一个类的 getDeclaredFields())全部改为 public，返回处理的字段数.
+ * 每个字段都经 FromReflectedField 取得 ArtField/Field：它在 runtime 内部进入 runnable 状态，
+ * 这里不在 native 状态下解码或遍历 Class 对象，不会与移动/扫描 Class 的 GC 并发.
+ */
+static jint setFieldsPublic(JNIEnv* env, jclass, jobjectArray fields) {
+	StatScope scope(STAT_SET_CLASS_FIELDS);
+	if (fields == nullptr) {
+		return 0;
+	}
+	jsize count = env->GetArrayLength(fields);
+	for (jsize i = 0; i < count; ++i) {
+		jobject field = env->GetObjectArrayElement(fields, i);
+		if (field == nullptr) {
+			continue;
+		}
+		if (isArt) {
+			art_setFieldFlag(env, field);
+		} else {
+			dalvik_setFieldFlag(env, field);
+		}
+		env->DeleteLocalRef(field);
+	}
+	scope.setItems(count);
+	return count;
+}
+
+/**
+ * 撤销对 method 的替换，恢复为第一次替换前的实现
+ */
+static jboolean restore(JNIEnv* env, jclass, jobject method) {
+	if (method == nullptr) {
+		return JNI_FALSE;
+	}
+	StatScope scope(STAT_RESTORE);
+	void* meth = env->FromReflectedMethod(method);
+	std::lock_guard<std::mutex> lock(replaceLock);
+	bool restored = meth != nullptr && snapshot_restore(meth);
+	scope.setItems(restored ? 1 : 0);
+	trace_record(TRACE_RESTORE, restored ? 1 : 0, meth, nullptr);
+	return restored ? JNI_TRUE : JNI_FALSE;
+}
+
+/**
+ * 撤销所有替换，返回恢复的方法数
+ */
+static jint restoreMethods(JNIEnv*, jclass) {
+	StatScope scope(STAT_RESTORE);
+	std::lock_guard<std::mutex> lock(replaceLock);
+	SuspendScope suspend(snapshot_count());
+	jint count = (jint) snapshot_restoreAll();
+	scope.setItems(count);
+	trace_record(TRACE_RESTORE_ALL, (uint32_t) count, nullptr, nullptr);
+	return count;
+}
+
+/*
+ * andfix.h 导出的 C 接口
+ */
+extern "C" int andfix_api_version(void) {
+	return ANDFIX_API_VERSION;
+}
+
+extern "C" int andfix_replace(jmethodID target, jmethodID replacement) {
+	if (!ready) {
+		return ANDFIX_ERROR_NOT_SETUP;
+	}
+	if (target == nullptr || replacement == nullptr) {
+		return ANDFIX_ERROR_NULL;
+	}
+	StatScope scope(STAT_REPLACE_METHOD);
+	std::lock_guard<std::mutex> lock(replaceLock);
+	applyEntry({ target, replacement });
+	return ANDFIX_OK;
+}
+
+/**
+ * 跳过为 null 的条目，其余追加到 entries
+ */
+static void collectEntries(const jmethodID* targets, const jmethodID* replacements, size_t count,
+		int* status, std::vector<ReplaceEntry>& entries) {
+	entries.reserve(count);
+	for (size_t i = 0; i < count; ++i) {
+		bool valid = targets[i] != nullptr && replacements[i] != nullptr;
+		if (status != nullptr) {
+			status[i] = valid ? ANDFIX_OK : ANDFIX_ERROR_NULL;
+		}
+		if (valid) {
+			entries.push_back({ targets[i], replacements[i] });
+		}
+	}
+}
+
+extern "C" int andfix_replace_batch(const jmethodID* targets, const jmethodID* replacements,
+		size_t count, int* status) {
+	if (!ready) {
+		return ANDFIX_ERROR_NOT_SETUP;
+	}
+	if (targets == nullptr || replacements == nullptr) {
+		return 0;
+	}
+	StatScope scope(STAT_REPLACE_METHODS);
+	std::vector<ReplaceEntry> entries;
+	collectEntries(targets, replacements, count, status, entries);
+	applyEntries(entries);
+	scope.setItems(entries.size());
+	return (int) entries.size();
+}
+
+extern "C" int64_t andfix_enqueue_batch(const jmethodID* targets, const jmethodID* replacements,
+		size_t count, int* status) {
+	if (!ready) {
+		return ANDFIX_ERROR_NOT_SETUP;
+	}
+	if (targets == nullptr || replacements == nullptr) {
+		return 0;
+	}
+	std::vector<ReplaceEntry> entries;
+	collectEntries(targets, replacements, count, status, entries);
+	return (int64_t) applyQueue_push(entries);
+}
+
+extern "C" int andfix_await(int64_t ticket, int64_t timeoutNs) {
+	return ticket <= 0 || applyQueue_await((uint64_t) ticket, timeoutNs) ? 1 : 0;
+}
+
+extern "C" int andfix_restore(jmethodID method) {
+	if (method == nullptr) {
+		return 0;
+	}
+	StatScope scope(STAT_RESTORE);
+	std::lock_guard<std::mutex> lock(replaceLock);
+	bool restored = snapshot_restore(method);
+	scope.setItems(restored ? 1 : 0);
+	trace_record(TRACE_RESTORE, restored ? 1 : 0, method, nullptr);
+	return restored ? 1 : 0;
+}
+
+extern "C" size_t andfix_restore_all(void) {
+	StatScope scope(STAT_RESTORE);
+	std::lock_guard<std::mutex> lock(replaceLock);
+	SuspendScope suspend(snapshot_count());
+	size_t count = snapshot_restoreAll();
+	scope.setItems(count);
+	trace_record(TRACE_RESTORE_ALL, (uint32_t) count, nullptr, nullptr);
+	return count;
+}
+
+/**
+ * 所有 native 统计项，按 [STAT_*][STAT_FIELD_*] 展开
+ */
+static jlongArray getStats(JNIEnv* env, jclass) {
+	int64_t snapshot[STAT_NATIVE_COUNT * STAT_FIELDS];
+	jlong values[STAT_NATIVE_COUNT * STAT_FIELDS];
+	size_t count = stats_snapshot(snapshot, STAT_NATIVE_COUNT * STAT_FIELDS);
+	for (size_t i = 0; i < count; ++i) {
+		values[i] = (jlong) snapshot[i];
+	}
+	jlongArray result = env->NewLongArray((jsize) count);
+	if (result != nullptr) {
+		env->SetLongArrayRegion(result, 0, (jsize) count, values);
+	}
+	return result;
+}
+
+/**
+ * 解码 trace 环形缓冲区中的事件，只在需要排查问题时调用
+ */
+static jstring dumpTrace(JNIEnv* env, jclass) {
+	std::string text = trace_dump();
+	return env->NewStringUTF(text.c_str());
+}
+
+/**
+ * 补丁或 odex 的带密钥指纹，见 hash/file_hash.h
+ *
+ * @return 32 字节，文件无法读取时为 null
+ */
+static jbyteArray fingerprint(JNIEnv* env, jclass, jstring path, jbyteArray key) {
+	if (path == nullptr) {
+		return nullptr;
+	}
+	std::vector<jbyte> keyBytes;
+	if (key != nullptr) {
+		keyBytes.resize(env->GetArrayLength(key));
+		if (!keyBytes.empty()) {
+			env->GetByteArrayRegion(key, 0, (jsize) keyBytes.size(), keyBytes.data());
+		}
+	}
+	const char* file = env->GetStringUTFChars(path, nullptr);
+	if (file == nullptr) {
+		return nullptr;
+	}
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	bool hashed = file_hash(file, keyBytes.data(), keyBytes.size(), 0, digest);
+	env->ReleaseStringUTFChars(path, file);
+	if (!hashed) {
+		return nullptr;
+	}
+	jbyteArray result = env->NewByteArray(SHA256_DIGEST_SIZE);
+	if (result != nullptr) {
+		env->SetByteArrayRegion(result, 0, SHA256_DIGEST_SIZE, (const jbyte*) digest);
+	}
+	return result;
+}
+
+/*
+ * ZipArchive 的 native 方法: archive 与 reader 以 jlong 句柄交给 Java，条目用排序后的下标表示
+ */
+static jlong zipOpen(JNIEnv* env, jclass, jstring path) {
+	if (path == nullptr) {
+		return 0;
+	}
+	const char* file = env->GetStringUTFChars(path, nullptr);
+	if (file == nullptr) {
+		return 0;
+	}
+	ZipArchive* archive = zip_open(file);
+	env->ReleaseStringUTFChars(path, file);
+	return (jlong) (uintptr_t) archive;
+}
+
+static void zipClose(JNIEnv*, jclass, jlong handle) {
+	zip_close((ZipArchive*) (uintptr_t) handle);
+}
+
+static jint zipCount(JNIEnv*, jclass, jlong handle) {
+	return (jint) zip_entryCount((ZipArchive*) (uintptr_t) handle);
+}
+
+static jstring zipName(JNIEnv* env, jclass, jlong handle, jint index) {
+	const ZipEntry* entry = zip_entryAt((ZipArchive*) (uintptr_t) handle, (size_t) index);
+	if (entry == nullptr) {
+		return nullptr;
+	}
+	std::string name(entry->name, entry->nameLength);
+	return env->NewStringUTF(name.c_str());
+}
+
+/**
+ * @return 条目的下标，没有则为 -1
+ */
+static jint zipFind(JNIEnv* env, jclass, jlong handle, jstring name) {
+	if (name == nullptr) {
+		return -1;
+	}
+	const ZipArchive* archive = (ZipArchive*) (uintptr_t) handle;
+	const char* utf = env->GetStringUTFChars(name, nullptr);
+	if (utf == nullptr) {
+		return -1;
+	}
+	const ZipEntry* entry = zip_find(archive, utf, strlen(utf));
+	env->ReleaseStringUTFChars(name, utf);
+	return entry == nullptr ? -1 : (jint) (entry - zip_entryAt(archive, 0));
+}
+
+static jlong zipSize(JNIEnv*, jclass, jlong handle, jint index) {
+	const ZipEntry* entry = zip_entryAt((ZipArchive*) (uintptr_t) handle, (size_t) index);
+	return entry == nullptr ? -1 : (jlong) entry->uncompressedSize;
+}
+
+/**
+ * @return 指向映射的 direct ByteBuffer，条目不是 stored 时为 null
+ */
+static jobject zipMap(JNIEnv* env, jclass, jlong handle, jint index) {
+	const ZipArchive* archive = (ZipArchive*) (uintptr_t) handle;
+	const ZipEntry* entry = zip_entryAt(archive, (size_t) index);
+	if (entry == nullptr) {
+		return nullptr;
+	}
+	const uint8_t* data = zip_storedData(archive, entry);
+	if (data == nullptr) {
+		return nullptr;
+	}
+	return env->NewDirectByteBuffer((void*) data, (jlong) entry->uncompressedSize);
+}
+
+static jlong zipOpenReader(JNIEnv*, jclass, jlong handle, jint index) {
+	const ZipArchive* archive = (ZipArchive*) (uintptr_t) handle;
+	const ZipEntry* entry = zip_entryAt(archive, (size_t) index);
+	if (entry == nullptr) {
+		return 0;
+	}
+	return (jlong) (uintptr_t) zip_openReader(archive, entry);
+}
+
+/**
+ * 先检查 [offset, offset + length) 在 buffer 内再读，越界时不会从 reader 中取走数据
+ *
+ * @return 读到的字节数，-1 表示已读完，-2 表示数据损坏或越界
+ */
+static jint zipRead(JNIEnv* env, jclass, jlong reader, jbyteArray buffer, jint offset,
+		jint length) {
+	if (buffer == nullptr || offset < 0 || length < 0
+			|| offset > env->GetArrayLength(buffer) - length) {
+		return -2;
+	}
+	if (length == 0) {
+		return 0;
+	}
+	jbyte chunk[ZIP_READ_CHUNK];
+	ssize_t n = zip_read((ZipReader*) (uintptr_t) reader, chunk,
+			std::min<size_t>((size_t) length, sizeof(chunk)));
+	if (n < 0) {
+		return -2;
+	}
+	if (n == 0) {
+		return -1;
+	}
+	env->SetByteArrayRegion(buffer, offset, (jsize) n, chunk);
+	return (jint) n;
+}
+
+static void zipCloseReader(JNIEnv*, jclass, jlong reader) {
+	zip_closeReader((ZipReader*) (uintptr_t) reader);
+}
+
 /*
  * JNI registration.
  */
@@ -88,7 +800,7 @@ static JNINativeMethod gMethods[] = {
   /* name, signature, funcPtr */
   {
     "setup",
-    "(ZI)Z",
+    "(ZILjava/lang/String;Ljava/lang/String;)Z",
     (void*) setup
   },
   {
@@ -96,11 +808,119 @@ static JNINativeMethod gMethods[] = {
     "(Ljava/lang/reflect/Method;Ljava/lang/reflect/Method;)V",
     (void*) replaceMethod
 	},
+	{
+	  "replaceMethods",
+	  "([Ljava/lang/reflect/Method;[Ljava/lang/reflect/Method;)[I",
+	  (void*) replaceMethods
+	},
+	{
+	  "enqueueReplaceMethods",
+	  "([Ljava/lang/reflect/Method;[Ljava/lang/reflect/Method;[I)J",
+	  (void*) enqueueReplaceMethods
+	},
+	{
+	  "awaitApplied",
+	  "(JJ)Z",
+	  (void*) awaitApplied
+	},
+	{
+	  "replaceMethodBySignature",
+	  "(Ljava/lang/Class;Ljava/lang/String;Ljava/lang/String;ZLjava/lang/Class;Ljava/lang/String;Ljava/lang/String;)I",
+	  (void*) replaceMethodBySignature
+	},
+	{
+	  "replaceMethodsBySignature",
+	  "([Ljava/lang/Class;[Ljava/lang/String;[Ljava/lang/String;[Z[Ljava/lang/Class;[Ljava/lang/String;[Ljava/lang/String;)[I",
+	  (void*) replaceMethodsBySignature
+	},
+	{
+	  "setFieldsPublic",
+	  "([Ljava/lang/reflect/Field;)I",
+	  (void*) setFieldsPublic
+	},
+	{
+	  "restore",
+	  "(Ljava/lang/reflect/Method;)Z",
+	  (void*) restore
+	},
+	{
+	  "restoreMethods",
+	  "()I",
+	  (void*) restoreMethods
+	},
 	{
 	  "setFieldFlag",
 	  "(Ljava/lang/reflect/Field;)V",
 	  (void*) setFieldFlag
 	},
+	{
+	  "getNativeStats",
+	  "()[J",
+	  (void*) getStats
+	},
+	{
+	  "dumpTrace",
+	  "()Ljava/lang/String;",
+	  (void*) dumpTrace
+	},
+	{
+	  "fingerprint",
+	  "(Ljava/lang/String;[B)[B",
+	  (void*) fingerprint
+	},
+};
+
+static JNINativeMethod gZipMethods[] = {
+	{
+	  "nativeOpen",
+	  "(Ljava/lang/String;)J",
+	  (void*) zipOpen
+	},
+	{
+	  "nativeClose",
+	  "(J)V",
+	  (void*) zipClose
+	},
+	{
+	  "nativeCount",
+	  "(J)I",
+	  (void*) zipCount
+	},
+	{
+	  "nativeName",
+	  "(JI)Ljava/lang/String;",
+	  (void*) zipName
+	},
+	{
+	  "nativeFind",
+	  "(JLjava/lang/String;)I",
+	  (void*) zipFind
+	},
+	{
+	  "nativeSize",
+	  "(JI)J",
+	  (void*) zipSize
+	},
+	{
+	  "nativeMap",
+	  "(JI)Ljava/nio/ByteBuffer;",
+	  (void*) zipMap
+	},
+	{
+	  "nativeOpenReader",
+	  "(JI)J",
+	  (void*) zipOpenReader
+	},
+	{
+	  "nativeRead",
+	  "(J[BII)I",
+	  (void*) zipRead
+	},
+	{
+	  "nativeCloseReader",
+	  "(J)V",
+	  (void*) zipCloseReader
+	},
 };
 
 /*
@@ -128,6 +948,14 @@ static int registerNatives(JNIEnv* env) {
 	if (!registerNativeMethods(env, JNIREG_CLASS, gMethods, sizeof(gMethods) / sizeof(gMethods[0]))) {
 		return JNI_FALSE;
 	}
+	// ZipArchive 只是读取补丁的快速路径，它注册失败(如被 ProGuard 删掉)时 Java 层退回 ZipFile
+	if (!registerNativeMethods(env, ZIPREG_CLASS, gZipMethods,
+			sizeof(gZipMethods) / sizeof(gZipMethods[0]))) {
+		LOGW("registerNatives: %s not registered", ZIPREG_CLASS);
+		if (env->ExceptionCheck()) {
+			env->ExceptionClear();
+		}
+	}
 	return JNI_TRUE;
 }
 
@@ -147,6 +975,8 @@ JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM* vm, void*) {
 	if (!registerNatives(env)) { //注册
 		return -1;
 	}
+	javaVM = vm;
+	applyQueue_init(applyQueued, attachApplier);
 	/* success -- return valid version number */
 	return JNI_VERSION_1_4;
 }
@@ -0,0 +1,113 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * andfix.h
+ *
+ * libandfix.so 对其它 native 库导出的 C 接口: 已经持有 jmethodID 的调用方可以直接替换方法，
+ * 不必回到 Java 层经过 AndFix.addReplaceMethod 的两次 JNI 切换与反射.
+ *
+ * - 与 Java 层共用同一套按版本分发的替换实现、快照与统计，也可以用 AndFix.restoreAll 撤销
+ * - 必须先由 Java 层调用 AndFix.setup()，否则返回 ANDFIX_ERROR_NOT_SETUP
+ * - 与 Java 层的替换/恢复互斥，可以在任意线程调用
+ * - 调用方应先检查 andfix_api_version() == ANDFIX_API_VERSION
+ *
+ * 链接: target_link_libraries(yourlib andfix)，或 dlopen("libandfix.so") 后 dlsym 各函数.
+ */
+
+#ifndef ANDFIX_H_
+#define ANDFIX_H_
+
+#include <jni.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ANDFIX_API_VERSION 2
+
+#define ANDFIX_EXPORT __attribute__ ((visibility ("default")))
+
+/*
+ * 返回值，与 AndFix.REPLACE_* 一致
+ */
+#define ANDFIX_OK 0
+#define ANDFIX_ERROR_NULL 1          // 参数为 null
+#define ANDFIX_ERROR_NOT_SETUP (-1)  // AndFix.setup() 尚未成功
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @return 本库实现的 ANDFIX_API_VERSION
+ */
+ANDFIX_EXPORT int andfix_api_version(void);
+
+/**
+ * target 的实现替换为 replacement 的实现
+ *
+ * @return ANDFIX_OK / ANDFIX_ERROR_*
+ */
+ANDFIX_EXPORT int andfix_replace(jmethodID target, jmethodID replacement);
+
+/**
+ * 批量替换 targets[i] -> replacements[i]，按地址顺序一次写入
+ *
+ * @param status 可为 NULL，否则写入每一项的 ANDFIX_OK / ANDFIX_ERROR_*
+ * @return 替换的方法数，未 setup 时为 ANDFIX_ERROR_NOT_SETUP
+ */
+ANDFIX_EXPORT int andfix_replace_batch(const jmethodID* targets, const jmethodID* replacements,
+		size_t count, int* status);
+
+/**
+ * andfix_replace_batch 的异步形式(API 2): 条目在调用线程检查后入队，由 applier 线程与其它线程
+ * 同时提交的批次合并写入，调用方不互相阻塞
+ *
+ * @param status 可为 NULL，否则写入每一项的 ANDFIX_OK / ANDFIX_ERROR_*
+ * @return 传给 andfix_await 的 ticket，没有要写入的方法时为 0，未 setup 时为 ANDFIX_ERROR_NOT_SETUP
+ */
+ANDFIX_EXPORT int64_t andfix_enqueue_batch(const jmethodID* targets,
+		const jmethodID* replacements, size_t count, int* status);
+
+/**
+ * 等待 andfix_enqueue_batch 返回的 ticket 写入(API 2)
+ *
+ * @param timeoutNs 小于 0 表示一直等，0 表示只检查
+ * @return 1 已写入，0 超时
+ */
+ANDFIX_EXPORT int andfix_await(int64_t ticket, int64_t timeoutNs);
+
+/**
+ * 撤销对 method 的替换
+ *
+ * art 上快照保存的 GC 引用可能已被移动式 GC 作废，见 snapshot.h 的限制说明
+ *
+ * @return 1 已恢复，0 该方法没有被替换过
+ */
+ANDFIX_EXPORT int andfix_restore(jmethodID method);
+
+/**
+ * 撤销所有替换(包括 Java 层发起的)
+ *
+ * @return 恢复的方法数
+ */
+ANDFIX_EXPORT size_t andfix_restore_all(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ANDFIX_H_ */
@@ -0,0 +1,177 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * apply_queue.cpp
+ *
+ * 侵入式 MPSC 队列(Vyukov): 入队是 head 上的一次 exchange 加一次 store，出队只由 applier
+ * 线程做，不需要 CAS. applier 用信号量睡眠，每个批次入队后 post 一次.
+ *
+ * ticket 在入队前用 fetch_add 分配，两个线程的分配顺序与入队顺序可能相反，所以 applier
+ * 记下写完的 ticket，只在它们连续时推进 appliedTicket.
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+#include <semaphore.h>
+
+#include "apply_queue.h"
+#include "common.h"
+
+struct ApplyNode {
+	std::atomic<ApplyNode*> next;
+	uint64_t ticket;
+	std::vector<ReplaceEntry> entries;
+};
+
+static applyEntries_func applyFn;
+static applierStart_func startFn;
+
+// 生产者在 head 入队，applier 从 tail 出队，stub 使队列永不为空
+static ApplyNode stub;
+static std::atomic<ApplyNode*> head(&stub);
+static ApplyNode* tail = &stub;
+
+static std::atomic<uint64_t> nextTicket(1);
+static sem_t pending;
+static std::once_flag started;
+
+// applier 推进，等待方读取
+static std::atomic<uint64_t> appliedTicket(0);
+static std::mutex appliedLock;
+static std::condition_variable appliedCond;
+
+static void push(ApplyNode* node) {
+	node->next.store(nullptr, std::memory_order_relaxed);
+	ApplyNode* prev = head.exchange(node, std::memory_order_acq_rel);
+	prev->next.store(node, std::memory_order_release);
+}
+
+/**
+ * 只在 applier 线程调用
+ *
+ * @return null 表示队列为空，或者有生产者正处于 exchange 与 store 之间(它随后会 post)
+ */
+static ApplyNode* pop() {
+	ApplyNode* node = tail;
+	ApplyNode* next = node->next.load(std::memory_order_acquire);
+	if (node == &stub) {
+		if (next == nullptr) {
+			return nullptr;
+		}
+		tail = next;
+		node = next;
+		next = next->next.load(std::memory_order_acquire);
+	}
+	if (next != nullptr) {
+		tail = next;
+		return node;
+	}
+	if (node != head.load(std::memory_order_acquire)) {
+		return nullptr;
+	}
+	push(&stub);
+	next = node->next.load(std::memory_order_acquire);
+	if (next != nullptr) {
+		tail = next;
+		return node;
+	}
+	return nullptr;
+}
+
+static void applierLoop() {
+	if (startFn != nullptr) {
+		startFn();
+	}
+	std::vector<ReplaceEntry> merged;
+	// 已写入但前面还有未写入 ticket 的批次
+	std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<uint64_t> > done;
+	for (;;) {
+		while (sem_wait(&pending) != 0 && errno == EINTR) {
+		}
+		size_t batches = 0;
+		merged.clear();
+		while (ApplyNode* node = pop()) {
+			merged.insert(merged.end(), node->entries.begin(), node->entries.end());
+			done.push(node->ticket);
+			delete node;
+			++batches;
+		}
+		if (batches == 0) {
+			continue; // 多余的 post，对应的批次已在上一轮写入
+		}
+		applyFn(merged);
+		LOGD("applyQueue: %d batches, %d methods", (int) batches, (int) merged.size());
+
+		uint64_t applied = appliedTicket.load(std::memory_order_relaxed);
+		while (!done.empty() && done.top() == applied + 1) {
+			applied = done.top();
+			done.pop();
+		}
+		{
+			std::lock_guard<std::mutex> lock(appliedLock);
+			appliedTicket.store(applied, std::memory_order_release);
+		}
+		appliedCond.notify_all();
+	}
+}
+
+static void start() {
+	sem_init(&pending, 0, 0);
+	std::thread(applierLoop).detach();
+}
+
+void applyQueue_init(applyEntries_func apply, applierStart_func onStart) {
+	applyFn = apply;
+	startFn = onStart;
+}
+
+uint64_t applyQueue_push(std::vector<ReplaceEntry>& entries) {
+	if (entries.empty()) {
+		return 0;
+	}
+	std::call_once(started, start);
+	ApplyNode* node = new ApplyNode();
+	node->entries.swap(entries);
+	node->ticket = nextTicket.fetch_add(1, std::memory_order_relaxed);
+	uint64_t ticket = node->ticket;
+	push(node);
+	sem_post(&pending);
+	return ticket;
+}
+
+bool applyQueue_await(uint64_t ticket, int64_t timeoutNs) {
+	auto applied = [ticket]() {
+		return appliedTicket.load(std::memory_order_acquire) >= ticket;
+	};
+	if (applied() || timeoutNs == 0) {
+		return applied();
+	}
+	std::unique_lock<std::mutex> lock(appliedLock);
+	if (timeoutNs < 0) {
+		appliedCond.wait(lock, applied);
+		return true;
+	}
+	return appliedCond.wait_for(lock, std::chrono::nanoseconds(timeoutNs), applied);
+}
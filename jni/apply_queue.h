@@ -0,0 +1,76 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * apply_queue.h
+ *
+ * 批量替换的提交队列.
+ *
+ * 多个线程各自解析好 ReplaceEntry 后把批次无锁地压入队列(MPSC，入队只有一次 exchange)，
+ * 由唯一的 applier 线程取出：同时在排队的批次按入队顺序拼成一批，一次 applyEntries 写完
+ * (一次加锁、一次挂起窗口). 调用方只在解析时并行，写入由 applier 串行.
+ *
+ * 每个批次入队时拿到一个递增的 ticket. applier 写完后推进"已写入"的 ticket，它之前的所有
+ * 批次都已写入；调用方用 applyQueue_await 等待自己的 ticket.
+ */
+
+#ifndef APPLY_QUEUE_H_
+#define APPLY_QUEUE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+struct ReplaceEntry {
+	void* method1;
+	void* method2;
+};
+
+/**
+ * 写入一批条目，在 applier 线程中调用
+ */
+typedef void (*applyEntries_func)(std::vector<ReplaceEntry>& entries);
+
+/**
+ * applier 线程开始取批次之前调用一次，在 applier 线程中
+ */
+typedef void (*applierStart_func)();
+
+/**
+ * 设置写入函数，第一次入队前调用
+ *
+ * @param onStart 可以为 null
+ */
+void applyQueue_init(applyEntries_func apply, applierStart_func onStart);
+
+/**
+ * 把 entries 作为一个批次入队，entries 被取走(调用后为空)，第一次调用时启动 applier 线程
+ *
+ * @return 批次的 ticket；entries 为空时返回 0，0 总是已写入
+ */
+uint64_t applyQueue_push(std::vector<ReplaceEntry>& entries);
+
+/**
+ * 等待 ticket 及之前的批次写入
+ *
+ * @param timeoutNs 小于 0 表示一直等，0 表示只检查
+ * @return 是否已写入
+ */
+bool applyQueue_await(uint64_t ticket, int64_t timeoutNs);
+
+#endif /* APPLY_QUEUE_H_ */
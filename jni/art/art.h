@@ -56,23 +56,27 @@ typedef signed int s4;
 typedef signed long long s8;
 #endif
 
-void replace_4_4(JNIEnv* env, jobject src, jobject dest);
+/**
+ * replace_x_x 的参数是已经通过 FromReflectedMethod 解析好的 ArtMethod 指针，
+ * 这样批量替换时可以先一次性解析，再逐个替换，不必每个方法都回到 JNI.
+ */
+void replace_4_4(void* src, void* dest);
 
 void setFieldFlag_4_4(JNIEnv* env, jobject field);
 
-void replace_5_0(JNIEnv* env, jobject src, jobject dest);
+void replace_5_0(void* src, void* dest);
 
 void setFieldFlag_5_0(JNIEnv* env, jobject field);
 
-void replace_5_1(JNIEnv* env, jobject src, jobject dest);
+void replace_5_1(void* src, void* dest);
 
 void setFieldFlag_5_1(JNIEnv* env, jobject field);
 
-void replace_6_0(JNIEnv* env, jobject src, jobject dest);
+void replace_6_0(void* src, void* dest);
 
 void setFieldFlag_6_0(JNIEnv* env, jobject field);
 
-void replace_7_0(JNIEnv* env, jobject method1, jobject method2);
+void replace_7_0(void* method1, void* method2);
 
 void setFieldFlag_7_0(JNIEnv* env, jobject field);
 
@@ -0,0 +1,348 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "art_layout.h"
+#include "../common.h"
+
+/**
+ * 探测用的类，见 AndFix.LayoutProbe:
+ * public static final void a(); private static void b(); private static native void n();
+ * 同一个类的方法在 methods_ 数组中按方法名排序连续存放，所以 a、b 相邻.
+ */
+#define PROBE_CLASS   "com/alipay/euler/andfix/AndFix$LayoutProbe"
+#define PROBE_FLAGS_A 0x0019 // ACC_PUBLIC | ACC_STATIC | ACC_FINAL
+#define PROBE_FLAGS_B 0x000a // ACC_PRIVATE | ACC_STATIC
+
+#define MAX_METHOD_SIZE 256
+#define NOT_FOUND       0xffff
+
+ArtMethodLayout artMethodLayout;
+
+// FNV-1a
+static uint64_t fingerprintHash(const char* fingerprint) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (const char* p = fingerprint; p != nullptr && *p != '\0'; ++p) {
+		hash ^= (uint8_t) *p;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static void probeNative(JNIEnv*, jclass) {
+}
+
+static bool validLayout(const ArtMethodLayout& layout) {
+	const uint16_t ptr = layout.pointer_size;
+	return layout.size <= MAX_METHOD_SIZE
+			&& layout.size % 4 == 0
+			&& layout.size >= layout.copy_offset + 3 * ptr
+			&& layout.access_flags_offset >= layout.copy_offset
+			&& layout.access_flags_offset + 4 <= layout.size
+			&& layout.entry_point_from_jni_offset + ptr <= layout.size
+			&& layout.entry_point_from_quick_compiled_code_offset + ptr <= layout.size;
+}
+
+static bool loadLayout(const char* path, const ArtMethodLayout& expect, ArtMethodLayout* out) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	ArtMethodLayout layout;
+	ssize_t len = read(fd, &layout, sizeof(layout));
+	close(fd);
+
+	if (len != (ssize_t) sizeof(layout)
+			|| layout.magic != ART_LAYOUT_MAGIC
+			|| layout.version != ART_LAYOUT_VERSION
+			|| layout.apilevel != expect.apilevel
+			|| layout.fingerprint != expect.fingerprint
+			|| layout.pointer_size != expect.pointer_size
+			|| !validLayout(layout)) {
+		return false;
+	}
+	*out = layout;
+	return true;
+}
+
+static void saveLayout(const char* path, const ArtMethodLayout& layout) {
+	std::string tmp = std::string(path) + ".tmp";
+	int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		LOGW("saveLayout: open %s failed", tmp.c_str());
+		return;
+	}
+	bool written = write(fd, &layout, sizeof(layout)) == (ssize_t) sizeof(layout);
+	close(fd);
+	// 先写临时文件再 rename，避免下次启动读到写了一半的描述符
+	if (!written || rename(tmp.c_str(), path) != 0) {
+		unlink(tmp.c_str());
+		LOGW("saveLayout: write %s failed", path);
+	}
+}
+
+/**
+ * a、b 是相邻的两个 ArtMethod，n 是已注册到 probeNative 的 native 方法
+ */
+static bool probeMethods(const char* a, const char* b, const char* n, ArtMethodLayout* layout) {
+	if (b <= a || b - a > MAX_METHOD_SIZE) {
+		return false;
+	}
+	const size_t size = (size_t) (b - a);
+
+	uint16_t access = NOT_FOUND;
+	for (size_t offset = 0; offset + 4 <= size; offset += 4) {
+		uint32_t flagsA;
+		uint32_t flagsB;
+		memcpy(&flagsA, a + offset, 4);
+		memcpy(&flagsB, b + offset, 4);
+		// 高 16 位是 art 内部使用的标志位
+		if ((flagsA & 0xffff) == PROBE_FLAGS_A && (flagsB & 0xffff) == PROBE_FLAGS_B) {
+			access = (uint16_t) offset;
+			break;
+		}
+	}
+
+	// ptr_sized_fields_ 是 PACKED(4) 的，所以按 4 字节步进
+	uint16_t jni = NOT_FOUND;
+	for (size_t offset = 0; offset + sizeof(void*) <= size; offset += 4) {
+		void* value;
+		memcpy(&value, n + offset, sizeof(void*));
+		if (value == (void*) probeNative) {
+			jni = (uint16_t) offset;
+			break;
+		}
+	}
+
+	if (access == NOT_FOUND || jni == NOT_FOUND) {
+		return false;
+	}
+	layout->size = (uint16_t) size;
+	layout->access_flags_offset = access;
+	layout->entry_point_from_jni_offset = jni;
+	// 5.1 ~ 7.0 中 entry_point_from_quick_compiled_code_ 都紧跟在 entry_point_from_jni_ 后面
+	layout->entry_point_from_quick_compiled_code_offset = (uint16_t) (jni + sizeof(void*));
+	layout->probed = 1;
+	return validLayout(*layout);
+}
+
+static bool probeLayout(JNIEnv* env, ArtMethodLayout* layout) {
+	jclass clazz = env->FindClass(PROBE_CLASS);
+	if (clazz == nullptr) {
+		env->ExceptionClear();
+		// 多半是被 ProGuard/R8 删掉了，见 README 中的 keep 规则
+		LOGE("probeLayout: %s not found, is it kept by ProGuard?", PROBE_CLASS);
+		return false;
+	}
+
+	bool probed = false;
+	JNINativeMethod probe = { "n", "()V", (void*) probeNative };
+	if (env->RegisterNatives(clazz, &probe, 1) == JNI_OK) {
+		// 6.0 起 jmethodID 就是 ArtMethod*
+		const char* a = (const char*) env->GetStaticMethodID(clazz, "a", "()V");
+		const char* b = (const char*) env->GetStaticMethodID(clazz, "b", "()V");
+		const char* n = (const char*) env->GetStaticMethodID(clazz, "n", "()V");
+		if (a != nullptr && b != nullptr && n != nullptr) {
+			probed = probeMethods(a, b, n, layout);
+		} else {
+			LOGE("probeLayout: %s lost a(), b() or n(), is it kept by ProGuard?", PROBE_CLASS);
+		}
+	} else {
+		LOGE("probeLayout: RegisterNatives on %s failed", PROBE_CLASS);
+	}
+	if (env->ExceptionCheck()) {
+		env->ExceptionClear();
+	}
+	env->DeleteLocalRef(clazz);
+	return probed;
+}
+
+bool art_initLayout(JNIEnv* env, const ArtMethodLayout& layout,
+		const char* fingerprint, const char* cachePath) {
+	artMethodLayout = layout;
+	artMethodLayout.magic = ART_LAYOUT_MAGIC;
+	artMethodLayout.version = ART_LAYOUT_VERSION;
+	artMethodLayout.fingerprint = fingerprintHash(fingerprint);
+	artMethodLayout.pointer_size = sizeof(void*);
+	artMethodLayout.probed = 0;
+
+	if (cachePath != nullptr && loadLayout(cachePath, artMethodLayout, &artMethodLayout)) {
+		LOGD("art_initLayout: cached size=%d probed=%d",
+				artMethodLayout.size, artMethodLayout.probed);
+		return true;
+	}
+
+	// 6.0 以下 ArtMethod 是 mirror::Object，在堆上分配，相邻的方法不一定连续，只能用默认布局
+	if (artMethodLayout.apilevel > 22) {
+		ArtMethodLayout probed = artMethodLayout;
+		if (probeLayout(env, &probed)) {
+			if (probed.size != layout.size
+					|| probed.access_flags_offset != layout.access_flags_offset
+					|| probed.entry_point_from_jni_offset != layout.entry_point_from_jni_offset) {
+				LOGW("art_initLayout: ArtMethod differs from AOSP, size %d -> %d",
+						layout.size, probed.size);
+			}
+			artMethodLayout = probed;
+		} else {
+			LOGW("art_initLayout: probe failed, use default layout");
+		}
+	}
+
+	if (!validLayout(artMethodLayout)) {
+		LOGE("art_initLayout: invalid layout, size=%d", artMethodLayout.size);
+		return false;
+	}
+	if (artMethodLayout.apilevel > ART_LAYOUT_MAX_DEFAULT_API && !artMethodLayout.probed) {
+		// 7.0 的布局只是猜测，不能在没验证过的情况下改写方法
+		LOGE("art_initLayout: apilevel %d needs a probed layout", artMethodLayout.apilevel);
+		return false;
+	}
+	if (cachePath != nullptr) {
+		saveLayout(cachePath, artMethodLayout);
+	}
+	LOGD("art_initLayout: size=%d probed=%d", artMethodLayout.size, artMethodLayout.probed);
+	return true;
+}
+
+/**
+ * 桥读取 method + art_bridgeEntryOffset 处的入口，只要仍是桥自己就自旋，否则跳到新入口.
+ * 只用调用约定中的临时寄存器(x86_64: rax、r11; arm64: x16、x17)，参数寄存器原样交给新入口.
+ * 入口用 acquire 读取(arm64 上是 ldar)，与 art_writeMethod 最后的 release 写配对，
+ * 跳到新入口后看到的方法其余字段一定是写完的.
+ */
+extern "C" __attribute__ ((visibility ("hidden"))) uint32_t art_bridgeEntryOffset;
+uint32_t art_bridgeEntryOffset;
+
+#if defined(__x86_64__)
+extern "C" void art_quickBridgeEntry();
+__asm__(
+	".text\n"
+	".globl art_quickBridgeEntry\n"
+	".hidden art_quickBridgeEntry\n"
+	".type art_quickBridgeEntry, @function\n"
+	"art_quickBridgeEntry:\n"
+	"1:\n"
+	"	movl art_bridgeEntryOffset(%rip), %eax\n"
+	"	movq (%rdi, %rax), %r11\n"
+	"	leaq art_quickBridgeEntry(%rip), %rax\n"
+	"	cmpq %rax, %r11\n"
+	"	jne 2f\n"
+	"	pause\n"
+	"	jmp 1b\n"
+	"2:\n"
+	"	jmp *%r11\n"
+	".size art_quickBridgeEntry, . - art_quickBridgeEntry\n"
+);
+#define HAS_QUICK_BRIDGE 1
+#elif defined(__aarch64__)
+extern "C" void art_quickBridgeEntry();
+__asm__(
+	".text\n"
+	".globl art_quickBridgeEntry\n"
+	".hidden art_quickBridgeEntry\n"
+	".type art_quickBridgeEntry, %function\n"
+	"art_quickBridgeEntry:\n"
+	"1:\n"
+	"	adrp x16, art_bridgeEntryOffset\n"
+	"	ldr w16, [x16, :lo12:art_bridgeEntryOffset]\n"
+	"	add x16, x0, x16\n"
+	"	ldar x16, [x16]\n"
+	"	adr x17, art_quickBridgeEntry\n"
+	"	cmp x16, x17\n"
+	"	b.ne 2f\n"
+	"	yield\n"
+	"	b 1b\n"
+	"2:\n"
+	"	br x16\n"
+	".size art_quickBridgeEntry, . - art_quickBridgeEntry\n"
+);
+#define HAS_QUICK_BRIDGE 1
+#else
+#define HAS_QUICK_BRIDGE 0
+#endif
+
+void* art_quickBridge() {
+#if HAS_QUICK_BRIDGE
+	return (void*) &art_quickBridgeEntry;
+#else
+	return nullptr;
+#endif
+}
+
+void art_writeMethod(void* method, const void* bytes, size_t offset, size_t size) {
+	const size_t entryOffset = artMethodLayout.entry_point_from_quick_compiled_code_offset;
+	char* base = (char*) method;
+	void** entry = (void**) (base + entryOffset);
+	if (entryOffset < offset || entryOffset + sizeof(void*) > offset + size
+			|| (offset | size | entryOffset) % sizeof(uint32_t) != 0) {
+		// 布局异常时退回到直接拷贝
+		memcpy(base + offset, bytes, size);
+		return;
+	}
+
+	void* bridge = art_quickBridge();
+	if (bridge != nullptr) {
+		__atomic_store_n(&art_bridgeEntryOffset, (uint32_t) entryOffset, __ATOMIC_RELAXED);
+		__atomic_store_n(entry, bridge, __ATOMIC_RELAXED);
+	}
+	// 读到后面任何一个新字段的线程，再读入口时至少能看到桥
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	const char* src = (const char*) bytes - offset;
+	for (size_t i = offset; i < offset + size; i += sizeof(uint32_t)) {
+		if (i >= entryOffset && i < entryOffset + sizeof(void*)) {
+			continue;
+		}
+		uint32_t word;
+		memcpy(&word, src + i, sizeof(word));
+		__atomic_store_n((uint32_t*) (base + i), word, __ATOMIC_RELAXED);
+	}
+
+	void* newEntry;
+	memcpy(&newEntry, src + entryOffset, sizeof(void*));
+	__atomic_store_n(entry, newEntry, __ATOMIC_RELEASE);
+}
+
+void art_copyMethod(void* dest, const void* src) {
+	const ArtMethodLayout& layout = artMethodLayout;
+	size_t size = layout.size - layout.copy_offset;
+	// 布局的 size 不超过 MAX_METHOD_SIZE(见 validLayout)，先在栈上拼出完整的新方法，再一次性按顺序写入 dest
+	char image[MAX_METHOD_SIZE];
+	memcpy(image, (const char*) src + layout.copy_offset, size);
+	uint32_t accessFlags;
+	memcpy(&accessFlags, image + layout.access_flags_offset - layout.copy_offset,
+			sizeof(accessFlags));
+	accessFlags |= 0x0001;
+	memcpy(image + layout.access_flags_offset - layout.copy_offset, &accessFlags,
+			sizeof(accessFlags));
+	art_writeMethod(dest, image, layout.copy_offset, size);
+}
+
+void* art_quickEntryPoint(const void* method) {
+	void* entryPoint;
+	memcpy(&entryPoint,
+			(const char*) method + artMethodLayout.entry_point_from_quick_compiled_code_offset,
+			sizeof(void*));
+	return entryPoint;
+}
@@ -0,0 +1,122 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * art_layout.h
+ *
+ * ArtMethod 布局描述符.
+ *
+ * art_x_x.h 中写死的 ArtMethod 结构是按 AOSP 源码构建的，厂商 ROM 可以任意修改它. 所以在
+ * art_setup 中先用 art_x_x.h 得到默认布局，再在运行时探测真实的 sizeof(ArtMethod) 以及
+ * access_flags_ / entry_point_from_jni_ / entry_point_from_quick_compiled_code_ 的偏移.
+ * 探测结果按 build fingerprint 持久化，之后的启动直接读取，不再探测.
+ * replace_x_x 按描述符中的偏移拷贝 ArtMethod，而不是按写死的结构体成员拷贝.
+ */
+
+#ifndef ART_LAYOUT_H_
+#define ART_LAYOUT_H_
+
+#include <jni.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ART_LAYOUT_MAGIC   0x594c4641 // "AFLY"
+#define ART_LAYOUT_VERSION 1
+
+/*
+ * art_x_x.h 中有默认布局的最高 apilevel(7.0)；更高的版本只在探测成功时才能替换
+ */
+#define ART_LAYOUT_MAX_DEFAULT_API 24
+
+/**
+ * 持久化到磁盘的格式就是这个结构体本身，只在同一台设备上读写，所以不考虑字节序
+ */
+struct ArtMethodLayout {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t apilevel;
+	uint64_t fingerprint;    // ro.build.fingerprint 的 hash
+	uint16_t size;           // sizeof(ArtMethod)
+	uint16_t copy_offset;    // 从这里开始拷贝，4.4~5.1 的 ArtMethod 是 mirror::Object，要跳过对象头
+	uint16_t access_flags_offset;
+	uint16_t entry_point_from_jni_offset;
+	uint16_t entry_point_from_quick_compiled_code_offset;
+	uint8_t pointer_size;
+	uint8_t probed;          // 1: 运行时探测得到; 0: art_x_x.h 中的默认值
+};
+
+#define LAYOUT_OFFSET(obj, field) \
+	((uint16_t) ((const char*) &(obj).field - (const char*) &(obj)))
+
+/**
+ * 当前使用的布局，在 art_setup 中确定
+ */
+extern ArtMethodLayout artMethodLayout;
+
+/**
+ * art_x_x.h 中结构体对应的默认布局，定义在各个 art_method_replace_x_x.cpp 中
+ */
+void layout_4_4(ArtMethodLayout* layout);
+
+void layout_5_0(ArtMethodLayout* layout);
+
+void layout_5_1(ArtMethodLayout* layout);
+
+void layout_6_0(ArtMethodLayout* layout);
+
+void layout_7_0(ArtMethodLayout* layout);
+
+/**
+ * 确定 artMethodLayout: 先读缓存，缓存无效时(6.0 及以上)探测并写回缓存.
+ *
+ * @param layout      art_x_x.h 的默认布局
+ * @param fingerprint ro.build.fingerprint，可以为 null
+ * @param cachePath   布局缓存文件，可以为 null
+ * @return false 表示没有可用的布局: 默认布局不合法，或 apilevel 高于 ART_LAYOUT_MAX_DEFAULT_API
+ *         而探测失败(没有经过验证的默认布局)
+ */
+bool art_initLayout(JNIEnv* env, const ArtMethodLayout& layout,
+		const char* fingerprint, const char* cachePath);
+
+/**
+ * 按 artMethodLayout 把 src 拷贝到 dest，并把 dest 的访问权限改为 public，写入顺序见 art_writeMethod
+ */
+void art_copyMethod(void* dest, const void* src);
+
+/**
+ * 把 bytes 写入 method 的 [offset, offset + size)，该区间必须包含 quick 入口.
+ *
+ * 替换时其他线程可能正在调用 method，直接 memcpy 会让它们拿到新入口、旧字段(或相反).
+ * 所以按以下顺序写:
+ * 1. 入口先切到 art_quickBridge(有的话)，之后进入的调用在桥里自旋，等入口变为真正的实现；
+ * 2. release fence 后逐个 4 字节写入入口以外的字段；
+ * 3. 最后以 release 语义写入新入口.
+ * 已经在旧实现中执行的线程不受影响，它们由挂起所有线程来保证.
+ */
+void art_writeMethod(void* method, const void* bytes, size_t offset, size_t size);
+
+/**
+ * 替换期间临时使用的 quick 入口，x86_64 与 arm64 之外为 null(只保证入口最后写入)
+ */
+void* art_quickBridge();
+
+/**
+ * 按 artMethodLayout 读取 entry_point_from_quick_compiled_code_，用于日志
+ */
+void* art_quickEntryPoint(const void* method);
+
+#endif /* ART_LAYOUT_H_ */
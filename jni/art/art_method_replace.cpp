@@ -34,32 +34,163 @@
 #include <sys/wait.h>
 
 #include "art.h"
+#include "art_layout.h"
 #include "../common.h"
+#include "../snapshot.h"
+#include "../elf/elf_resolver.h"
+
+typedef void (*replaceMethod_func)(void* method1, void* method2);
+typedef void (*setFieldFlag_func)(JNIEnv* env, jobject field);
+// art::ScopedSuspendAll::ScopedSuspendAll(const char* cause, bool long_suspend) / ~ScopedSuspendAll()
+typedef void (*scopedSuspendAll_func)(void* self, const char* cause, bool longSuspend);
+typedef void (*scopedResumeAll_func)(void* self);
+// art::Dbg::SuspendVM() / art::Dbg::ResumeVM()
+typedef void (*suspendVM_func)();
 
 static int apilevel;
 
+/**
+ * 按 apilevel 在 art_setup 中选定一次，之后每次替换只是一次间接调用
+ */
+static replaceMethod_func replaceMethod_fnPtr;
+static setFieldFlag_func setFieldFlag_fnPtr;
+
+/**
+ * 挂起/恢复所有线程，在 art_setup 中解析:
+ * 7.0 起用 ScopedSuspendAll(ThreadList::SuspendAll 需要 ThreadList 实例，拿不到)；
+ * 5.0 ~ 6.0 退回 Dbg::SuspendVM/ResumeVM；都没有时批量替换不挂起.
+ */
+static scopedSuspendAll_func scopedSuspendAll_fnPtr;
+static scopedResumeAll_func scopedResumeAll_fnPtr;
+static suspendVM_func suspendVM_fnPtr;
+static suspendVM_func resumeVM_fnPtr;
+// ScopedSuspendAll 没有成员，这里给它留足空间
+static char scopedSuspendAll[16] __attribute__ ((aligned (8)));
+
+static void resolveSuspendAll() {
+  scopedSuspendAll_fnPtr = nullptr;
+  scopedResumeAll_fnPtr = nullptr;
+  suspendVM_fnPtr = nullptr;
+  resumeVM_fnPtr = nullptr;
+  if (apilevel > 23) {
+    scopedSuspendAll_fnPtr = reinterpret_cast<scopedSuspendAll_func>(
+        elf_findSymbol("libart.so", "_ZN3art16ScopedSuspendAllC1EPKcb"));
+    scopedResumeAll_fnPtr = reinterpret_cast<scopedResumeAll_func>(
+        elf_findSymbol("libart.so", "_ZN3art16ScopedSuspendAllD1Ev"));
+    if (scopedSuspendAll_fnPtr != nullptr && scopedResumeAll_fnPtr != nullptr) {
+      return;
+    }
+    scopedSuspendAll_fnPtr = nullptr;
+    scopedResumeAll_fnPtr = nullptr;
+  }
+  if (apilevel > 19) {
+    suspendVM_fnPtr = reinterpret_cast<suspendVM_func>(
+        elf_findSymbol("libart.so", "_ZN3art3Dbg9SuspendVMEv"));
+    resumeVM_fnPtr = reinterpret_cast<suspendVM_func>(
+        elf_findSymbol("libart.so", "_ZN3art3Dbg8ResumeVMEv"));
+    if (suspendVM_fnPtr != nullptr && resumeVM_fnPtr != nullptr) {
+      return;
+    }
+    suspendVM_fnPtr = nullptr;
+    resumeVM_fnPtr = nullptr;
+  }
+  LOGW("art_setup: no suspend-all entry point, batches are written without suspension");
+}
+
+/**
+ * @param fingerprint ro.build.fingerprint，布局缓存的 key
+ * @param layoutCache ArtMethod 布局缓存文件，null 表示不缓存
+ */
 extern jboolean __attribute__ ((visibility ("hidden")))
-art_setup(JNIEnv*, int level) {
+art_setup(JNIEnv* env, int level, const char* fingerprint, const char* layoutCache) {
 	apilevel = level;
+	ArtMethodLayout layout = ArtMethodLayout();
+	layout.apilevel = (uint16_t) level;
+  if (apilevel > 23) {
+    replaceMethod_fnPtr = replace_7_0;
+    setFieldFlag_fnPtr = setFieldFlag_7_0;
+    layout_7_0(&layout);
+  } else if (apilevel > 22) {
+    replaceMethod_fnPtr = replace_6_0;
+    setFieldFlag_fnPtr = setFieldFlag_6_0;
+    layout_6_0(&layout);
+  } else if (apilevel > 21) {
+    replaceMethod_fnPtr = replace_5_1;
+    setFieldFlag_fnPtr = setFieldFlag_5_1;
+    layout_5_1(&layout);
+  } else if (apilevel > 19) {
+    replaceMethod_fnPtr = replace_5_0;
+    setFieldFlag_fnPtr = setFieldFlag_5_0;
+    layout_5_0(&layout);
+  } else {
+    replaceMethod_fnPtr = replace_4_4;
+    setFieldFlag_fnPtr = setFieldFlag_4_4;
+    layout_4_4(&layout);
+  }
+  if (replaceMethod_fnPtr == nullptr || setFieldFlag_fnPtr == nullptr) {
+    LOGE("art_setup: no replacer bound for apilevel %d", apilevel);
+    return JNI_FALSE;
+  }
+  if (!art_initLayout(env, layout, fingerprint, layoutCache)) {
+    return JNI_FALSE;
+  }
+  resolveSuspendAll();
 	return JNI_TRUE;
 }
 
+/**
+ * 挂起除当前线程外的所有线程，调用方不能持有 mutator lock(JNI 方法中处于 native 状态即可)，
+ * 挂起期间不能再调用 JNI.
+ *
+ * @return false 表示没有可用的挂起接口，没有挂起，也不需要 art_resumeAll
+ */
+extern bool __attribute__ ((visibility ("hidden")))
+art_suspendAll() {
+  if (scopedSuspendAll_fnPtr != nullptr) {
+    scopedSuspendAll_fnPtr(scopedSuspendAll, "andfix", false);
+    return true;
+  }
+  if (suspendVM_fnPtr != nullptr) {
+    suspendVM_fnPtr();
+    return true;
+  }
+  return false;
+}
+
+extern void __attribute__ ((visibility ("hidden")))
+art_resumeAll() {
+  if (scopedResumeAll_fnPtr != nullptr) {
+    scopedResumeAll_fnPtr(scopedSuspendAll);
+  } else if (resumeVM_fnPtr != nullptr) {
+    resumeVM_fnPtr();
+  }
+}
+
+/**
+ * 为接下来 count 次 art_replaceArtMethod 预留快照，批量替换在挂起线程之前调用
+ */
+extern bool __attribute__ ((visibility ("hidden")))
+art_reserveSnapshots(size_t count) {
+  return snapshot_reserve(count, artMethodLayout.size - artMethodLayout.copy_offset);
+}
+
+/**
+ * dest替换src, 参数为已解析的 ArtMethod 指针(jmethodID)，批量替换时直接使用
+ */
+extern void __attribute__ ((visibility ("hidden")))
+art_replaceArtMethod(void* method1, void* method2) {
+  // 保存原始字节，用于 restoreMethod/restoreAll
+  snapshot_save(method1, artMethodLayout.copy_offset,
+                artMethodLayout.size - artMethodLayout.copy_offset);
+  replaceMethod_fnPtr(method1, method2);
+}
+
 /**
  * dest替换src
  */
 extern void __attribute__ ((visibility ("hidden"))) 
 art_replaceMethod(JNIEnv* env, jobject method1, jobject method2) {
-  if (apilevel > 23) {
-    replace_7_0(env, method1, method2);
-  } else if (apilevel > 22) {
-		replace_6_0(env, method1, method2);
-	} else if (apilevel > 21) {
-		replace_5_1(env, method1, method2);
-	} else if (apilevel > 19) {
-		replace_5_0(env, method1, method2);
-  } else {
-    replace_4_4(env, method1, method2);
-  }
+  art_replaceArtMethod(env->FromReflectedMethod(method1), env->FromReflectedMethod(method2));
 }
 
 /**
@@ -68,15 +199,5 @@ art_replaceMethod(JNIEnv* env, jobject method1, jobject method2) {
  */
 extern void __attribute__ ((visibility ("hidden")))
 art_setFieldFlag(JNIEnv* env, jobject field) {
-  if (apilevel > 23) {
-    setFieldFlag_7_0(env, field);
-  } else if (apilevel > 22) {
-    setFieldFlag_6_0(env, field);
-  } else if (apilevel > 21) {
-    setFieldFlag_5_1(env, field);
-  } else  if (apilevel > 19) {
-    setFieldFlag_5_0(env, field);
-  } else {
-    setFieldFlag_4_4(env, field);
-  }
+  setFieldFlag_fnPtr(env, field);
 }
@@ -34,12 +34,14 @@
 #include <sys/wait.h>
 
 #include "art.h"
+#include "art_layout.h"
 #include "art_4_4.h"
 #include "../common.h"
+#include "../trace.h"
 
-void replace_4_4(JNIEnv* env, jobject src, jobject dest) {
-	art::mirror::ArtMethod* smeth = (art::mirror::ArtMethod*) env->FromReflectedMethod(src);
-	art::mirror::ArtMethod* dmeth = (art::mirror::ArtMethod*) env->FromReflectedMethod(dest);
+void replace_4_4(void* src, void* dest) {
+	art::mirror::ArtMethod* smeth = (art::mirror::ArtMethod*) src;
+	art::mirror::ArtMethod* dmeth = (art::mirror::ArtMethod*) dest;
 
     // for plugin classloader
 	dmeth->declaring_class_->class_loader_ = smeth->declaring_class_->class_loader_; 
@@ -48,31 +50,24 @@ void replace_4_4(JNIEnv* env, jobject src, jobject dest) {
 	//for reflection invoke
 	reinterpret_cast<art::mirror::Class*>(dmeth->declaring_class_)->super_class_ = 0;
 
-	smeth->declaring_class_ = dmeth->declaring_class_;
-  smeth->dex_cache_initialized_static_storage_ = dmeth->dex_cache_initialized_static_storage_;
-  smeth->access_flags_ = dmeth->access_flags_  | 0x0001;
-  smeth->dex_cache_resolved_types_ = dmeth->dex_cache_resolved_types_;
-  smeth->dex_cache_resolved_methods_ = dmeth->dex_cache_resolved_methods_;
-  smeth->dex_cache_strings_ = dmeth->dex_cache_strings_;
-  smeth->code_item_offset_ = dmeth->code_item_offset_;
-  smeth->core_spill_mask_ = dmeth->core_spill_mask_;
-  smeth->fp_spill_mask_ = dmeth->fp_spill_mask_;
-  smeth->method_dex_index_ = dmeth->method_dex_index_;
-  smeth->mapping_table_ = dmeth->mapping_table_;
-  smeth->method_index_ = dmeth->method_index_;
-  smeth->gc_map_ = dmeth->gc_map_;
-  smeth->frame_size_in_bytes_ = dmeth->frame_size_in_bytes_;
-  smeth->native_method_ = dmeth->native_method_;
-  smeth->vmap_table_ = dmeth->vmap_table_;
-  smeth->entry_point_from_compiled_code_ = dmeth->entry_point_from_compiled_code_;
-  smeth->entry_point_from_interpreter_ = dmeth->entry_point_from_interpreter_;
-  smeth->method_index_ = dmeth->method_index_;
+	// 按运行时确定的布局整体拷贝，而不是按 art_4_4.h 中的成员逐个拷贝
+	art_copyMethod(smeth, dmeth);
 
-	LOGD("replace_4_4: %d , %d", smeth->entry_point_from_compiled_code_, dmeth->entry_point_from_compiled_code_);
+	trace_record(TRACE_REPLACE, 44, smeth, dmeth);
+}
+
+void layout_4_4(ArtMethodLayout* layout) {
+	art::mirror::ArtMethod method;
+	layout->size = sizeof(method);
+	layout->copy_offset = LAYOUT_OFFSET(method, declaring_class_);
+	layout->access_flags_offset = LAYOUT_OFFSET(method, access_flags_);
+	layout->entry_point_from_jni_offset = LAYOUT_OFFSET(method, native_method_);
+	layout->entry_point_from_quick_compiled_code_offset =
+			LAYOUT_OFFSET(method, entry_point_from_compiled_code_);
 }
 
 void setFieldFlag_4_4(JNIEnv* env, jobject field) {
 	art::mirror::ArtField* artField = (art::mirror::ArtField*) env->FromReflectedField(field);
 	artField->access_flags_ = artField->access_flags_ & (~0x0002) | 0x0001;
-	LOGD("setFieldFlag_4_4: %d ", artField->access_flags_);
+	trace_record(TRACE_SET_FIELD_FLAG, artField->access_flags_, artField, nullptr);
 }
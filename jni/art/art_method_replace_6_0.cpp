@@ -34,12 +34,14 @@
 #include <sys/wait.h>
 
 #include "art.h"
+#include "art_layout.h"
 #include "art_6_0.h"
 #include "../common.h"
+#include "../trace.h"
 
-void replace_6_0(JNIEnv* env, jobject src, jobject dest) {
-  art::mirror::ArtMethod* smeth = (art::mirror::ArtMethod*) env->FromReflectedMethod(src);
-  art::mirror::ArtMethod* dmeth = (art::mirror::ArtMethod*) env->FromReflectedMethod(dest);
+void replace_6_0(void* src, void* dest) {
+  art::mirror::ArtMethod* smeth = (art::mirror::ArtMethod*) src;
+  art::mirror::ArtMethod* dmeth = (art::mirror::ArtMethod*) dest;
 
   // for plugin classloader
   reinterpret_cast<art::mirror::Class*>(dmeth->declaring_class_)->class_loader_ =
@@ -54,30 +56,24 @@ void replace_6_0(JNIEnv* env, jobject src, jobject dest) {
   // for reflection invoke
   reinterpret_cast<art::mirror::Class*>(dmeth->declaring_class_)->super_class_ = 0;
 
-  smeth->declaring_class_ = dmeth->declaring_class_;
-  smeth->dex_cache_resolved_methods_ = dmeth->dex_cache_resolved_methods_;
-  smeth->dex_cache_resolved_types_ = dmeth->dex_cache_resolved_types_;
-  smeth->access_flags_ = dmeth->access_flags_ | 0x0001;
-  smeth->dex_code_item_offset_ = dmeth->dex_code_item_offset_;
-  smeth->dex_method_index_ = dmeth->dex_method_index_;
-  smeth->method_index_ = dmeth->method_index_;
+  // 按运行时确定的布局整体拷贝，而不是按 art_6_0.h 中的成员逐个拷贝
+  art_copyMethod(smeth, dmeth);
 
-  smeth->ptr_sized_fields_.entry_point_from_interpreter_ =
-      dmeth->ptr_sized_fields_.entry_point_from_interpreter_;
-
-  smeth->ptr_sized_fields_.entry_point_from_jni_ =
-      dmeth->ptr_sized_fields_.entry_point_from_jni_;
-
-  smeth->ptr_sized_fields_.entry_point_from_quick_compiled_code_ =
-      dmeth->ptr_sized_fields_.entry_point_from_quick_compiled_code_;
+  trace_record(TRACE_REPLACE, 60, smeth, dmeth);
+}
 
-  LOGD("replace_6_0: %d , %d",
-      smeth->ptr_sized_fields_.entry_point_from_quick_compiled_code_,
-      dmeth->ptr_sized_fields_.entry_point_from_quick_compiled_code_);
+void layout_6_0(ArtMethodLayout* layout) {
+	art::mirror::ArtMethod method;
+	layout->size = sizeof(method);
+	layout->copy_offset = LAYOUT_OFFSET(method, declaring_class_);
+	layout->access_flags_offset = LAYOUT_OFFSET(method, access_flags_);
+	layout->entry_point_from_jni_offset = LAYOUT_OFFSET(method, ptr_sized_fields_.entry_point_from_jni_);
+	layout->entry_point_from_quick_compiled_code_offset =
+			LAYOUT_OFFSET(method, ptr_sized_fields_.entry_point_from_quick_compiled_code_);
 }
 
 void setFieldFlag_6_0(JNIEnv* env, jobject field) {
 	art::mirror::ArtField* artField = (art::mirror::ArtField*) env->FromReflectedField(field);
 	artField->access_flags_ = artField->access_flags_ & (~0x0002) | 0x0001;
-	LOGD("setFieldFlag_6_0: %d ", artField->access_flags_);
+	trace_record(TRACE_SET_FIELD_FLAG, artField->access_flags_, artField, nullptr);
 }
@@ -0,0 +1,121 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * dispatch_bench.cpp
+ *
+ * art_replaceArtMethod 的单次调用开销(host 上运行，依赖 andfix_host 与 host/ 中的合成对象).
+ * 每种 art 布局先经 art_setup 绑定，再对同一组合成 ArtMethod 测两种分发方式:
+ * 1. chain: 每次调用都按 apilevel 走 if/else 链再调用 replace_x_x(旧实现，作为基线)
+ * 2. table: andfix 实际走的 art_replaceArtMethod，art_setup 时选定的函数指针
+ * 两者都先 snapshot_save，与旧实现一致；计时不含 JNI 与挂起.
+ *
+ * usage: andfix_dispatch_bench
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <vector>
+
+#include "../host/fake_jni_env.h"
+#include "../host/fake_runtime.h"
+#include "../art/art.h"
+#include "../art/art_layout.h"
+#include "../snapshot.h"
+
+#define METHOD_COUNT 1024  // 一个大补丁的量级
+#define ROUNDS 200
+#define REPS 5
+
+extern jboolean art_setup(JNIEnv* env, int level, const char* fingerprint,
+		const char* layoutCache);
+extern void art_replaceArtMethod(void* method1, void* method2);
+
+typedef void (*replace_func)(void* method1, void* method2);
+
+// volatile：防止编译器把 apilevel 当作常量把分支折叠掉
+static volatile int apilevel;
+
+static __attribute__((noinline)) void chain_replace(void* method1, void* method2) {
+	snapshot_save(method1, artMethodLayout.copy_offset,
+			artMethodLayout.size - artMethodLayout.copy_offset);
+	if (apilevel > 23) {
+		replace_7_0(method1, method2);
+	} else if (apilevel > 22) {
+		replace_6_0(method1, method2);
+	} else if (apilevel > 21) {
+		replace_5_1(method1, method2);
+	} else if (apilevel > 19) {
+		replace_5_0(method1, method2);
+	} else {
+		replace_4_4(method1, method2);
+	}
+}
+
+static double nowNs() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @return REPS 次中位数，ns/call
+ */
+static double measure(replace_func replace, const FakeMethodTable& targets,
+		const FakeMethodTable& replacements) {
+	std::vector<double> times;
+	for (int rep = 0; rep < REPS; ++rep) {
+		double start = nowNs();
+		for (int round = 0; round < ROUNDS; ++round) {
+			for (size_t i = 0; i < targets.count; ++i) {
+				replace(targets.method(i), replacements.method(i));
+			}
+		}
+		times.push_back((nowNs() - start) / ((double) ROUNDS * targets.count));
+	}
+	std::sort(times.begin(), times.end());
+	return times[times.size() / 2];
+}
+
+int main() {
+	printf("%-8s %12s %12s\n", "layout", "chain ns", "table ns");
+	for (const FakeRuntime* const* it = fakeRuntimes; *it != nullptr; ++it) {
+		const FakeRuntime& runtime = **it;
+		if (!runtime.isArt) {
+			continue;
+		}
+		fake_defineProbeClass(runtime);
+		if (!art_setup(fake_env(), runtime.apilevel, "host/andfix/bench:user/release-keys",
+				nullptr)) {
+			fprintf(stderr, "art_setup failed for %s\n", runtime.name);
+			return 1;
+		}
+		apilevel = runtime.apilevel;
+
+		FakeMethodTable targets = fake_newMethods(runtime, METHOD_COUNT, 0x0002, 1);
+		FakeMethodTable replacements = fake_newMethods(runtime, METHOD_COUNT, 0x0002, 0x40000000);
+		measure(chain_replace, targets, replacements); // warm up，同时保存快照
+		double chain = measure(chain_replace, targets, replacements);
+		double table = measure(art_replaceArtMethod, targets, replacements);
+		printf("%-8s %12.2f %12.2f\n", runtime.name, chain, table);
+
+		snapshot_restoreAll();
+		fake_collect();
+		fake_resetHeap();
+	}
+	return 0;
+}
@@ -0,0 +1,143 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * elf_bench.cpp
+ *
+ * elf_findSymbol 与 dlsym 的对比(host 上运行)，对 libc 与 libstdc++ 分别测:
+ * 1. cold: 第一次查找，包含读 /proc/self/maps、mmap 与解析 section
+ * 2. warm: 之后每次查找的耗时
+ * 3. dlsym: 同一批符号用 dlsym 查找的耗时
+ * 并检查两者返回的地址是否一致.
+ *
+ * usage: andfix_elf_bench [iterations]
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include <dlfcn.h>
+
+#include "../elf/elf_resolver.h"
+
+#define DEFAULT_ITERATIONS 20000
+
+struct Library {
+	const char* name;
+	std::vector<const char*> symbols;
+};
+
+static double nowNs() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// 不选 memcpy/strlen 等 IFUNC 符号，dlsym 返回的是解析后的实现而不是符号本身
+static const Library libraries[] = {
+	{
+		"libc.so.6",
+		{
+			"malloc", "free", "calloc", "realloc", "fopen", "fclose", "fprintf",
+			"snprintf", "qsort", "bsearch", "getenv", "open", "read", "write", "mmap",
+			"munmap", "clock_gettime", "strtol", "atoi", "localtime_r", "pthread_create",
+			"pthread_mutex_lock", "pthread_mutex_unlock", "sigaction", "opendir",
+		},
+	},
+	{
+		"libstdc++.so.6",
+		{
+			"_ZSt9terminatev",
+			"_ZdlPv",
+			"_ZNSt9exceptionD2Ev",
+			"_ZNSt6chrono3_V212system_clock3nowEv",
+			"_ZNKSt9bad_alloc4whatEv",
+			"_ZSt17__throw_bad_allocv",
+			"_ZNSt6thread4joinEv",
+			"_ZNSt13runtime_errorC1EPKc",
+			"__cxa_throw",
+			"__cxa_allocate_exception",
+		},
+	},
+};
+
+static int run(const Library& library, int iterations) {
+	void* handle = dlopen(library.name, RTLD_NOW | RTLD_NOLOAD);
+	if (handle == nullptr) {
+		printf("%-16s not loaded, skipped\n", library.name);
+		return 0;
+	}
+
+	elf_clearCache();
+	double start = nowNs();
+	void* first = elf_findSymbol(library.name, library.symbols[0]);
+	double cold = nowNs() - start;
+
+	int mismatches = 0;
+	int found = 0;
+	for (const char* symbol : library.symbols) {
+		void* expect = dlsym(handle, symbol);
+		void* actual = elf_findSymbol(library.name, symbol);
+		if (expect == nullptr) {
+			continue;
+		}
+		++found;
+		if (actual != expect) {
+			printf("  mismatch %s: elf %p dlsym %p\n", symbol, actual, expect);
+			++mismatches;
+		}
+	}
+
+	volatile uintptr_t sink = (uintptr_t) first;
+	start = nowNs();
+	for (int i = 0; i < iterations; ++i) {
+		for (const char* symbol : library.symbols) {
+			sink += (uintptr_t) elf_findSymbol(library.name, symbol);
+		}
+	}
+	double warm = (nowNs() - start) / ((double) iterations * library.symbols.size());
+
+	start = nowNs();
+	for (int i = 0; i < iterations; ++i) {
+		for (const char* symbol : library.symbols) {
+			sink += (uintptr_t) dlsym(handle, symbol);
+		}
+	}
+	double viaDlsym = (nowNs() - start) / ((double) iterations * library.symbols.size());
+	dlclose(handle);
+
+	printf("%-16s cold %8.1f us  warm %6.1f ns/lookup  dlsym %6.1f ns/lookup  %d/%d match\n",
+			library.name, cold / 1000, warm, viaDlsym, found - mismatches, found);
+	return mismatches;
+}
+
+int main(int argc, char** argv) {
+	int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+	if (iterations <= 0) {
+		fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+		return 2;
+	}
+	int mismatches = 0;
+	for (const Library& library : libraries) {
+		mismatches += run(library, iterations);
+	}
+	return mismatches == 0 ? 0 : 1;
+}
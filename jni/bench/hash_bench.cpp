@@ -0,0 +1,296 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * hash_bench.cpp
+ *
+ * 指纹的吞吐(GB/s，host 上运行)，对同一个临时文件测:
+ * 1. md5 read: 8KB 一次 read() 再做 MD5，与 SecurityChecker.getFileMD5 的做法相同.
+ *    host 上没有 Java，用 C 的 MD5 代替 MessageDigest，结果是 Java 路径的上限
+ * 2. sha256 portable / 当前 CPU 的实现，单线程，数据已在内存中
+ * 3. file_hash 单线程与按核数多线程，包含 mmap
+ * 每项取 3 次中最快的一次，文件都在 page cache 中.
+ *
+ * usage: andfix_hash_bench [megabytes]
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../hash/file_hash.h"
+
+#define DEFAULT_MEGABYTES 64
+#define RUNS 3
+#define READ_BUFFER 8192
+
+static double nowNs() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+struct Md5 {
+	uint32_t state[4];
+	uint64_t length;
+	uint8_t buffer[64];
+	size_t used;
+};
+
+static uint32_t md5K[64];
+
+static const int MD5_SHIFT[64] = {
+	7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+	5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+	4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+	6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21,
+};
+
+static void md5Block(uint32_t state[4], const uint8_t* p) {
+	uint32_t m[16];
+	for (int i = 0; i < 16; ++i) {
+		m[i] = p[4 * i] | (p[4 * i + 1] << 8) | (p[4 * i + 2] << 16) | ((uint32_t) p[4 * i + 3] << 24);
+	}
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	for (int i = 0; i < 64; ++i) {
+		uint32_t f;
+		int g;
+		if (i < 16) {
+			f = (b & c) | (~b & d);
+			g = i;
+		} else if (i < 32) {
+			f = (d & b) | (~d & c);
+			g = (5 * i + 1) % 16;
+		} else if (i < 48) {
+			f = b ^ c ^ d;
+			g = (3 * i + 5) % 16;
+		} else {
+			f = c ^ (b | ~d);
+			g = (7 * i) % 16;
+		}
+		f += a + md5K[i] + m[g];
+		a = d;
+		d = c;
+		c = b;
+		b += (f << MD5_SHIFT[i]) | (f >> (32 - MD5_SHIFT[i]));
+	}
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+}
+
+static void md5Init(Md5* ctx) {
+	if (md5K[0] == 0) {
+		for (int i = 0; i < 64; ++i) {
+			md5K[i] = (uint32_t) (fabs(sin(i + 1.0)) * 4294967296.0);
+		}
+	}
+	ctx->state[0] = 0x67452301;
+	ctx->state[1] = 0xefcdab89;
+	ctx->state[2] = 0x98badcfe;
+	ctx->state[3] = 0x10325476;
+	ctx->length = 0;
+	ctx->used = 0;
+}
+
+static void md5Update(Md5* ctx, const void* data, size_t size) {
+	const uint8_t* p = (const uint8_t*) data;
+	ctx->length += size;
+	while (size > 0) {
+		if (ctx->used == 0 && size >= 64) {
+			md5Block(ctx->state, p);
+			p += 64;
+			size -= 64;
+			continue;
+		}
+		size_t n = 64 - ctx->used < size ? 64 - ctx->used : size;
+		memcpy(ctx->buffer + ctx->used, p, n);
+		ctx->used += n;
+		p += n;
+		size -= n;
+		if (ctx->used == 64) {
+			md5Block(ctx->state, ctx->buffer);
+			ctx->used = 0;
+		}
+	}
+}
+
+static void md5Final(Md5* ctx, uint8_t out[16]) {
+	uint64_t bits = ctx->length * 8;
+	uint8_t pad[128] = { 0x80 };
+	size_t padSize = (ctx->used < 56 ? 56 : 120) - ctx->used;
+	for (int i = 0; i < 8; ++i) {
+		pad[padSize + i] = (uint8_t) (bits >> (8 * i));
+	}
+	md5Update(ctx, pad, padSize + 8);
+	for (int i = 0; i < 16; ++i) {
+		out[i] = (uint8_t) (ctx->state[i / 4] >> (8 * (i % 4)));
+	}
+}
+
+static std::string toHex(const uint8_t* bytes, size_t size) {
+	static const char digits[] = "0123456789abcdef";
+	std::string hex;
+	for (size_t i = 0; i < size; ++i) {
+		hex.push_back(digits[bytes[i] >> 4]);
+		hex.push_back(digits[bytes[i] & 0xf]);
+	}
+	return hex;
+}
+
+static bool md5File(const char* path, uint8_t out[16]) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	Md5 ctx;
+	md5Init(&ctx);
+	uint8_t buffer[READ_BUFFER];
+	ssize_t n;
+	while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+		md5Update(&ctx, buffer, n);
+	}
+	close(fd);
+	md5Final(&ctx, out);
+	return n == 0;
+}
+
+/**
+ * 已知答案，防止测的是算错的实现
+ */
+static bool checkKnownAnswers() {
+	bool ok = true;
+	Md5 md5;
+	uint8_t md5Out[16];
+	md5Init(&md5);
+	md5Update(&md5, "abc", 3);
+	md5Final(&md5, md5Out);
+	if (toHex(md5Out, 16) != "900150983cd24fb0d6963f7d28e17f72") {
+		printf("md5(abc) = %s\n", toHex(md5Out, 16).c_str());
+		ok = false;
+	}
+	uint8_t sha[SHA256_DIGEST_SIZE];
+	sha256("abc", 3, sha);
+	if (toHex(sha, sizeof(sha)) != "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad") {
+		printf("sha256(abc) [%s] = %s\n", sha256_implementation(), toHex(sha, sizeof(sha)).c_str());
+		ok = false;
+	}
+	return ok;
+}
+
+static void report(const char* name, double ns, size_t size) {
+	printf("%-28s %8.1f ms  %6.2f GB/s\n", name, ns / 1e6, size / ns);
+}
+
+int main(int argc, char** argv) {
+	int megabytes = argc > 1 ? atoi(argv[1]) : DEFAULT_MEGABYTES;
+	if (megabytes <= 0) {
+		fprintf(stderr, "usage: %s [megabytes]\n", argv[0]);
+		return 2;
+	}
+	if (!checkKnownAnswers()) {
+		return 1;
+	}
+	size_t size = (size_t) megabytes << 20;
+	std::vector<uint8_t> data(size);
+	uint32_t x = 2463534242u;
+	for (size_t i = 0; i < size; ++i) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		data[i] = (uint8_t) x;
+	}
+
+	char path[] = "/tmp/andfix_hash_benchXXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0 || write(fd, data.data(), size) != (ssize_t) size) {
+		fprintf(stderr, "can not write %s\n", path);
+		return 1;
+	}
+	close(fd);
+
+	const char key[] = "andfix";
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	uint8_t reference[SHA256_DIGEST_SIZE];
+	uint8_t md5Out[16];
+	int mismatches = 0;
+	double best[6];
+	for (double& ns : best) {
+		ns = 1e30;
+	}
+	for (int run = 0; run < RUNS; ++run) {
+		double start = nowNs();
+		md5File(path, md5Out);
+		best[0] = fmin(best[0], nowNs() - start);
+
+		sha256_forcePortable(true);
+		start = nowNs();
+		sha256(data.data(), size, digest);
+		best[1] = fmin(best[1], nowNs() - start);
+		sha256_forcePortable(false);
+
+		start = nowNs();
+		sha256(data.data(), size, digest);
+		best[2] = fmin(best[2], nowNs() - start);
+
+		sha256_forcePortable(true);
+		start = nowNs();
+		file_hash(path, key, strlen(key), 1, reference);
+		best[3] = fmin(best[3], nowNs() - start);
+		sha256_forcePortable(false);
+
+		start = nowNs();
+		file_hash(path, key, strlen(key), 1, digest);
+		best[4] = fmin(best[4], nowNs() - start);
+		mismatches += memcmp(digest, reference, sizeof(digest)) != 0;
+
+		start = nowNs();
+		file_hash(path, key, strlen(key), 0, digest);
+		best[5] = fmin(best[5], nowNs() - start);
+		mismatches += memcmp(digest, reference, sizeof(digest)) != 0;
+	}
+	unlink(path);
+
+	std::string accelerated = std::string("sha256 ") + sha256_implementation();
+	std::string fileHash = std::string("file_hash ") + sha256_implementation() + " x1";
+	char parallel[64];
+	unsigned int cores = std::thread::hardware_concurrency();
+	snprintf(parallel, sizeof(parallel), "file_hash %s x%u", sha256_implementation(),
+			cores < 1 ? 1 : (cores > FILE_HASH_MAX_THREADS ? FILE_HASH_MAX_THREADS : cores));
+	printf("%d MB, %u cores\n", megabytes, cores);
+	report("md5 read (java path)", best[0], size);
+	report("sha256 portable", best[1], size);
+	report(accelerated.c_str(), best[2], size);
+	report("file_hash portable x1", best[3], size);
+	report(fileHash.c_str(), best[4], size);
+	report(parallel, best[5], size);
+	if (mismatches != 0) {
+		printf("%d fingerprint(s) differ between implementations\n", mismatches);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,393 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * replace_bench.cpp
+ *
+ * 方法替换的规模测试(host 上运行，依赖 andfix_host 与 host/ 中的合成对象):
+ * 对 art_x_x.h / dalvik.h 的每种布局，分别替换 10、1k、100k、1M 个方法，测三种方式:
+ * 1. raw:    直接调用 replace_x_x / dalvik_replaceDalvikMethod，不含 JNI 与快照
+ * 2. single: 每个方法调用一次 AndFix.replaceMethod 的 native 实现
+ * 3. batch:  一次 AndFix.replaceMethods 替换全部方法
+ * 输出 ns/method 以及每个方法的 cache miss 数(perf_event_open 不可用时为 null)，
+ * 人可读的表格打印到 stderr，JSON 打印到 stdout 或 --json 指定的文件，便于比较不同版本.
+ *
+ * usage: andfix_replace_bench [--sizes 10,1000,100000,1000000] [--layouts art_6_0,dalvik]
+ *                             [--json out.json]
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "../host/fake_jni_env.h"
+#include "../host/fake_runtime.h"
+#include "../art/art.h"
+
+#define JNIREG_CLASS "com/alipay/euler/andfix/AndFix"
+
+// 每个测量点至少替换这么多次方法，小规模时靠重复次数摊薄计时误差
+#define MIN_METHODS_PER_POINT 200000
+#define MIN_REPS 3
+
+extern jint JNI_OnLoad(JavaVM* vm, void* reserved);
+extern void dalvik_replaceDalvikMethod(void* src, void* dest);
+
+typedef jboolean (*setup_func)(JNIEnv*, jclass, jboolean, jint, jstring, jstring);
+typedef void (*replaceMethod_func)(JNIEnv*, jclass, jobject, jobject);
+typedef jintArray (*replaceMethods_func)(JNIEnv*, jclass, jobjectArray, jobjectArray);
+typedef jint (*restoreMethods_func)(JNIEnv*, jclass);
+typedef void (*rawReplace_func)(void*, void*);
+
+static setup_func setup_fnPtr;
+static replaceMethod_func replaceMethod_fnPtr;
+static replaceMethods_func replaceMethods_fnPtr;
+static restoreMethods_func restoreMethods_fnPtr;
+
+static jclass andfixClass;
+
+struct RawReplace {
+	const FakeRuntime* runtime;
+	rawReplace_func replace;
+};
+
+static const RawReplace rawReplaces[] = {
+	{ &fakeArt_4_4, replace_4_4 },
+	{ &fakeArt_5_0, replace_5_0 },
+	{ &fakeArt_5_1, replace_5_1 },
+	{ &fakeArt_6_0, replace_6_0 },
+	{ &fakeArt_7_0, replace_7_0 },
+	// dalvik 下被改写的是第一个参数
+	{ &fakeDalvik, dalvik_replaceDalvikMethod },
+};
+
+struct Result {
+	const FakeRuntime* runtime;
+	const char* mode;
+	size_t methods;
+	size_t reps;
+	double nsPerMethod;      // 各次重复的中位数
+	double minNsPerMethod;
+	double missesPerMethod;  // < 0 表示没有计数器
+};
+
+static double nowNs() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * 当前线程用户态的 cache miss 计数器，打不开时(容器、虚拟机、perf_event_paranoid)返回 -1
+ */
+static int openCacheMisses() {
+	perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+struct Counter {
+	int fd;
+	uint64_t total;
+
+	void start() {
+		if (fd >= 0) {
+			ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+
+	void stop() {
+		if (fd >= 0) {
+			ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+			uint64_t value = 0;
+			if (read(fd, &value, sizeof(value)) == (ssize_t) sizeof(value)) {
+				total += value;
+			}
+		}
+	}
+};
+
+static int cacheMissFd = -1;
+
+static bool bindNatives() {
+	andfixClass = fake_defineClass(JNIREG_CLASS);
+	if (JNI_OnLoad(fake_vm(), nullptr) < 0) {
+		return false;
+	}
+	setup_fnPtr = (setup_func) fake_nativeMethod(JNIREG_CLASS, "setup");
+	replaceMethod_fnPtr = (replaceMethod_func) fake_nativeMethod(JNIREG_CLASS, "replaceMethod");
+	replaceMethods_fnPtr = (replaceMethods_func) fake_nativeMethod(JNIREG_CLASS, "replaceMethods");
+	restoreMethods_fnPtr = (restoreMethods_func) fake_nativeMethod(JNIREG_CLASS, "restoreMethods");
+	return setup_fnPtr && replaceMethod_fnPtr && replaceMethods_fnPtr && restoreMethods_fnPtr;
+}
+
+static rawReplace_func rawReplaceOf(const FakeRuntime& runtime) {
+	for (const RawReplace& raw : rawReplaces) {
+		if (raw.runtime == &runtime) {
+			return raw.replace;
+		}
+	}
+	return nullptr;
+}
+
+/**
+ * 一个测量点: 同一组方法替换 reps 次，每次之后恢复(不计时)
+ */
+struct Workload {
+	FakeMethodTable targets;
+	FakeMethodTable replacements;
+	std::vector<jobject> targetRefs;
+	std::vector<jobject> replacementRefs;
+	jobjectArray targetArray;
+	jobjectArray replacementArray;
+};
+
+static void newWorkload(const FakeRuntime& runtime, size_t count, Workload* work) {
+	work->targets = fake_newMethods(runtime, count, 0x0002, 1);
+	work->replacements = fake_newMethods(runtime, count, 0x0002, 0x40000000);
+	work->targetRefs.resize(count);
+	work->replacementRefs.resize(count);
+	for (size_t i = 0; i < count; ++i) {
+		work->targetRefs[i] = fake_reflected(work->targets.method(i));
+		work->replacementRefs[i] = fake_reflected(work->replacements.method(i));
+	}
+	work->targetArray = fake_objectArray(work->targetRefs);
+	work->replacementArray = fake_objectArray(work->replacementRefs);
+}
+
+static void replaceRaw(const Workload& work, rawReplace_func replace) {
+	// 与 replaceMethod 的参数方向一致: art 改写 targets，dalvik 改写 replacements
+	const bool isArt = work.targets.runtime->isArt;
+	for (size_t i = 0; i < work.targets.count; ++i) {
+		void* target = work.targets.method(i);
+		void* replacement = work.replacements.method(i);
+		if (isArt) {
+			replace(target, replacement);
+		} else {
+			replace(replacement, target);
+		}
+	}
+}
+
+static void replaceSingle(const Workload& work) {
+	JNIEnv* env = fake_env();
+	for (size_t i = 0; i < work.targets.count; ++i) {
+		replaceMethod_fnPtr(env, andfixClass, work.targetRefs[i], work.replacementRefs[i]);
+	}
+}
+
+static void replaceBatch(const Workload& work) {
+	replaceMethods_fnPtr(fake_env(), andfixClass, work.targetArray, work.replacementArray);
+}
+
+static Result measure(const Workload& work, const char* mode, rawReplace_func raw) {
+	const size_t count = work.targets.count;
+	const size_t reps = std::max((size_t) MIN_REPS, MIN_METHODS_PER_POINT / count);
+	std::vector<double> times;
+	times.reserve(reps);
+	Counter counter = { cacheMissFd, 0 };
+
+	for (size_t rep = 0; rep < reps; ++rep) {
+		counter.start();
+		double start = nowNs();
+		if (raw != nullptr) {
+			replaceRaw(work, raw);
+		} else if (strcmp(mode, "single") == 0) {
+			replaceSingle(work);
+		} else {
+			replaceBatch(work);
+		}
+		times.push_back((nowNs() - start) / count);
+		counter.stop();
+		restoreMethods_fnPtr(fake_env(), andfixClass);
+	}
+
+	std::sort(times.begin(), times.end());
+	Result result;
+	result.runtime = work.targets.runtime;
+	result.mode = mode;
+	result.methods = count;
+	result.reps = reps;
+	result.nsPerMethod = times[times.size() / 2];
+	result.minNsPerMethod = times.front();
+	result.missesPerMethod = cacheMissFd >= 0 ? (double) counter.total / (reps * count) : -1;
+	return result;
+}
+
+static void printResult(const Result& result) {
+	char misses[32];
+	if (result.missesPerMethod < 0) {
+		snprintf(misses, sizeof(misses), "n/a");
+	} else {
+		snprintf(misses, sizeof(misses), "%.3f", result.missesPerMethod);
+	}
+	fprintf(stderr, "%-8s %-6s %8zu methods  %9.1f ns/method (min %9.1f)  misses/method %s\n",
+			result.runtime->name, result.mode, result.methods, result.nsPerMethod,
+			result.minNsPerMethod, misses);
+}
+
+static void writeJson(FILE* out, const std::vector<size_t>& sizes,
+		const std::vector<Result>& results) {
+	fprintf(out, "{\n");
+	fprintf(out, "  \"benchmark\": \"andfix_replace\",\n");
+	fprintf(out, "  \"timestamp\": %ld,\n", (long) time(nullptr));
+	fprintf(out, "  \"compiler\": \"%s\",\n", __VERSION__);
+	fprintf(out, "  \"pointer_size\": %zu,\n", sizeof(void*));
+	fprintf(out, "  \"cache_misses\": %s,\n", cacheMissFd >= 0 ? "true" : "false");
+	fprintf(out, "  \"sizes\": [");
+	for (size_t i = 0; i < sizes.size(); ++i) {
+		fprintf(out, "%s%zu", i == 0 ? "" : ", ", sizes[i]);
+	}
+	fprintf(out, "],\n");
+	fprintf(out, "  \"results\": [\n");
+	for (size_t i = 0; i < results.size(); ++i) {
+		const Result& r = results[i];
+		fprintf(out, "    {\"layout\": \"%s\", \"method_size\": %zu, \"mode\": \"%s\", "
+				"\"methods\": %zu, \"reps\": %zu, \"ns_per_method\": %.2f, "
+				"\"ns_per_method_min\": %.2f, \"cache_misses_per_method\": ",
+				r.runtime->name, r.runtime->methodSize, r.mode, r.methods, r.reps,
+				r.nsPerMethod, r.minNsPerMethod);
+		if (r.missesPerMethod < 0) {
+			fprintf(out, "null}");
+		} else {
+			fprintf(out, "%.4f}", r.missesPerMethod);
+		}
+		fprintf(out, "%s\n", i + 1 == results.size() ? "" : ",");
+	}
+	fprintf(out, "  ]\n");
+	fprintf(out, "}\n");
+}
+
+static std::vector<std::string> split(const char* list) {
+	std::vector<std::string> items;
+	std::string item;
+	for (const char* p = list; ; ++p) {
+		if (*p == ',' || *p == '\0') {
+			if (!item.empty()) {
+				items.push_back(item);
+			}
+			item.clear();
+			if (*p == '\0') {
+				break;
+			}
+		} else {
+			item += *p;
+		}
+	}
+	return items;
+}
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [--sizes 10,1000,100000,1000000] [--layouts art_6_0,dalvik]"
+			" [--json out.json]\n", name);
+}
+
+int main(int argc, char** argv) {
+	std::vector<size_t> sizes = { 10, 1000, 100000, 1000000 };
+	std::vector<std::string> layouts;
+	const char* jsonPath = nullptr;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+			sizes.clear();
+			for (const std::string& size : split(argv[++i])) {
+				sizes.push_back(strtoul(size.c_str(), nullptr, 10));
+			}
+		} else if (strcmp(argv[i], "--layouts") == 0 && i + 1 < argc) {
+			layouts = split(argv[++i]);
+		} else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+			jsonPath = argv[++i];
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (sizes.empty() || std::find(sizes.begin(), sizes.end(), (size_t) 0) != sizes.end()) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	if (!bindNatives()) {
+		fprintf(stderr, "JNI_OnLoad failed\n");
+		return 1;
+	}
+	cacheMissFd = openCacheMisses();
+	if (cacheMissFd < 0) {
+		fprintf(stderr, "perf_event_open unavailable, cache misses reported as n/a\n");
+	}
+
+	std::vector<Result> results;
+	for (const FakeRuntime* const* it = fakeRuntimes; *it != nullptr; ++it) {
+		const FakeRuntime& runtime = **it;
+		if (!layouts.empty()
+				&& std::find(layouts.begin(), layouts.end(), runtime.name) == layouts.end()) {
+			continue;
+		}
+		if (runtime.isArt) {
+			fake_defineProbeClass(runtime);
+		}
+		// host 上 dalvik_setup 必然失败(没有 libdvm.so)，但替换本身不依赖它
+		setup_fnPtr(fake_env(), andfixClass, runtime.isArt, runtime.apilevel,
+				fake_string("host/andfix/bench:user/release-keys"), nullptr);
+
+		for (size_t count : sizes) {
+			Workload work;
+			newWorkload(runtime, count, &work);
+			const Result points[] = {
+				measure(work, "raw", rawReplaceOf(runtime)),
+				measure(work, "single", nullptr),
+				measure(work, "batch", nullptr),
+			};
+			for (const Result& result : points) {
+				printResult(result);
+				results.push_back(result);
+			}
+			fake_collect();
+			fake_resetHeap();
+		}
+	}
+
+	FILE* out = jsonPath != nullptr ? fopen(jsonPath, "w") : stdout;
+	if (out == nullptr) {
+		fprintf(stderr, "can not open %s\n", jsonPath);
+		return 1;
+	}
+	writeJson(out, sizes, results);
+	if (out != stdout) {
+		fclose(out);
+	}
+	if (cacheMissFd >= 0) {
+		close(cacheMissFd);
+	}
+	return 0;
+}
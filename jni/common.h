@@ -22,8 +22,49 @@
 #include <android/log.h>
 
 #define  LOG_TAG    "AndFix"
+
+/*
+ * 编译期的日志级别，取值与 ANDROID_LOG_* 相同(预处理器看不到枚举，所以另外定义)，
+ * 低于该级别的 LOGx 连同参数的求值一起被编译掉.
+ * 默认 release(NDEBUG) 只保留 LOGW/LOGE，可以用 -DANDFIX_LOG_LEVEL=3 打开 LOGD.
+ * 替换过程中的逐方法事件不走日志，见 trace.h.
+ */
+#define ANDFIX_LOG_DEBUG  3
+#define ANDFIX_LOG_WARN   5
+#define ANDFIX_LOG_ERROR  6
+#define ANDFIX_LOG_SILENT 8
+
+#ifndef ANDFIX_LOG_LEVEL
+#ifdef NDEBUG
+#define ANDFIX_LOG_LEVEL ANDFIX_LOG_WARN
+#else
+#define ANDFIX_LOG_LEVEL ANDFIX_LOG_DEBUG
+#endif
+#endif
+
+#if ANDFIX_LOG_LEVEL <= ANDFIX_LOG_DEBUG
 #define  LOGD(...)  __android_log_print(ANDROID_LOG_DEBUG,LOG_TAG,__VA_ARGS__)
+#else
+#define  LOGD(...)  ((void) 0)
+#endif
+#if ANDFIX_LOG_LEVEL <= ANDFIX_LOG_WARN
 #define  LOGW(...)  __android_log_print(ANDROID_LOG_WARN,LOG_TAG,__VA_ARGS__)
-#define  LOGE(...)  __android_log_print(ANDROID_LOG_ERROR,LOG_TAG,__VA_ARGS__)							\
+#else
+#define  LOGW(...)  ((void) 0)
+#endif
+#if ANDFIX_LOG_LEVEL <= ANDFIX_LOG_ERROR
+#define  LOGE(...)  __android_log_print(ANDROID_LOG_ERROR,LOG_TAG,__VA_ARGS__)
+#else
+#define  LOGE(...)  ((void) 0)
+#endif
+
+/*
+ * Per-entry status of a batch replacement, must match AndFix.REPLACE_*.
+ */
+enum {
+	REPLACE_OK = 0,         // replaced
+	REPLACE_NULL = 1,       // target or replacement is null
+	REPLACE_UNRESOLVED = 2, // FromReflectedMethod failed
+};
 
 #endif /* COMMON_H_ */
@@ -284,7 +284,7 @@ typedef struct Method {
 typedef Object* (*dvmDecodeIndirectRef_func)(void* self, jobject jobj);
 typedef void* (*dvmThreadSelf_func)();
 
-dvmDecodeIndirectRef_func dvmDecodeIndirectRef_fnPtr;
-dvmThreadSelf_func dvmThreadSelf_fnPtr;
+extern dvmDecodeIndirectRef_func dvmDecodeIndirectRef_fnPtr;
+extern dvmThreadSelf_func dvmThreadSelf_fnPtr;
 
-jmethodID jClassMethod; // Java中Method类中的getDeclaringClass()
+extern jmethodID jClassMethod; // Java中Method类中的getDeclaringClass()
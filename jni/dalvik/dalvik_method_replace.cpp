@@ -35,15 +35,38 @@
 
 #include "dalvik.h"
 #include "../common.h"
+#include "../snapshot.h"
+#include "../trace.h"
+#include "../elf/elf_resolver.h"
+
+dvmDecodeIndirectRef_func dvmDecodeIndirectRef_fnPtr;
+dvmThreadSelf_func dvmThreadSelf_fnPtr;
+
+jmethodID jClassMethod;
 
 static void* dvm_dlsym(void* hand, const char* name) {
 	void* ret = dlsym(hand, name);
-	char msg[1024] = { 0 };
-	snprintf(msg, sizeof(msg) - 1, "0x%x", ret);
-	LOGD("%s = %s\n", name, msg);
+	LOGD("%s = %p", name, ret);
 	return ret;
 }
 
+/**
+ * 先解析 libdvm.so 的符号表，找不到(例如库不在 /proc/self/maps 中)再退回 dlopen/dlsym
+ */
+static void* dvm_findSymbol(void** hand, const char* name) {
+	void* ret = elf_findSymbol("libdvm.so", name);
+	if (ret != nullptr) {
+		return ret;
+	}
+	if (*hand == nullptr) {
+		*hand = dlopen("libdvm.so", RTLD_NOW);
+		if (*hand == nullptr) {
+			return nullptr;
+		}
+	}
+	return dvm_dlsym(*hand, name);
+}
+
 /**
  * Android libdvm.so 与 libart.so
  * 系统升级到5.1之后，发现system/lib/下面没有libdvm.so了，只剩下了libart.so。对于libart模式，
@@ -71,44 +94,51 @@ dalvik_setup(JNIEnv* env, int apilevel) {
 	// 2. 把 libart.so/libdvm.so 使用open()打开，使用mmap()映射到内存空间，然后根据 Elf
 	//    文件的格式，从 got/got.plt 中 获取对应目标符号(field/method)的偏移量；
 	// 3. 基地址 + 偏移量 即是我们需要的符号地址: ArtMethod/ArtField.
-	void* dvm_hand = dlopen("libdvm.so", RTLD_NOW); // dl打开dalvik虚拟机
-	if (dvm_hand) {
-		dvmDecodeIndirectRef_fnPtr = reinterpret_cast<dvmDecodeIndirectRef_func>(dvm_dlsym(
-				dvm_hand, apilevel > 10
-						? "_Z20dvmDecodeIndirectRefP6ThreadP8_jobject"
-						: "dvmDecodeIndirectRef"));
-
-		if (!dvmDecodeIndirectRef_fnPtr) {
-			return JNI_FALSE;
-		}
-
-		dvmThreadSelf_fnPtr = reinterpret_cast<dvmThreadSelf_func>(dvm_dlsym(
-				dvm_hand, apilevel > 10 ? "_Z13dvmThreadSelfv" : "dvmThreadSelf"));
+	// 这里按第 1~3 步用 elf_findSymbol 解析，dlopen 只作为兜底
+	void* dvm_hand = nullptr;
+	dvmDecodeIndirectRef_fnPtr = reinterpret_cast<dvmDecodeIndirectRef_func>(dvm_findSymbol(
+			&dvm_hand, apilevel > 10
+					? "_Z20dvmDecodeIndirectRefP6ThreadP8_jobject"
+					: "dvmDecodeIndirectRef"));
+
+	if (!dvmDecodeIndirectRef_fnPtr) {
+		return JNI_FALSE;
+	}
 
-		if (!dvmThreadSelf_fnPtr) {
-			return JNI_FALSE;
-		}
-		jclass Method_Classs = env->FindClass("java/lang/reflect/Method");
-		jClassMethod = env->GetMethodID(Method_Classs, "getDeclaringClass", "()Ljava/lang/Class;");
+	dvmThreadSelf_fnPtr = reinterpret_cast<dvmThreadSelf_func>(dvm_findSymbol(
+			&dvm_hand, apilevel > 10 ? "_Z13dvmThreadSelfv" : "dvmThreadSelf"));
 
-		return JNI_TRUE;
-	} else {
+	if (!dvmThreadSelf_fnPtr) {
 		return JNI_FALSE;
 	}
+	jclass Method_Classs = env->FindClass("java/lang/reflect/Method");
+	jClassMethod = env->GetMethodID(Method_Classs, "getDeclaringClass", "()Ljava/lang/Class;");
+
+	return JNI_TRUE;
 }
 
-extern void __attribute__ ((visibility ("hidden"))) 
-dalvik_replaceMethod(JNIEnv* env, jobject src, jobject dest) {
-	jobject clazz = env->CallObjectMethod(dest, jClassMethod);
+/**
+ * 为接下来 count 次 dalvik_replaceDalvikMethod 预留快照
+ */
+extern bool __attribute__ ((visibility ("hidden")))
+dalvik_reserveSnapshots(size_t count) {
+	return snapshot_reserve(count, sizeof(Method));
+}
 
-	// Dalvik中，Class对象对应的是 DvmObject结构体
-	ClassObject* clz = (ClassObject*) dvmDecodeIndirectRef_fnPtr(dvmThreadSelf_fnPtr(), clazz);
+/**
+ * 参数为已解析的 Method 指针(jmethodID)，批量替换时直接使用.
+ * Method.clazz 就是 getDeclaringClass() 对应的 ClassObject，所以这里不需要再回到 Java 层.
+ */
+extern void __attribute__ ((visibility ("hidden")))
+dalvik_replaceDalvikMethod(void* src, void* dest) {
+	Method* meth = (Method*) src;
+	Method* target = (Method*) dest;
 
-	clz->status = CLASS_INITIALIZED; // 标记该Class对象初始化完毕
+	// 保存原始字节，用于 restoreMethod/restoreAll
+	snapshot_save(meth, 0, sizeof(Method));
 
-	Method* meth = (Method*) env->FromReflectedMethod(src);
-	Method* target = (Method*) env->FromReflectedMethod(dest);
-	LOGD("dalvikMethod: %s", meth->name);
+	// Dalvik中，Class对象对应的是 DvmObject结构体
+	target->clazz->status = CLASS_INITIALIZED; // 标记该Class对象初始化完毕
 
 //	meth->clazz = target->clazz;
 	meth->accessFlags |= ACC_PUBLIC;
@@ -121,10 +151,16 @@ dalvik_replaceMethod(JNIEnv* env, jobject src, jobject dest) {
 	meth->prototype = target->prototype;
 	meth->insns = target->insns;
 	meth->nativeFunc = target->nativeFunc; // 关键的一步
+	trace_record(TRACE_REPLACE, 0, meth, target);
+}
+
+extern void __attribute__ ((visibility ("hidden"))) 
+dalvik_replaceMethod(JNIEnv* env, jobject src, jobject dest) {
+	dalvik_replaceDalvikMethod(env->FromReflectedMethod(src), env->FromReflectedMethod(dest));
 }
 
 extern void dalvik_setFieldFlag(JNIEnv* env, jobject field) {
 	Field* dalvikField = (Field*) env->FromReflectedField(field);
 	dalvikField->accessFlags = dalvikField->accessFlags & (~ACC_PRIVATE) | ACC_PUBLIC;
-	LOGD("dalvik_setFieldFlag: %d ", dalvikField->accessFlags);
+	trace_record(TRACE_SET_FIELD_FLAG, dalvikField->accessFlags, dalvikField, nullptr);
 }
@@ -0,0 +1,445 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <link.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "elf_resolver.h"
+#include "../common.h"
+
+#define ELF_WORD_BITS (sizeof(ElfW(Addr)) * 8)
+
+struct GnuHash {
+	uint32_t nbuckets;
+	uint32_t symoffset;
+	uint32_t bloomSize;
+	uint32_t bloomShift;
+	const ElfW(Addr)* bloom;
+	const uint32_t* buckets;
+	const uint32_t* chain;
+};
+
+struct SysvHash {
+	uint32_t nbucket;
+	uint32_t nchain;
+	const uint32_t* bucket;
+	const uint32_t* chain;
+};
+
+/**
+ * .symtab 的索引项，按 hash 排序
+ */
+struct SymtabEntry {
+	uint32_t hash;
+	uint32_t index;
+
+	bool operator<(const SymtabEntry& other) const {
+		return hash < other.hash;
+	}
+};
+
+struct ElfImage {
+	std::string library;
+	std::string path;
+	ElfW(Addr) bias;         // 运行时地址 = st_value + bias
+
+	void* map;
+	size_t mapSize;
+
+	const ElfW(Sym)* dynsym;
+	size_t dynsymCount;
+	const char* dynstr;
+	const ElfW(Versym)* versym;
+	bool hasGnuHash;
+	GnuHash gnuHash;
+	bool hasSysvHash;
+	SysvHash sysvHash;
+
+	const ElfW(Sym)* symtab;
+	size_t symtabCount;
+	const char* strtab;
+	bool symtabIndexed;
+	std::vector<SymtabEntry> symtabIndex;
+};
+
+static std::vector<ElfImage*> images;
+
+static uint32_t gnuHashOf(const char* name) {
+	uint32_t h = 5381;
+	for (const unsigned char* p = (const unsigned char*) name; *p != '\0'; ++p) {
+		h = (h << 5) + h + *p;
+	}
+	return h;
+}
+
+static uint32_t sysvHashOf(const char* name) {
+	uint32_t h = 0;
+	for (const unsigned char* p = (const unsigned char*) name; *p != '\0'; ++p) {
+		h = (h << 4) + *p;
+		uint32_t g = h & 0xf0000000;
+		h ^= g;
+		h ^= g >> 24;
+	}
+	return h;
+}
+
+static bool matchLibrary(const char* path, const char* library) {
+	if (strchr(library, '/') != nullptr) {
+		return strcmp(path, library) == 0;
+	}
+	const char* slash = strrchr(path, '/');
+	if (slash == nullptr) {
+		return false;
+	}
+	// 允许带版本号的真实文件名，如 libstdc++.so.6 -> libstdc++.so.6.0.30
+	const size_t len = strlen(library);
+	return strncmp(slash + 1, library, len) == 0
+			&& (slash[1 + len] == '\0' || slash[1 + len] == '.');
+}
+
+/**
+ * 在 /proc/self/maps 中找到 library 文件偏移 0 处的映射
+ */
+static bool findMapping(const char* library, std::string* path, uintptr_t* start) {
+	FILE* fp = fopen("/proc/self/maps", "re");
+	if (fp == nullptr) {
+		return false;
+	}
+	bool found = false;
+	char line[1024];
+	while (fgets(line, sizeof(line), fp) != nullptr) {
+		uintptr_t begin;
+		uintptr_t end;
+		unsigned long offset;
+		int pathPos = 0;
+		if (sscanf(line, "%" SCNxPTR "-%" SCNxPTR " %*4s %lx %*s %*s %n",
+				&begin, &end, &offset, &pathPos) < 3 || pathPos == 0) {
+			continue;
+		}
+		char* name = line + pathPos;
+		name[strcspn(name, "\n")] = '\0';
+		if (offset == 0 && name[0] == '/' && matchLibrary(name, library)) {
+			*path = name;
+			*start = begin;
+			found = true;
+			break;
+		}
+	}
+	fclose(fp);
+	return found;
+}
+
+template<typename T>
+static const T* section(const ElfImage* image, const ElfW(Shdr)& shdr) {
+	if (shdr.sh_offset + shdr.sh_size > image->mapSize) {
+		return nullptr;
+	}
+	return (const T*) ((const char*) image->map + shdr.sh_offset);
+}
+
+static bool parseGnuHash(const ElfImage* image, const ElfW(Shdr)& shdr, GnuHash* hash) {
+	const uint32_t* words = section<uint32_t>(image, shdr);
+	if (words == nullptr || shdr.sh_size < 4 * sizeof(uint32_t)) {
+		return false;
+	}
+	hash->nbuckets = words[0];
+	hash->symoffset = words[1];
+	hash->bloomSize = words[2];
+	hash->bloomShift = words[3];
+	hash->bloom = (const ElfW(Addr)*) (words + 4);
+	hash->buckets = (const uint32_t*) (hash->bloom + hash->bloomSize);
+	hash->chain = hash->buckets + hash->nbuckets;
+	return hash->nbuckets != 0 && hash->bloomSize != 0;
+}
+
+static bool parseSysvHash(const ElfImage* image, const ElfW(Shdr)& shdr, SysvHash* hash) {
+	const uint32_t* words = section<uint32_t>(image, shdr);
+	if (words == nullptr || shdr.sh_size < 2 * sizeof(uint32_t)) {
+		return false;
+	}
+	hash->nbucket = words[0];
+	hash->nchain = words[1];
+	hash->bucket = words + 2;
+	hash->chain = hash->bucket + hash->nbucket;
+	return hash->nbucket != 0;
+}
+
+static bool parseImage(ElfImage* image, uintptr_t start) {
+	const ElfW(Ehdr)* ehdr = (const ElfW(Ehdr)*) image->map;
+	if (image->mapSize < sizeof(ElfW(Ehdr))
+			|| memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0
+			|| ehdr->e_ident[EI_CLASS] != (sizeof(void*) == 8 ? ELFCLASS64 : ELFCLASS32)
+			|| ehdr->e_shoff + ehdr->e_shnum * sizeof(ElfW(Shdr)) > image->mapSize
+			|| ehdr->e_phoff + ehdr->e_phnum * sizeof(ElfW(Phdr)) > image->mapSize
+			|| ehdr->e_shstrndx >= ehdr->e_shnum) {
+		return false;
+	}
+
+	// 加载偏移: 第一个 PT_LOAD 的页对齐地址映射到了 start
+	const ElfW(Phdr)* phdrs = (const ElfW(Phdr)*) ((const char*) image->map + ehdr->e_phoff);
+	ElfW(Addr) minVaddr = (ElfW(Addr)) -1;
+	for (int i = 0; i < ehdr->e_phnum; ++i) {
+		if (phdrs[i].p_type == PT_LOAD && phdrs[i].p_vaddr < minVaddr) {
+			minVaddr = phdrs[i].p_vaddr;
+		}
+	}
+	if (minVaddr == (ElfW(Addr)) -1) {
+		return false;
+	}
+	image->bias = start - (minVaddr & ~(ElfW(Addr)) (getpagesize() - 1));
+
+	const ElfW(Shdr)* shdrs = (const ElfW(Shdr)*) ((const char*) image->map + ehdr->e_shoff);
+	for (int i = 0; i < ehdr->e_shnum; ++i) {
+		const ElfW(Shdr)& shdr = shdrs[i];
+		switch (shdr.sh_type) {
+		case SHT_DYNSYM:
+		case SHT_SYMTAB: {
+			if (shdr.sh_link >= ehdr->e_shnum) {
+				break;
+			}
+			const ElfW(Sym)* syms = section<ElfW(Sym)>(image, shdr);
+			const char* strs = section<char>(image, shdrs[shdr.sh_link]);
+			if (syms == nullptr || strs == nullptr) {
+				break;
+			}
+			if (shdr.sh_type == SHT_DYNSYM) {
+				image->dynsym = syms;
+				image->dynsymCount = shdr.sh_size / sizeof(ElfW(Sym));
+				image->dynstr = strs;
+			} else {
+				image->symtab = syms;
+				image->symtabCount = shdr.sh_size / sizeof(ElfW(Sym));
+				image->strtab = strs;
+			}
+			break;
+		}
+		case SHT_GNU_HASH:
+			image->hasGnuHash = parseGnuHash(image, shdr, &image->gnuHash);
+			break;
+		case SHT_HASH:
+			image->hasSysvHash = parseSysvHash(image, shdr, &image->sysvHash);
+			break;
+		case SHT_GNU_versym:
+			image->versym = section<ElfW(Versym)>(image, shdr);
+			break;
+		default:
+			break;
+		}
+	}
+	return image->dynsym != nullptr || image->symtab != nullptr;
+}
+
+static void releaseImage(ElfImage* image) {
+	if (image->map != nullptr) {
+		munmap(image->map, image->mapSize);
+	}
+	delete image;
+}
+
+static ElfImage* loadImage(const char* library) {
+	std::string path;
+	uintptr_t start;
+	if (!findMapping(library, &path, &start)) {
+		LOGW("elf_resolver: %s is not loaded", library);
+		return nullptr;
+	}
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		LOGW("elf_resolver: open %s failed", path.c_str());
+		return nullptr;
+	}
+	struct stat st;
+	void* map = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		map = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if (map == MAP_FAILED) {
+		LOGW("elf_resolver: mmap %s failed", path.c_str());
+		return nullptr;
+	}
+
+	ElfImage* image = new ElfImage();
+	image->library = library;
+	image->path = path;
+	image->map = map;
+	image->mapSize = (size_t) st.st_size;
+	if (!parseImage(image, start)) {
+		LOGW("elf_resolver: %s has no symbol table", path.c_str());
+		releaseImage(image);
+		return nullptr;
+	}
+	LOGD("elf_resolver: %s dynsym=%zu symtab=%zu gnu_hash=%d",
+			path.c_str(), image->dynsymCount, image->symtabCount, image->hasGnuHash);
+	return image;
+}
+
+static ElfImage* imageOf(const char* library) {
+	for (ElfImage* image : images) {
+		if (image->library == library) {
+			return image;
+		}
+	}
+	// 库还没加载时不缓存，之后加载了仍可以找到
+	ElfImage* image = loadImage(library);
+	if (image != nullptr) {
+		images.push_back(image);
+	}
+	return image;
+}
+
+/**
+ * 与动态链接器一致: 只认已定义的、默认版本的符号
+ */
+static inline bool definedAt(const ElfImage* image, size_t index) {
+	const ElfW(Sym)& sym = image->dynsym[index];
+	if (sym.st_shndx == SHN_UNDEF || sym.st_value == 0) {
+		return false;
+	}
+	return image->versym == nullptr || (image->versym[index] & 0x8000) == 0;
+}
+
+static const ElfW(Sym)* gnuLookup(const ElfImage* image, const char* name) {
+	const GnuHash& table = image->gnuHash;
+	const uint32_t h = gnuHashOf(name);
+
+	ElfW(Addr) word = table.bloom[(h / ELF_WORD_BITS) % table.bloomSize];
+	ElfW(Addr) mask = ((ElfW(Addr)) 1 << (h % ELF_WORD_BITS))
+			| ((ElfW(Addr)) 1 << ((h >> table.bloomShift) % ELF_WORD_BITS));
+	if ((word & mask) != mask) {
+		return nullptr;
+	}
+
+	uint32_t index = table.buckets[h % table.nbuckets];
+	if (index < table.symoffset) {
+		return nullptr;
+	}
+	for (; index < image->dynsymCount; ++index) {
+		uint32_t chainHash = table.chain[index - table.symoffset];
+		if ((h | 1) == (chainHash | 1)
+				&& strcmp(image->dynstr + image->dynsym[index].st_name, name) == 0
+				&& definedAt(image, index)) {
+			return &image->dynsym[index];
+		}
+		if (chainHash & 1) {
+			break; // 链表结束
+		}
+	}
+	return nullptr;
+}
+
+static const ElfW(Sym)* sysvLookup(const ElfImage* image, const char* name) {
+	const SysvHash& table = image->sysvHash;
+	const uint32_t h = sysvHashOf(name);
+	for (uint32_t index = table.bucket[h % table.nbucket];
+			index != 0 && index < table.nchain && index < image->dynsymCount;
+			index = table.chain[index]) {
+		if (strcmp(image->dynstr + image->dynsym[index].st_name, name) == 0
+				&& definedAt(image, index)) {
+			return &image->dynsym[index];
+		}
+	}
+	return nullptr;
+}
+
+static const ElfW(Sym)* dynsymLookup(const ElfImage* image, const char* name) {
+	if (image->hasGnuHash) {
+		return gnuLookup(image, name);
+	}
+	if (image->hasSysvHash) {
+		return sysvLookup(image, name);
+	}
+	for (size_t index = 1; index < image->dynsymCount; ++index) {
+		if (strcmp(image->dynstr + image->dynsym[index].st_name, name) == 0
+				&& definedAt(image, index)) {
+			return &image->dynsym[index];
+		}
+	}
+	return nullptr;
+}
+
+static void indexSymtab(ElfImage* image) {
+	image->symtabIndexed = true;
+	image->symtabIndex.reserve(image->symtabCount);
+	for (size_t index = 1; index < image->symtabCount; ++index) {
+		const ElfW(Sym)& sym = image->symtab[index];
+		if (sym.st_shndx == SHN_UNDEF || sym.st_value == 0 || sym.st_name == 0) {
+			continue;
+		}
+		int type = ELF32_ST_TYPE(sym.st_info); // 与 ELF64_ST_TYPE 相同
+		if (type != STT_FUNC && type != STT_OBJECT) {
+			continue;
+		}
+		image->symtabIndex.push_back({ gnuHashOf(image->strtab + sym.st_name), (uint32_t) index });
+	}
+	std::sort(image->symtabIndex.begin(), image->symtabIndex.end());
+}
+
+static const ElfW(Sym)* symtabLookup(ElfImage* image, const char* name) {
+	if (image->symtab == nullptr) {
+		return nullptr;
+	}
+	if (!image->symtabIndexed) {
+		indexSymtab(image);
+	}
+	SymtabEntry key = { gnuHashOf(name), 0 };
+	auto it = std::lower_bound(image->symtabIndex.begin(), image->symtabIndex.end(), key);
+	for (; it != image->symtabIndex.end() && it->hash == key.hash; ++it) {
+		const ElfW(Sym)& sym = image->symtab[it->index];
+		if (strcmp(image->strtab + sym.st_name, name) == 0) {
+			return &sym;
+		}
+	}
+	return nullptr;
+}
+
+void* elf_findSymbol(const char* library, const char* name) {
+	if (library == nullptr || name == nullptr) {
+		return nullptr;
+	}
+	ElfImage* image = imageOf(library);
+	if (image == nullptr) {
+		return nullptr;
+	}
+	const ElfW(Sym)* sym = image->dynsym != nullptr ? dynsymLookup(image, name) : nullptr;
+	if (sym == nullptr) {
+		// 没有导出的内部符号只在 .symtab 中
+		sym = symtabLookup(image, name);
+	}
+	if (sym == nullptr) {
+		return nullptr;
+	}
+	return (void*) (image->bias + sym->st_value);
+}
+
+void elf_clearCache() {
+	for (ElfImage* image : images) {
+		releaseImage(image);
+	}
+	images.clear();
+}
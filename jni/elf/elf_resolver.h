@@ -0,0 +1,48 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * elf_resolver.h
+ *
+ * 不经过 dlopen/dlsym 查找已加载库中的符号.
+ *
+ * 7.0 起 linker namespace 限制了 app 对 libart.so 等系统库的 dlopen，所以这里改为:
+ * 1. 从 /proc/self/maps 中找到库的路径与加载基址；
+ * 2. 把库文件只读 mmap 进来，解析 section header，取得 .dynsym/.dynstr、.gnu.hash/.hash
+ *    以及(未 strip 时的) .symtab/.strtab；
+ * 3. .dynsym 用 GNU hash(没有时用 SysV hash)查找，.symtab 没有 hash 表，第一次用到时建一张
+ *    按名字 hash 排序的索引，之后二分查找；
+ * 4. 符号值 + 加载偏移就是运行时地址.
+ * 每个库只解析一次，结果缓存到 elf_clearCache 为止. 与 snapshot 一样不加锁，调用方负责串行.
+ */
+
+#ifndef ELF_RESOLVER_H_
+#define ELF_RESOLVER_H_
+
+/**
+ * @param library 库的文件名(如 "libdvm.so")或完整路径
+ * @param name    符号名，C++ 符号为 mangled name
+ * @return 符号的运行时地址；库未加载或没有该符号时为 null
+ */
+void* elf_findSymbol(const char* library, const char* name);
+
+/**
+ * 释放所有已解析的库
+ */
+void elf_clearCache();
+
+#endif /* ELF_RESOLVER_H_ */
@@ -0,0 +1,121 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * file_hash.cpp
+ *
+ * 工作线程从一个原子计数器领取块号，各自写自己的摘要槽，最后由调用线程汇总.
+ * 只有一块时不起线程.
+ */
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file_hash.h"
+#include "../common.h"
+
+static const uint8_t MAGIC[4] = { 'A', 'F', 'H', '1' };
+
+static void hashChunks(const uint8_t* data, size_t size, size_t chunks,
+		std::atomic<size_t>* next, uint8_t* digests) {
+	for (;;) {
+		size_t i = next->fetch_add(1, std::memory_order_relaxed);
+		if (i >= chunks) {
+			return;
+		}
+		size_t offset = i * FILE_HASH_CHUNK_SIZE;
+		size_t length = size - offset < FILE_HASH_CHUNK_SIZE ? size - offset : FILE_HASH_CHUNK_SIZE;
+		sha256(data + offset, length, digests + i * SHA256_DIGEST_SIZE);
+	}
+}
+
+void buffer_hash(const void* data, size_t size, const void* key, size_t keySize,
+		int threads, uint8_t out[SHA256_DIGEST_SIZE]) {
+	size_t chunks = (size + FILE_HASH_CHUNK_SIZE - 1) / FILE_HASH_CHUNK_SIZE;
+	// MAGIC || le64 size || le32 chunk size || digests
+	std::vector<uint8_t> root(16 + chunks * SHA256_DIGEST_SIZE);
+	memcpy(root.data(), MAGIC, sizeof(MAGIC));
+	for (int i = 0; i < 8; ++i) {
+		root[4 + i] = (uint8_t) ((uint64_t) size >> (8 * i));
+	}
+	for (int i = 0; i < 4; ++i) {
+		root[12 + i] = (uint8_t) (FILE_HASH_CHUNK_SIZE >> (8 * i));
+	}
+	uint8_t* digests = root.data() + 16;
+
+	if (threads <= 0) {
+		threads = (int) std::thread::hardware_concurrency();
+	}
+	if (threads > FILE_HASH_MAX_THREADS) {
+		threads = FILE_HASH_MAX_THREADS;
+	}
+	if ((size_t) threads > chunks) {
+		threads = (int) chunks;
+	}
+
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> workers;
+	for (int i = 1; i < threads; ++i) {
+		workers.push_back(std::thread(hashChunks, (const uint8_t*) data, size, chunks,
+				&next, digests));
+	}
+	hashChunks((const uint8_t*) data, size, chunks, &next, digests);
+	for (size_t i = 0; i < workers.size(); ++i) {
+		workers[i].join();
+	}
+
+	hmac_sha256(key, keySize, root.data(), root.size(), out);
+}
+
+bool file_hash(const char* path, const void* key, size_t keySize, int threads,
+		uint8_t out[SHA256_DIGEST_SIZE]) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		LOGE("file_hash: open %s failed", path);
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		LOGE("file_hash: stat %s failed", path);
+		return false;
+	}
+	size_t size = (size_t) st.st_size;
+	if (size == 0) {
+		close(fd);
+		buffer_hash(nullptr, 0, key, keySize, 1, out);
+		return true;
+	}
+	void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		LOGE("file_hash: mmap %s failed", path);
+		return false;
+	}
+	// 各线程同时读不同的块，让内核提前把整个文件读进来
+	madvise(data, size, MADV_WILLNEED);
+	buffer_hash(data, size, key, keySize, threads, out);
+	munmap(data, size);
+	return true;
+}
@@ -0,0 +1,53 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * file_hash.h
+ *
+ * 补丁与 odex 的带密钥指纹.
+ *
+ * 数据按 FILE_HASH_CHUNK_SIZE 切块，每块独立求 SHA-256(可以在多个线程上并行)，
+ * 指纹 = HMAC-SHA256(key, "AFH1" || le64 数据长度 || le32 块大小 || 各块摘要).
+ * 块大小固定，所以指纹与线程数无关.
+ */
+
+#ifndef FILE_HASH_H_
+#define FILE_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sha256.h"
+
+#define FILE_HASH_CHUNK_SIZE (1 << 20)
+#define FILE_HASH_MAX_THREADS 8
+
+/**
+ * @param threads 计算块摘要的线程数，0 表示按 CPU 核数与块数决定
+ */
+void buffer_hash(const void* data, size_t size, const void* key, size_t keySize,
+		int threads, uint8_t out[SHA256_DIGEST_SIZE]);
+
+/**
+ * mmap 文件后计算 buffer_hash
+ *
+ * @return false 表示文件无法打开或映射
+ */
+bool file_hash(const char* path, const void* key, size_t keySize, int threads,
+		uint8_t out[SHA256_DIGEST_SIZE]);
+
+#endif /* FILE_HASH_H_ */
@@ -0,0 +1,322 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * sha256.cpp
+ *
+ * 三种压缩函数都一次处理连续的多个块，消息调度与轮常量与 FIPS 180-4 一致.
+ */
+
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define SHA256_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_SHA2
+#define HWCAP_SHA2 (1 << 6)
+#endif
+#define SHA256_ARM64 1
+#endif
+
+#include "sha256.h"
+
+typedef void (*compress_func)(uint32_t state[8], const uint8_t* data, size_t blocks);
+
+static const uint32_t K[64] __attribute__ ((aligned (16))) = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint32_t INITIAL_STATE[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static inline uint32_t rotr(uint32_t x, int n) {
+	return (x >> n) | (x << (32 - n));
+}
+
+static inline uint32_t loadBe32(const uint8_t* p) {
+	return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+static void compressPortable(uint32_t state[8], const uint8_t* data, size_t blocks) {
+	uint32_t w[64];
+	for (; blocks > 0; --blocks, data += SHA256_BLOCK_SIZE) {
+		for (int i = 0; i < 16; ++i) {
+			w[i] = loadBe32(data + 4 * i);
+		}
+		for (int i = 16; i < 64; ++i) {
+			uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+			uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+		uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+		uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+		for (int i = 0; i < 64; ++i) {
+			uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g))
+					+ K[i] + w[i];
+			uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+			h = g;
+			g = f;
+			f = e;
+			e = d + t1;
+			d = c;
+			c = b;
+			b = a;
+			a = t1 + t2;
+		}
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+		state[5] += f;
+		state[6] += g;
+		state[7] += h;
+	}
+}
+
+#if SHA256_X86
+/**
+ * state 在寄存器中按 sha256rnds2 的要求排成 ABEF / CDGH
+ */
+__attribute__ ((target ("sha,sse4.1")))
+static void compressShaNi(uint32_t state[8], const uint8_t* data, size_t blocks) {
+	const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i tmp = _mm_loadu_si128((const __m128i*) &state[0]);
+	__m128i state1 = _mm_loadu_si128((const __m128i*) &state[4]);
+	tmp = _mm_shuffle_epi32(tmp, 0xb1);            // CDAB
+	state1 = _mm_shuffle_epi32(state1, 0x1b);      // EFGH
+	__m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+	state1 = _mm_blend_epi16(state1, tmp, 0xf0);   // CDGH
+
+	__m128i w[16];
+	for (; blocks > 0; --blocks, data += SHA256_BLOCK_SIZE) {
+		__m128i abefSave = state0;
+		__m128i cdghSave = state1;
+		for (int i = 0; i < 4; ++i) {
+			w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (data + 16 * i)), mask);
+		}
+		for (int i = 4; i < 16; ++i) {
+			__m128i t = _mm_sha256msg1_epu32(w[i - 4], w[i - 3]);
+			t = _mm_add_epi32(t, _mm_alignr_epi8(w[i - 1], w[i - 2], 4));
+			w[i] = _mm_sha256msg2_epu32(t, w[i - 1]);
+		}
+		for (int i = 0; i < 16; ++i) {
+			__m128i msg = _mm_add_epi32(w[i], _mm_load_si128((const __m128i*) &K[4 * i]));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e));
+		}
+		state0 = _mm_add_epi32(state0, abefSave);
+		state1 = _mm_add_epi32(state1, cdghSave);
+	}
+
+	tmp = _mm_shuffle_epi32(state0, 0x1b);         // FEBA
+	state1 = _mm_shuffle_epi32(state1, 0xb1);      // DCHG
+	state0 = _mm_blend_epi16(tmp, state1, 0xf0);   // DCBA
+	state1 = _mm_alignr_epi8(state1, tmp, 8);      // ABEF
+	_mm_storeu_si128((__m128i*) &state[0], state0);
+	_mm_storeu_si128((__m128i*) &state[4], state1);
+}
+
+static bool hasShaNi() {
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)
+			|| (ecx & bit_SSSE3) == 0 || (ecx & bit_SSE4_1) == 0) {
+		return false;
+	}
+	if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+		return false;
+	}
+	return (ebx & (1u << 29)) != 0; // SHA
+}
+#endif
+
+#if SHA256_ARM64
+__attribute__ ((target ("crypto")))
+static void compressArmv8(uint32_t state[8], const uint8_t* data, size_t blocks) {
+	uint32x4_t state0 = vld1q_u32(&state[0]);
+	uint32x4_t state1 = vld1q_u32(&state[4]);
+	uint32x4_t w[16];
+	for (; blocks > 0; --blocks, data += SHA256_BLOCK_SIZE) {
+		uint32x4_t abcdSave = state0;
+		uint32x4_t efghSave = state1;
+		for (int i = 0; i < 4; ++i) {
+			w[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+		}
+		for (int i = 4; i < 16; ++i) {
+			w[i] = vsha256su1q_u32(vsha256su0q_u32(w[i - 4], w[i - 3]), w[i - 2], w[i - 1]);
+		}
+		for (int i = 0; i < 16; ++i) {
+			uint32x4_t msg = vaddq_u32(w[i], vld1q_u32(&K[4 * i]));
+			uint32x4_t abcd = state0;
+			state0 = vsha256hq_u32(state0, state1, msg);
+			state1 = vsha256h2q_u32(state1, abcd, msg);
+		}
+		state0 = vaddq_u32(state0, abcdSave);
+		state1 = vaddq_u32(state1, efghSave);
+	}
+	vst1q_u32(&state[0], state0);
+	vst1q_u32(&state[4], state1);
+}
+#endif
+
+static std::atomic<compress_func> compress_fnPtr(nullptr);
+static std::atomic<const char*> implementation(nullptr);
+
+static void selectCompress() {
+	compress_func fn = compressPortable;
+	const char* name = "portable";
+#if SHA256_X86
+	if (hasShaNi()) {
+		fn = compressShaNi;
+		name = "sha-ni";
+	}
+#elif SHA256_ARM64
+	if ((getauxval(AT_HWCAP) & HWCAP_SHA2) != 0) {
+		fn = compressArmv8;
+		name = "armv8";
+	}
+#endif
+	implementation.store(name, std::memory_order_relaxed);
+	compress_fnPtr.store(fn, std::memory_order_relaxed);
+}
+
+static inline compress_func compress() {
+	// 多个线程同时首次调用时各自选一次，结果相同
+	compress_func fn = compress_fnPtr.load(std::memory_order_relaxed);
+	if (fn == nullptr) {
+		selectCompress();
+		fn = compress_fnPtr.load(std::memory_order_relaxed);
+	}
+	return fn;
+}
+
+const char* sha256_implementation() {
+	compress();
+	return implementation.load(std::memory_order_relaxed);
+}
+
+const char* sha256_forcePortable(bool portable) {
+	if (portable) {
+		implementation.store("portable", std::memory_order_relaxed);
+		compress_fnPtr.store(compressPortable, std::memory_order_relaxed);
+	} else {
+		selectCompress();
+	}
+	return implementation.load(std::memory_order_relaxed);
+}
+
+void sha256_init(Sha256* ctx) {
+	memcpy(ctx->state, INITIAL_STATE, sizeof(INITIAL_STATE));
+	ctx->length = 0;
+	ctx->used = 0;
+}
+
+void sha256_update(Sha256* ctx, const void* data, size_t size) {
+	const uint8_t* p = (const uint8_t*) data;
+	compress_func fn = compress();
+	ctx->length += size;
+	if (ctx->used > 0) {
+		size_t n = SHA256_BLOCK_SIZE - ctx->used;
+		if (n > size) {
+			n = size;
+		}
+		memcpy(ctx->buffer + ctx->used, p, n);
+		ctx->used += n;
+		p += n;
+		size -= n;
+		if (ctx->used < SHA256_BLOCK_SIZE) {
+			return;
+		}
+		fn(ctx->state, ctx->buffer, 1);
+		ctx->used = 0;
+	}
+	size_t blocks = size / SHA256_BLOCK_SIZE;
+	if (blocks > 0) {
+		fn(ctx->state, p, blocks);
+		p += blocks * SHA256_BLOCK_SIZE;
+		size -= blocks * SHA256_BLOCK_SIZE;
+	}
+	if (size > 0) {
+		memcpy(ctx->buffer, p, size);
+		ctx->used = size;
+	}
+}
+
+void sha256_final(Sha256* ctx, uint8_t out[SHA256_DIGEST_SIZE]) {
+	uint64_t bits = ctx->length * 8;
+	uint8_t pad[SHA256_BLOCK_SIZE * 2] = { 0x80 };
+	size_t padSize = (ctx->used < 56 ? 56 : 120) - ctx->used;
+	for (int i = 0; i < 8; ++i) {
+		pad[padSize + i] = (uint8_t) (bits >> (56 - 8 * i));
+	}
+	sha256_update(ctx, pad, padSize + 8);
+	for (int i = 0; i < 8; ++i) {
+		out[4 * i] = (uint8_t) (ctx->state[i] >> 24);
+		out[4 * i + 1] = (uint8_t) (ctx->state[i] >> 16);
+		out[4 * i + 2] = (uint8_t) (ctx->state[i] >> 8);
+		out[4 * i + 3] = (uint8_t) ctx->state[i];
+	}
+}
+
+void sha256(const void* data, size_t size, uint8_t out[SHA256_DIGEST_SIZE]) {
+	Sha256 ctx;
+	sha256_init(&ctx);
+	sha256_update(&ctx, data, size);
+	sha256_final(&ctx, out);
+}
+
+void hmac_sha256(const void* key, size_t keySize, const void* data, size_t size,
+		uint8_t out[SHA256_DIGEST_SIZE]) {
+	uint8_t block[SHA256_BLOCK_SIZE] = { 0 };
+	if (keySize > SHA256_BLOCK_SIZE) {
+		sha256(key, keySize, block);
+	} else if (keySize > 0) {
+		memcpy(block, key, keySize);
+	}
+	uint8_t pad[SHA256_BLOCK_SIZE];
+	uint8_t inner[SHA256_DIGEST_SIZE];
+	Sha256 ctx;
+
+	for (int i = 0; i < SHA256_BLOCK_SIZE; ++i) {
+		pad[i] = block[i] ^ 0x36;
+	}
+	sha256_init(&ctx);
+	sha256_update(&ctx, pad, sizeof(pad));
+	sha256_update(&ctx, data, size);
+	sha256_final(&ctx, inner);
+
+	for (int i = 0; i < SHA256_BLOCK_SIZE; ++i) {
+		pad[i] = block[i] ^ 0x5c;
+	}
+	sha256_init(&ctx);
+	sha256_update(&ctx, pad, sizeof(pad));
+	sha256_update(&ctx, inner, sizeof(inner));
+	sha256_final(&ctx, out);
+}
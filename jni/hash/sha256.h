@@ -0,0 +1,68 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * sha256.h
+ *
+ * SHA-256 与 HMAC-SHA256.
+ *
+ * 压缩函数在第一次使用时按 CPU 选定一次:
+ * - x86/x86_64 上支持 SHA 扩展(SHA-NI)时用 sha256rnds2 等指令；
+ * - arm64 上 HWCAP_SHA2 时用 ARMv8 Crypto 扩展的 sha256h 等指令；
+ * - 其它情况用可移植的 C 实现.
+ */
+
+#ifndef SHA256_H_
+#define SHA256_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_BLOCK_SIZE  64
+#define SHA256_DIGEST_SIZE 32
+
+struct Sha256 {
+	uint32_t state[8];
+	uint64_t length;
+	uint8_t buffer[SHA256_BLOCK_SIZE];
+	size_t used;
+};
+
+void sha256_init(Sha256* ctx);
+
+void sha256_update(Sha256* ctx, const void* data, size_t size);
+
+void sha256_final(Sha256* ctx, uint8_t out[SHA256_DIGEST_SIZE]);
+
+void sha256(const void* data, size_t size, uint8_t out[SHA256_DIGEST_SIZE]);
+
+void hmac_sha256(const void* key, size_t keySize, const void* data, size_t size,
+		uint8_t out[SHA256_DIGEST_SIZE]);
+
+/**
+ * @return 当前使用的实现: "sha-ni"、"armv8" 或 "portable"
+ */
+const char* sha256_implementation();
+
+/**
+ * 切换到可移植实现或恢复按 CPU 选择，供 host 上对比两种实现
+ *
+ * @return 切换后使用的实现
+ */
+const char* sha256_forcePortable(bool portable);
+
+#endif /* SHA256_H_ */
@@ -0,0 +1,26 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../art/art.h"
+#include "../art/art_5_0.h"
+
+#define FAKE_RUNTIME      fakeArt_5_0
+#define FAKE_RUNTIME_NAME "art_5_0"
+#define FAKE_APILEVEL     21
+#define FAKE_JNI_ENTRY    entry_point_from_jni_
+
+#include "fake_art.inc"
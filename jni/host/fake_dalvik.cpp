@@ -0,0 +1,97 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+
+#include "../dalvik/dalvik.h"
+#include "fake_runtime.h"
+
+namespace {
+
+const char* const methodName = "fake";
+
+void initClass(void* clazz) {
+	((ClassObject*) clazz)->status = CLASS_VERIFIED;
+}
+
+void initMethod(void* method, void* clazz, uint32_t accessFlags, uint32_t seed) {
+	Method* meth = (Method*) method;
+	uintptr_t base = (uintptr_t) seed << 4;
+	meth->clazz = (ClassObject*) clazz;
+	meth->accessFlags = accessFlags;
+	meth->methodIndex = (u2) seed;
+	meth->registersSize = (u2) (seed + 1);
+	meth->outsSize = (u2) (seed + 2);
+	meth->insSize = (u2) (seed + 3);
+	meth->name = methodName;
+	meth->prototype.dexFile = (u4*) (base + 0x10);
+	meth->prototype.protoIdx = seed;
+	meth->shorty = "V";
+	meth->insns = (u2*) (base + 0x20);
+	meth->jniArgInfo = (int) seed;
+	meth->nativeFunc = (DalvikBridgeFunc) (base + 0x30);
+}
+
+void initField(void* field, void* clazz, uint32_t accessFlags) {
+	Field* dalvikField = (Field*) field;
+	dalvikField->clazz = clazz;
+	dalvikField->name = "fake";
+	dalvikField->signature = "I";
+	dalvikField->accessFlags = accessFlags;
+}
+
+uint32_t fieldFlags(const void* field) {
+	return ((const Field*) field)->accessFlags;
+}
+
+void setJniEntryPoint(void* method, void* fnPtr) {
+	((Method*) method)->insns = (u2*) fnPtr;
+}
+
+/**
+ * 与 dalvik_replaceDalvikMethod 拷贝的成员一一对应，clazz、name 与 accessFlags 的其余位保持不变
+ */
+bool replaced(const void* target, const void* replacement) {
+	const Method* meth = (const Method*) target;
+	const Method* src = (const Method*) replacement;
+	return (meth->accessFlags & ACC_PUBLIC) != 0
+			&& meth->methodIndex == src->methodIndex
+			&& meth->jniArgInfo == src->jniArgInfo
+			&& meth->registersSize == src->registersSize
+			&& meth->outsSize == src->outsSize
+			&& meth->insSize == src->insSize
+			&& memcmp(&meth->prototype, &src->prototype, sizeof(DexProto)) == 0
+			&& meth->insns == src->insns
+			&& meth->nativeFunc == src->nativeFunc;
+}
+
+} // namespace
+
+extern const FakeRuntime fakeDalvik = {
+	"dalvik",
+	18,
+	false,
+	sizeof(ClassObject),
+	sizeof(Method),
+	sizeof(Field),
+	initClass,
+	initMethod,
+	initField,
+	fieldFlags,
+	setJniEntryPoint,
+	replaced,
+};
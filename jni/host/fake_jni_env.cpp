@@ -0,0 +1,386 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#include "fake_jni_env.h"
+
+static std::vector<std::unique_ptr<FakeClass>> classes;
+static std::vector<std::unique_ptr<FakeReflected>> reflecteds;
+static std::vector<std::unique_ptr<FakeString>> strings;
+static std::vector<std::unique_ptr<FakeObjectArray>> objectArrays;
+static std::vector<std::unique_ptr<FakeBooleanArray>> booleanArrays;
+static std::vector<std::unique_ptr<FakeByteArray>> byteArrays;
+static std::vector<std::unique_ptr<FakeIntArray>> intArrays;
+static std::vector<std::unique_ptr<FakeLongArray>> longArrays;
+static std::vector<std::unique_ptr<FakeDirectBuffer>> directBuffers;
+
+static bool pendingException;
+static int localFrameDepth;
+
+static FakeClass* findClass(const char* name) {
+	for (const auto& clazz : classes) {
+		if (clazz->name == name) {
+			return clazz.get();
+		}
+	}
+	return nullptr;
+}
+
+static jclass FindClass(JNIEnv*, const char* name) {
+	FakeClass* clazz = findClass(name);
+	if (clazz == nullptr) {
+		pendingException = true; // NoClassDefFoundError
+	}
+	return clazz;
+}
+
+static jmethodID FromReflectedMethod(JNIEnv*, jobject method) {
+	return (jmethodID) static_cast<FakeReflected*>(method)->id;
+}
+
+static jfieldID FromReflectedField(JNIEnv*, jobject field) {
+	return (jfieldID) static_cast<FakeReflected*>(field)->id;
+}
+
+static jboolean ExceptionCheck(JNIEnv*) {
+	return pendingException ? JNI_TRUE : JNI_FALSE;
+}
+
+static void ExceptionClear(JNIEnv*) {
+	pendingException = false;
+}
+
+static jint PushLocalFrame(JNIEnv*, jint) {
+	++localFrameDepth;
+	return JNI_OK;
+}
+
+static jobject PopLocalFrame(JNIEnv*, jobject result) {
+	if (localFrameDepth == 0) {
+		fprintf(stderr, "PopLocalFrame without PushLocalFrame\n");
+		abort();
+	}
+	--localFrameDepth;
+	return result;
+}
+
+static jobject NewGlobalRef(JNIEnv*, jobject obj) {
+	return obj;
+}
+
+static void DeleteGlobalRef(JNIEnv*, jobject) {
+}
+
+static void DeleteLocalRef(JNIEnv*, jobject) {
+}
+
+static std::string methodKey(const char* name, const char* sig) {
+	std::string key(name);
+	key.push_back('\0');
+	key.append(sig);
+	return key;
+}
+
+static jmethodID getMethodID(jclass clazz, const char* name, const char* sig) {
+	const FakeClass* fake = static_cast<FakeClass*>(clazz);
+	auto it = fake->methodIndex.find(methodKey(name, sig));
+	if (it != fake->methodIndex.end()) {
+		return it->second;
+	}
+	pendingException = true; // NoSuchMethodError
+	return nullptr;
+}
+
+static jmethodID GetMethodID(JNIEnv*, jclass clazz, const char* name, const char* sig) {
+	return getMethodID(clazz, name, sig);
+}
+
+static jmethodID GetStaticMethodID(JNIEnv*, jclass clazz, const char* name, const char* sig) {
+	return getMethodID(clazz, name, sig);
+}
+
+static jobject CallObjectMethodV(JNIEnv*, jobject, jmethodID, va_list) {
+	fprintf(stderr, "CallObjectMethod is not supported on host\n");
+	abort();
+}
+
+static jstring NewStringUTF(JNIEnv*, const char* bytes) {
+	return fake_string(bytes);
+}
+
+static const char* GetStringUTFChars(JNIEnv*, jstring string, jboolean* isCopy) {
+	if (isCopy != nullptr) {
+		*isCopy = JNI_FALSE;
+	}
+	return static_cast<FakeString*>(string)->utf.c_str();
+}
+
+static void ReleaseStringUTFChars(JNIEnv*, jstring, const char*) {
+}
+
+static jsize GetArrayLength(JNIEnv*, jarray array) {
+	// 作为参数传给 libandfix 的有 FakeObjectArray、FakeBooleanArray、FakeByteArray 与 FakeIntArray
+	for (const std::unique_ptr<FakeBooleanArray>& booleans : booleanArrays) {
+		if (booleans.get() == array) {
+			return (jsize) booleans->values.size();
+		}
+	}
+	for (const std::unique_ptr<FakeByteArray>& bytes : byteArrays) {
+		if (bytes.get() == array) {
+			return (jsize) bytes->values.size();
+		}
+	}
+	for (const std::unique_ptr<FakeIntArray>& ints : intArrays) {
+		if (ints.get() == array) {
+			return (jsize) ints->values.size();
+		}
+	}
+	return (jsize) static_cast<FakeObjectArray*>(array)->elements.size();
+}
+
+static jobject GetObjectArrayElement(JNIEnv*, jobjectArray array, jsize index) {
+	return static_cast<FakeObjectArray*>(array)->elements.at(index);
+}
+
+static void GetBooleanArrayRegion(JNIEnv*, jbooleanArray array, jsize start, jsize len,
+		jboolean* buf) {
+	FakeBooleanArray* booleans = static_cast<FakeBooleanArray*>(array);
+	memcpy(buf, booleans->values.data() + start, len * sizeof(jboolean));
+}
+
+static void GetByteArrayRegion(JNIEnv*, jbyteArray array, jsize start, jsize len, jbyte* buf) {
+	FakeByteArray* bytes = static_cast<FakeByteArray*>(array);
+	memcpy(buf, bytes->values.data() + start, len * sizeof(jbyte));
+}
+
+static jbyteArray NewByteArray(JNIEnv*, jsize length) {
+	FakeByteArray* array = new FakeByteArray();
+	array->values.resize(length);
+	byteArrays.emplace_back(array);
+	return array;
+}
+
+static jintArray NewIntArray(JNIEnv*, jsize length) {
+	FakeIntArray* array = new FakeIntArray();
+	array->values.resize(length);
+	intArrays.emplace_back(array);
+	return array;
+}
+
+static jlongArray NewLongArray(JNIEnv*, jsize length) {
+	FakeLongArray* array = new FakeLongArray();
+	array->values.resize(length);
+	longArrays.emplace_back(array);
+	return array;
+}
+
+static void SetByteArrayRegion(JNIEnv*, jbyteArray array, jsize start, jsize len,
+		const jbyte* buf) {
+	FakeByteArray* bytes = static_cast<FakeByteArray*>(array);
+	memcpy(bytes->values.data() + start, buf, len * sizeof(jbyte));
+}
+
+static void SetIntArrayRegion(JNIEnv*, jintArray array, jsize start, jsize len, const jint* buf) {
+	FakeIntArray* ints = static_cast<FakeIntArray*>(array);
+	memcpy(ints->values.data() + start, buf, len * sizeof(jint));
+}
+
+static void SetLongArrayRegion(JNIEnv*, jlongArray array, jsize start, jsize len, const jlong* buf) {
+	FakeLongArray* longs = static_cast<FakeLongArray*>(array);
+	memcpy(longs->values.data() + start, buf, len * sizeof(jlong));
+}
+
+static jobject NewDirectByteBuffer(JNIEnv*, void* address, jlong capacity) {
+	FakeDirectBuffer* buffer = new FakeDirectBuffer();
+	buffer->address = address;
+	buffer->capacity = capacity;
+	directBuffers.emplace_back(buffer);
+	return buffer;
+}
+
+static jint RegisterNatives(JNIEnv*, jclass clazz, const JNINativeMethod* methods, jint nMethods) {
+	FakeClass* fake = static_cast<FakeClass*>(clazz);
+	for (jint i = 0; i < nMethods; ++i) {
+		fake->natives.push_back(methods[i]);
+		if (fake->registerHook != nullptr) {
+			jmethodID id = getMethodID(clazz, methods[i].name, methods[i].signature);
+			if (id == nullptr) {
+				return JNI_ERR;
+			}
+			fake->registerHook(id, methods[i].fnPtr);
+		}
+	}
+	return JNI_OK;
+}
+
+static jint GetJavaVM(JNIEnv*, JavaVM** vm) {
+	*vm = fake_vm();
+	return JNI_OK;
+}
+
+static const JNINativeInterface nativeInterface = {
+	FindClass,
+	FromReflectedMethod,
+	FromReflectedField,
+	ExceptionCheck,
+	ExceptionClear,
+	PushLocalFrame,
+	PopLocalFrame,
+	NewGlobalRef,
+	DeleteGlobalRef,
+	DeleteLocalRef,
+	GetMethodID,
+	CallObjectMethodV,
+	GetStaticMethodID,
+	NewStringUTF,
+	GetStringUTFChars,
+	ReleaseStringUTFChars,
+	GetArrayLength,
+	GetObjectArrayElement,
+	GetBooleanArrayRegion,
+	GetByteArrayRegion,
+	NewByteArray,
+	NewIntArray,
+	NewLongArray,
+	SetByteArrayRegion,
+	SetIntArrayRegion,
+	SetLongArrayRegion,
+	NewDirectByteBuffer,
+	RegisterNatives,
+	GetJavaVM,
+};
+
+static JNIEnv env = { &nativeInterface };
+
+static jint DestroyJavaVM(JavaVM*) {
+	return JNI_ERR;
+}
+
+static jint AttachCurrentThread(JavaVM*, JNIEnv** p_env, void*) {
+	*p_env = &env;
+	return JNI_OK;
+}
+
+static jint DetachCurrentThread(JavaVM*) {
+	return JNI_OK;
+}
+
+static jint GetEnv(JavaVM*, void** p_env, jint) {
+	*p_env = &env;
+	return JNI_OK;
+}
+
+static const JNIInvokeInterface invokeInterface = {
+	DestroyJavaVM,
+	AttachCurrentThread,
+	DetachCurrentThread,
+	GetEnv,
+};
+
+static JavaVM vm = { &invokeInterface };
+
+JNIEnv* fake_env() {
+	return &env;
+}
+
+JavaVM* fake_vm() {
+	return &vm;
+}
+
+FakeClass* fake_defineClass(const char* name) {
+	FakeClass* clazz = findClass(name);
+	if (clazz == nullptr) {
+		clazz = new FakeClass();
+		clazz->name = name;
+		clazz->registerHook = nullptr;
+		classes.emplace_back(clazz);
+	}
+	return clazz;
+}
+
+void fake_defineMethod(FakeClass* clazz, const char* name, const char* signature, void* id) {
+	clazz->methods.push_back({ name, signature, (jmethodID) id });
+	clazz->methodIndex[methodKey(name, signature)] = (jmethodID) id;
+}
+
+void* fake_nativeMethod(const char* className, const char* name) {
+	FakeClass* clazz = findClass(className);
+	if (clazz == nullptr) {
+		return nullptr;
+	}
+	for (const JNINativeMethod& method : clazz->natives) {
+		if (strcmp(method.name, name) == 0) {
+			return method.fnPtr;
+		}
+	}
+	return nullptr;
+}
+
+FakeReflected* fake_reflected(void* id) {
+	FakeReflected* reflected = new FakeReflected();
+	reflected->id = id;
+	reflecteds.emplace_back(reflected);
+	return reflected;
+}
+
+FakeString* fake_string(const char* utf) {
+	FakeString* string = new FakeString();
+	string->utf = utf;
+	strings.emplace_back(string);
+	return string;
+}
+
+FakeObjectArray* fake_objectArray(const std::vector<jobject>& elements) {
+	FakeObjectArray* array = new FakeObjectArray();
+	array->elements = elements;
+	objectArrays.emplace_back(array);
+	return array;
+}
+
+FakeBooleanArray* fake_booleanArray(const std::vector<jboolean>& values) {
+	FakeBooleanArray* array = new FakeBooleanArray();
+	array->values = values;
+	booleanArrays.emplace_back(array);
+	return array;
+}
+
+FakeByteArray* fake_byteArray(const std::vector<jbyte>& values) {
+	FakeByteArray* array = new FakeByteArray();
+	array->values = values;
+	byteArrays.emplace_back(array);
+	return array;
+}
+
+int fake_localFrameDepth() {
+	return localFrameDepth;
+}
+
+void fake_collect() {
+	reflecteds.clear();
+	strings.clear();
+	objectArrays.clear();
+	booleanArrays.clear();
+	byteArrays.clear();
+	intArrays.clear();
+	longArrays.clear();
+	directBuffers.clear();
+	pendingException = false;
+}
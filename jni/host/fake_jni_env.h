@@ -0,0 +1,131 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * fake_jni_env.h
+ *
+ * host 构建用的 JNIEnv / JavaVM 替身.
+ *
+ * - java.lang.reflect.Method / Field 用 FakeReflected 表示，FromReflectedMethod /
+ *   FromReflectedField 直接返回其中保存的 ArtMethod* / ArtField* / Method*
+ * - FindClass 只认识通过 fake_defineClass 定义过的类，RegisterNatives 会记录注册的函数，
+ *   可以用 fake_nativeMethod 取回，从而像 Java 层一样调用 libandfix 的 JNI 函数
+ * - ArtMethod / Class 等合成对象见 fake_runtime.h
+ */
+
+#ifndef FAKE_JNI_ENV_H_
+#define FAKE_JNI_ENV_H_
+
+#include <jni.h>
+#include <stddef.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct FakeReflected : public _jobject {
+	void* id;
+};
+
+struct FakeString : public _jstring {
+	std::string utf;
+};
+
+struct FakeObjectArray : public _jobjectArray {
+	std::vector<jobject> elements;
+};
+
+struct FakeBooleanArray : public _jbooleanArray {
+	std::vector<jboolean> values;
+};
+
+struct FakeByteArray : public _jbyteArray {
+	std::vector<jbyte> values;
+};
+
+struct FakeIntArray : public _jintArray {
+	std::vector<jint> values;
+};
+
+struct FakeLongArray : public _jlongArray {
+	std::vector<jlong> values;
+};
+
+struct FakeDirectBuffer : public _jobject {
+	void* address;
+	jlong capacity;
+};
+
+/**
+ * RegisterNatives 时的回调，用于模拟 art 把 native 函数写入 entry_point_from_jni_
+ */
+typedef void (*FakeRegisterHook)(jmethodID method, void* fnPtr);
+
+struct FakeMethodId {
+	std::string name;
+	std::string signature;
+	jmethodID id;
+};
+
+struct FakeClass : public _jclass {
+	std::string name;
+	std::vector<FakeMethodId> methods;
+	std::unordered_map<std::string, jmethodID> methodIndex; // name + '\0' + signature
+	std::vector<JNINativeMethod> natives;
+	FakeRegisterHook registerHook;
+};
+
+JNIEnv* fake_env();
+
+JavaVM* fake_vm();
+
+/**
+ * 定义一个 FindClass 能找到的类
+ */
+FakeClass* fake_defineClass(const char* name);
+
+/**
+ * 为类添加一个 GetMethodID / GetStaticMethodID 能找到的方法
+ */
+void fake_defineMethod(FakeClass* clazz, const char* name, const char* signature, void* id);
+
+/**
+ * @return 通过 RegisterNatives 注册到 className 的 native 函数，没有则为 null
+ */
+void* fake_nativeMethod(const char* className, const char* name);
+
+FakeReflected* fake_reflected(void* id);
+
+FakeString* fake_string(const char* utf);
+
+FakeObjectArray* fake_objectArray(const std::vector<jobject>& elements);
+
+FakeBooleanArray* fake_booleanArray(const std::vector<jboolean>& values);
+
+FakeByteArray* fake_byteArray(const std::vector<jbyte>& values);
+
+/**
+ * 当前 PushLocalFrame 的嵌套深度，用于检查 frame 是否成对使用
+ */
+int fake_localFrameDepth();
+
+/**
+ * 释放 fake_* 创建的所有对象(类除外)
+ */
+void fake_collect();
+
+#endif /* FAKE_JNI_ENV_H_ */
@@ -0,0 +1,134 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include "fake_runtime.h"
+#include "fake_jni_env.h"
+
+#define PROBE_CLASS "com/alipay/euler/andfix/AndFix$LayoutProbe"
+
+// 每次向系统申请的大小，1M 个 7.0 的 ArtMethod 约 64MB
+#define HEAP_CHUNK_SIZE (64 << 20)
+// 没有 MAP_32BIT 时从这个地址开始尝试
+#define HEAP_HINT       0x10000000UL
+
+const FakeRuntime* const fakeRuntimes[] = {
+	&fakeArt_4_4,
+	&fakeArt_5_0,
+	&fakeArt_5_1,
+	&fakeArt_6_0,
+	&fakeArt_7_0,
+	&fakeDalvik,
+	nullptr,
+};
+
+struct HeapChunk {
+	char* base;
+	size_t size;
+};
+
+static std::vector<HeapChunk> chunks;
+static size_t used;
+
+static char* map32(size_t size) {
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined(MAP_32BIT)
+	flags |= MAP_32BIT;
+	void* hint = nullptr;
+#else
+	void* hint = (void*) HEAP_HINT;
+#endif
+	void* ptr = mmap(hint, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (ptr == MAP_FAILED) {
+		return nullptr;
+	}
+	if ((uintptr_t) ptr + size - 1 > 0xffffffffUL) {
+		munmap(ptr, size);
+		return nullptr;
+	}
+	return (char*) ptr;
+}
+
+void* fake_alloc32(size_t size) {
+	size = (size + 15) & ~(size_t) 15;
+	if (chunks.empty() || chunks.back().size - used < size) {
+		size_t chunkSize = size > HEAP_CHUNK_SIZE ? size : HEAP_CHUNK_SIZE;
+		char* base = map32(chunkSize);
+		if (base == nullptr) {
+			fprintf(stderr, "fake_alloc32: no memory below 4GB for %zu bytes\n", size);
+			abort();
+		}
+		chunks.push_back({ base, chunkSize });
+		used = 0;
+	}
+	// mmap 的匿名内存本身就是清零的
+	void* ptr = chunks.back().base + used;
+	used += size;
+	return ptr;
+}
+
+void fake_resetHeap() {
+	for (const HeapChunk& chunk : chunks) {
+		munmap(chunk.base, chunk.size);
+	}
+	chunks.clear();
+	used = 0;
+}
+
+FakeMethodTable fake_newMethods(const FakeRuntime& runtime, size_t count,
+		uint32_t accessFlags, uint32_t seed) {
+	FakeMethodTable table;
+	table.runtime = &runtime;
+	table.clazz = fake_alloc32(runtime.classSize);
+	runtime.initClass(table.clazz);
+	table.methods = (char*) fake_alloc32(runtime.methodSize * count);
+	table.count = count;
+	for (size_t i = 0; i < count; ++i) {
+		runtime.initMethod(table.method(i), table.clazz, accessFlags, seed + (uint32_t) i);
+	}
+	return table;
+}
+
+static const FakeRuntime* probeRuntime;
+
+static void probeRegisterHook(jmethodID method, void* fnPtr) {
+	probeRuntime->setJniEntryPoint(method, fnPtr);
+}
+
+void fake_defineProbeClass(const FakeRuntime& runtime) {
+	// 与 AndFix.LayoutProbe 一致: a() public static final, b() private static, n() private static native
+	static const uint32_t flags[] = { 0x0019, 0x000a, 0x010a };
+	static const char* const names[] = { "a", "b", "n" };
+
+	FakeClass* clazz = fake_defineClass(PROBE_CLASS);
+	clazz->methods.clear();
+	clazz->natives.clear();
+	clazz->registerHook = probeRegisterHook;
+	probeRuntime = &runtime;
+
+	FakeMethodTable table = fake_newMethods(runtime, 3, 0, 0x9e3779b9);
+	for (size_t i = 0; i < 3; ++i) {
+		runtime.initMethod(table.method(i), table.clazz, flags[i], 0x9e3779b9 + (uint32_t) i);
+		fake_defineMethod(clazz, names[i], "()V", table.method(i));
+	}
+}
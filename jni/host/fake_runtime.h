@@ -0,0 +1,101 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * fake_runtime.h
+ *
+ * 按 art_x_x.h / dalvik.h 中的结构体合成 Class、ArtMethod、ArtField、Method 对象.
+ *
+ * 每个版本的头文件都定义了同名的 art::mirror::ArtMethod，不能放在同一个编译单元中，所以每个版本
+ * 一个 fake_art_x_x.cpp，通过 FakeRuntime 这张函数表对外提供.
+ * 5.0 起 declaring_class_ 是 32 位的引用，所以所有合成对象都分配在低 4GB 中.
+ */
+
+#ifndef FAKE_RUNTIME_H_
+#define FAKE_RUNTIME_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct FakeRuntime {
+	const char* name;        // "art_6_0"、"dalvik"
+	int apilevel;            // 传给 AndFix.setup 的 apilevel
+	bool isArt;
+	size_t classSize;
+	size_t methodSize;
+	size_t fieldSize;
+
+	void (*initClass)(void* clazz);
+	/**
+	 * 用 seed 生成的字节填满整个方法结构，再写入 declaring class 与访问权限，
+	 * 不同 seed 的两个方法除这两项外每个字节都不同
+	 */
+	void (*initMethod)(void* method, void* clazz, uint32_t accessFlags, uint32_t seed);
+	void (*initField)(void* field, void* clazz, uint32_t accessFlags);
+	uint32_t (*fieldFlags)(const void* field);
+	/**
+	 * 模拟 RegisterNatives: 把 fnPtr 写入 native 方法的 jni 入口
+	 */
+	void (*setJniEntryPoint)(void* method, void* fnPtr);
+	/**
+	 * @return target 是否已是 replacement 的实现(按头文件中的结构体逐项检查)
+	 */
+	bool (*replaced)(const void* target, const void* replacement);
+};
+
+extern const FakeRuntime fakeArt_4_4;
+extern const FakeRuntime fakeArt_5_0;
+extern const FakeRuntime fakeArt_5_1;
+extern const FakeRuntime fakeArt_6_0;
+extern const FakeRuntime fakeArt_7_0;
+extern const FakeRuntime fakeDalvik;
+
+/**
+ * 所有支持的布局，以 null 结尾
+ */
+extern const FakeRuntime* const fakeRuntimes[];
+
+/**
+ * 在低 4GB 中分配清零的内存，按 16 字节对齐，只能通过 fake_resetHeap 统一释放
+ */
+void* fake_alloc32(size_t size);
+
+void fake_resetHeap();
+
+/**
+ * 连续存放的 count 个方法，与 art 中 methods_ 数组的布局一致
+ */
+struct FakeMethodTable {
+	const FakeRuntime* runtime;
+	void* clazz;
+	char* methods;
+	size_t count;
+
+	void* method(size_t i) const {
+		return methods + i * runtime->methodSize;
+	}
+};
+
+FakeMethodTable fake_newMethods(const FakeRuntime& runtime, size_t count,
+		uint32_t accessFlags, uint32_t seed);
+
+/**
+ * 按 runtime 定义 AndFix$LayoutProbe(a、b、n 三个相邻的方法)，供 art_initLayout 探测布局
+ */
+void fake_defineProbeClass(const FakeRuntime& runtime);
+
+#endif /* FAKE_RUNTIME_H_ */
@@ -0,0 +1,196 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include <zlib.h>
+
+#include "fake_zip.h"
+
+static void put16(std::vector<uint8_t>* out, uint32_t value) {
+	out->push_back((uint8_t) value);
+	out->push_back((uint8_t) (value >> 8));
+}
+
+static void put32(std::vector<uint8_t>* out, uint32_t value) {
+	put16(out, value & 0xffff);
+	put16(out, value >> 16);
+}
+
+static void put64(std::vector<uint8_t>* out, uint64_t value) {
+	put32(out, (uint32_t) value);
+	put32(out, (uint32_t) (value >> 32));
+}
+
+static void putBytes(std::vector<uint8_t>* out, const void* data, size_t size) {
+	const uint8_t* p = (const uint8_t*) data;
+	out->insert(out->end(), p, p + size);
+}
+
+std::vector<FakeZipEntry> fake_zipEntries(size_t count, uint32_t seed) {
+	std::vector<FakeZipEntry> entries(count);
+	uint32_t x = seed | 1;
+	for (size_t i = 0; i < count; ++i) {
+		FakeZipEntry& entry = entries[i];
+		char name[64];
+		snprintf(name, sizeof(name), "dir%03zu/entry%07zu.class", i % 97, i);
+		entry.name = name;
+		size_t size = (i * 37) % 311;
+		entry.data.resize(size);
+		for (size_t j = 0; j < size; ++j) {
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			// 前半随机、后半重复，deflate 有东西可压
+			entry.data[j] = j < size / 2 ? (uint8_t) x : (uint8_t) (j % 7);
+		}
+		entry.deflated = (i % 2) == 1;
+	}
+	// 打乱写入顺序，读取方必须自己排序
+	for (size_t i = count; i > 1; --i) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		std::swap(entries[i - 1], entries[x % i]);
+	}
+	return entries;
+}
+
+static std::vector<uint8_t> deflateRaw(z_stream* stream, const std::vector<uint8_t>& data) {
+	deflateReset(stream);
+	std::vector<uint8_t> out(deflateBound(stream, data.size()) + 16);
+	stream->next_in = (Bytef*) data.data();
+	stream->avail_in = (uInt) data.size();
+	stream->next_out = out.data();
+	stream->avail_out = (uInt) out.size();
+	if (deflate(stream, Z_FINISH) != Z_STREAM_END) {
+		fprintf(stderr, "deflate failed\n");
+		abort();
+	}
+	out.resize(out.size() - stream->avail_out);
+	return out;
+}
+
+std::vector<uint8_t> fake_zipBytes(const std::vector<FakeZipEntry>& entries, bool zip64,
+		const std::string& comment) {
+	z_stream stream = {};
+	deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+
+	std::vector<uint8_t> out;
+	std::vector<uint8_t> directory;
+	uint16_t version = zip64 ? 45 : 20;
+	for (const FakeZipEntry& entry : entries) {
+		std::vector<uint8_t> compressed;
+		if (entry.deflated) {
+			compressed = deflateRaw(&stream, entry.data);
+		}
+		const std::vector<uint8_t>& data = entry.deflated ? compressed : entry.data;
+		uint32_t crc = (uint32_t) crc32(crc32(0L, Z_NULL, 0), entry.data.data(),
+				(uInt) entry.data.size());
+		uint16_t method = entry.deflated ? 8 : 0;
+		uint64_t offset = out.size();
+
+		put32(&out, 0x04034b50);
+		put16(&out, version);
+		put16(&out, 0);
+		put16(&out, method);
+		put32(&out, 0); // time, date
+		put32(&out, crc);
+		put32(&out, zip64 ? 0xffffffff : (uint32_t) data.size());
+		put32(&out, zip64 ? 0xffffffff : (uint32_t) entry.data.size());
+		put16(&out, (uint32_t) entry.name.size());
+		put16(&out, zip64 ? 20 : 0);
+		putBytes(&out, entry.name.data(), entry.name.size());
+		if (zip64) {
+			put16(&out, 0x0001);
+			put16(&out, 16);
+			put64(&out, entry.data.size());
+			put64(&out, data.size());
+		}
+		putBytes(&out, data.data(), data.size());
+
+		put32(&directory, 0x02014b50);
+		put16(&directory, version);
+		put16(&directory, version);
+		put16(&directory, 0);
+		put16(&directory, method);
+		put32(&directory, 0);
+		put32(&directory, crc);
+		put32(&directory, zip64 ? 0xffffffff : (uint32_t) data.size());
+		put32(&directory, zip64 ? 0xffffffff : (uint32_t) entry.data.size());
+		put16(&directory, (uint32_t) entry.name.size());
+		put16(&directory, zip64 ? 28 : 0);
+		put16(&directory, 0); // comment
+		put16(&directory, 0); // disk
+		put16(&directory, 0); // internal attributes
+		put32(&directory, 0); // external attributes
+		put32(&directory, zip64 ? 0xffffffff : (uint32_t) offset);
+		putBytes(&directory, entry.name.data(), entry.name.size());
+		if (zip64) {
+			put16(&directory, 0x0001);
+			put16(&directory, 24);
+			put64(&directory, entry.data.size());
+			put64(&directory, data.size());
+			put64(&directory, offset);
+		}
+	}
+	deflateEnd(&stream);
+
+	uint64_t cdOffset = out.size();
+	putBytes(&out, directory.data(), directory.size());
+	bool needZip64 = zip64 || entries.size() > 0xffff;
+	if (needZip64) {
+		uint64_t recordOffset = out.size();
+		put32(&out, 0x06064b50);
+		put64(&out, 44);
+		put16(&out, 45);
+		put16(&out, 45);
+		put32(&out, 0);
+		put32(&out, 0);
+		put64(&out, entries.size());
+		put64(&out, entries.size());
+		put64(&out, directory.size());
+		put64(&out, cdOffset);
+
+		put32(&out, 0x07064b50);
+		put32(&out, 0);
+		put64(&out, recordOffset);
+		put32(&out, 1);
+	}
+	uint32_t count = needZip64 ? 0xffff : (uint32_t) entries.size();
+	put32(&out, 0x06054b50);
+	put16(&out, 0);
+	put16(&out, 0);
+	put16(&out, count);
+	put16(&out, count);
+	put32(&out, zip64 ? 0xffffffff : (uint32_t) directory.size());
+	put32(&out, zip64 ? 0xffffffff : (uint32_t) cdOffset);
+	put16(&out, (uint32_t) comment.size());
+	putBytes(&out, comment.data(), comment.size());
+	return out;
+}
+
+bool fake_writeFile(const char* path, const std::vector<uint8_t>& bytes) {
+	FILE* file = fopen(path, "wb");
+	if (file == nullptr) {
+		return false;
+	}
+	bool written = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+	return fclose(file) == 0 && written;
+}
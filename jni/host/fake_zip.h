@@ -0,0 +1,56 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * fake_zip.h
+ *
+ * 生成用于检查 zip/zip_archive 的 ZIP 文件.
+ *
+ * 条目按给定顺序写入(不排序)，deflated 条目用 zlib 的 raw deflate 压缩.
+ * 条目数超过 65535 或 zip64 为 true 时写 zip64 EOCD record 与 locator；
+ * zip64 为 true 时每个条目的大小与偏移也只写在 zip64 extra field 中.
+ */
+
+#ifndef FAKE_ZIP_H_
+#define FAKE_ZIP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+struct FakeZipEntry {
+	std::string name;
+	std::vector<uint8_t> data;
+	bool deflated;
+};
+
+/**
+ * count 个条目，名字唯一、顺序打乱，大小 0 到 300 多字节，一半 deflated
+ */
+std::vector<FakeZipEntry> fake_zipEntries(size_t count, uint32_t seed);
+
+/**
+ * @return 文件的完整内容
+ */
+std::vector<uint8_t> fake_zipBytes(const std::vector<FakeZipEntry>& entries, bool zip64,
+		const std::string& comment);
+
+bool fake_writeFile(const char* path, const std::vector<uint8_t>& bytes);
+
+#endif /* FAKE_ZIP_H_ */
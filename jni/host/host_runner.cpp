@@ -0,0 +1,998 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * host_runner.cpp
+ *
+ * 在 host 上通过 JNI_OnLoad 注册的 native 函数走一遍 AndFix 的 Java 入口:
+ * 对每种布局分别用 replaceMethod / replaceMethods 替换 N 对合成方法，检查替换结果，
+ * 再用 restoreMethods 回滚并检查是否还原，最后输出每个方法的耗时.
+ * 另外检查 setFieldFlag 与 setFieldsPublic 对字段访问权限的修改，以及并发读取的线程
+ * 在替换过程中不会看到新旧混杂的 ArtMethod.
+ *
+ * usage: andfix_host_runner [count]
+ * 全部通过时返回 0.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "fake_jni_env.h"
+#include "fake_runtime.h"
+#include "fake_zip.h"
+#include "../andfix.h"
+#include "../art/art_layout.h"
+#include "../hash/file_hash.h"
+#include "../stats.h"
+#include "../trace.h"
+#include "../zip/zip_archive.h"
+
+#define JNIREG_CLASS "com/alipay/euler/andfix/AndFix"
+#define ZIPREG_CLASS "com/alipay/euler/andfix/ZipArchive"
+
+#define DEFAULT_COUNT 10000
+
+#define QUEUE_PRODUCERS 4
+#define QUEUE_BATCH     64
+
+#define HASH_FILE_SIZE (3 * FILE_HASH_CHUNK_SIZE + 12345)
+
+#define SWAP_READERS 3
+#define SWAP_ROUNDS  20000
+
+extern jint JNI_OnLoad(JavaVM* vm, void* reserved);
+extern "C" uint32_t art_bridgeEntryOffset;
+
+typedef jboolean (*setup_func)(JNIEnv*, jclass, jboolean, jint, jstring, jstring);
+typedef void (*replaceMethod_func)(JNIEnv*, jclass, jobject, jobject);
+typedef jintArray (*replaceMethods_func)(JNIEnv*, jclass, jobjectArray, jobjectArray);
+typedef jint (*restoreMethods_func)(JNIEnv*, jclass);
+typedef void (*setFieldFlag_func)(JNIEnv*, jclass, jobject);
+typedef jint (*setFieldsPublic_func)(JNIEnv*, jclass, jobjectArray);
+typedef jlongArray (*getStats_func)(JNIEnv*, jclass);
+typedef jint (*replaceMethodBySignature_func)(JNIEnv*, jclass, jclass, jstring, jstring,
+		jboolean, jclass, jstring, jstring);
+typedef jlong (*enqueueReplaceMethods_func)(JNIEnv*, jclass, jobjectArray, jobjectArray, jintArray);
+typedef jboolean (*awaitApplied_func)(JNIEnv*, jclass, jlong, jlong);
+typedef jbyteArray (*fingerprint_func)(JNIEnv*, jclass, jstring, jbyteArray);
+typedef jlong (*zipOpen_func)(JNIEnv*, jclass, jstring);
+typedef void (*zipClose_func)(JNIEnv*, jclass, jlong);
+typedef jint (*zipFind_func)(JNIEnv*, jclass, jlong, jstring);
+typedef jobject (*zipMap_func)(JNIEnv*, jclass, jlong, jint);
+typedef jlong (*zipOpenReader_func)(JNIEnv*, jclass, jlong, jint);
+typedef jint (*zipRead_func)(JNIEnv*, jclass, jlong, jbyteArray, jint, jint);
+typedef void (*zipCloseReader_func)(JNIEnv*, jclass, jlong);
+typedef jintArray (*replaceMethodsBySignature_func)(JNIEnv*, jclass, jobjectArray, jobjectArray,
+		jobjectArray, jbooleanArray, jobjectArray, jobjectArray, jobjectArray);
+
+static setup_func setup_fnPtr;
+static replaceMethod_func replaceMethod_fnPtr;
+static replaceMethods_func replaceMethods_fnPtr;
+static restoreMethods_func restoreMethods_fnPtr;
+static setFieldFlag_func setFieldFlag_fnPtr;
+static setFieldsPublic_func setFieldsPublic_fnPtr;
+static getStats_func getStats_fnPtr;
+static replaceMethodBySignature_func replaceMethodBySignature_fnPtr;
+static replaceMethodsBySignature_func replaceMethodsBySignature_fnPtr;
+static enqueueReplaceMethods_func enqueueReplaceMethods_fnPtr;
+static awaitApplied_func awaitApplied_fnPtr;
+static fingerprint_func fingerprint_fnPtr;
+static zipOpen_func zipOpen_fnPtr;
+static zipClose_func zipClose_fnPtr;
+static zipFind_func zipFind_fnPtr;
+static zipMap_func zipMap_fnPtr;
+static zipOpenReader_func zipOpenReader_fnPtr;
+static zipRead_func zipRead_fnPtr;
+static zipCloseReader_func zipCloseReader_fnPtr;
+
+static jclass andfixClass;
+static int failures;
+
+#define CHECK(cond, ...) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+			fprintf(stderr, __VA_ARGS__); \
+			fputc('\n', stderr); \
+			++failures; \
+		} \
+	} while (0)
+
+static double nowNs() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static bool bindNatives() {
+	andfixClass = fake_defineClass(JNIREG_CLASS);
+	fake_defineClass(ZIPREG_CLASS);
+	if (JNI_OnLoad(fake_vm(), nullptr) < 0) {
+		return false;
+	}
+	setup_fnPtr = (setup_func) fake_nativeMethod(JNIREG_CLASS, "setup");
+	replaceMethod_fnPtr = (replaceMethod_func) fake_nativeMethod(JNIREG_CLASS, "replaceMethod");
+	replaceMethods_fnPtr = (replaceMethods_func) fake_nativeMethod(JNIREG_CLASS, "replaceMethods");
+	restoreMethods_fnPtr = (restoreMethods_func) fake_nativeMethod(JNIREG_CLASS, "restoreMethods");
+	setFieldFlag_fnPtr = (setFieldFlag_func) fake_nativeMethod(JNIREG_CLASS, "setFieldFlag");
+	setFieldsPublic_fnPtr = (setFieldsPublic_func) fake_nativeMethod(JNIREG_CLASS, "setFieldsPublic");
+	getStats_fnPtr = (getStats_func) fake_nativeMethod(JNIREG_CLASS, "getNativeStats");
+	replaceMethodBySignature_fnPtr = (replaceMethodBySignature_func) fake_nativeMethod(
+			JNIREG_CLASS, "replaceMethodBySignature");
+	replaceMethodsBySignature_fnPtr = (replaceMethodsBySignature_func) fake_nativeMethod(
+			JNIREG_CLASS, "replaceMethodsBySignature");
+	enqueueReplaceMethods_fnPtr = (enqueueReplaceMethods_func) fake_nativeMethod(
+			JNIREG_CLASS, "enqueueReplaceMethods");
+	awaitApplied_fnPtr = (awaitApplied_func) fake_nativeMethod(JNIREG_CLASS, "awaitApplied");
+	fingerprint_fnPtr = (fingerprint_func) fake_nativeMethod(JNIREG_CLASS, "fingerprint");
+	zipOpen_fnPtr = (zipOpen_func) fake_nativeMethod(ZIPREG_CLASS, "nativeOpen");
+	zipClose_fnPtr = (zipClose_func) fake_nativeMethod(ZIPREG_CLASS, "nativeClose");
+	zipFind_fnPtr = (zipFind_func) fake_nativeMethod(ZIPREG_CLASS, "nativeFind");
+	zipMap_fnPtr = (zipMap_func) fake_nativeMethod(ZIPREG_CLASS, "nativeMap");
+	zipOpenReader_fnPtr = (zipOpenReader_func) fake_nativeMethod(ZIPREG_CLASS, "nativeOpenReader");
+	zipRead_fnPtr = (zipRead_func) fake_nativeMethod(ZIPREG_CLASS, "nativeRead");
+	zipCloseReader_fnPtr = (zipCloseReader_func) fake_nativeMethod(ZIPREG_CLASS,
+			"nativeCloseReader");
+	return setup_fnPtr && replaceMethod_fnPtr && replaceMethods_fnPtr
+			&& restoreMethods_fnPtr && setFieldFlag_fnPtr && setFieldsPublic_fnPtr && getStats_fnPtr
+			&& replaceMethodBySignature_fnPtr && replaceMethodsBySignature_fnPtr
+			&& enqueueReplaceMethods_fnPtr && awaitApplied_fnPtr && fingerprint_fnPtr
+			&& zipOpen_fnPtr && zipClose_fnPtr && zipFind_fnPtr && zipMap_fnPtr
+			&& zipOpenReader_fnPtr && zipRead_fnPtr && zipCloseReader_fnPtr;
+}
+
+/**
+ * 一组待替换的方法: targets[i] 替换为 replacements[i]
+ */
+struct Workload {
+	FakeMethodTable targets;
+	FakeMethodTable replacements;
+	std::vector<char> original; // 替换前被改写的那张表，用于检查 restore
+};
+
+/**
+ * art 下 targets 被改写；dalvik 下沿用 replaceMethod 的参数顺序，被改写的是 replacements
+ */
+static const FakeMethodTable& written(const Workload& work) {
+	return work.targets.runtime->isArt ? work.targets : work.replacements;
+}
+
+static const FakeMethodTable& source(const Workload& work) {
+	return work.targets.runtime->isArt ? work.replacements : work.targets;
+}
+
+static void newWorkload(const FakeRuntime& runtime, size_t count, Workload* work) {
+	// private 方法，替换后应变为 public
+	work->targets = fake_newMethods(runtime, count, 0x0002, 1);
+	work->replacements = fake_newMethods(runtime, count, 0x0002, 0x40000000);
+	const FakeMethodTable& table = written(*work);
+	work->original.assign(table.methods, table.methods + count * runtime.methodSize);
+}
+
+static void checkReplaced(const char* mode, const Workload& work) {
+	const FakeMethodTable& dest = written(work);
+	const FakeMethodTable& src = source(work);
+	size_t mismatch = 0;
+	for (size_t i = 0; i < dest.count; ++i) {
+		if (!dest.runtime->replaced(dest.method(i), src.method(i))) {
+			++mismatch;
+		}
+	}
+	CHECK(mismatch == 0, "%s %s: %zu of %zu methods not replaced",
+			dest.runtime->name, mode, mismatch, dest.count);
+}
+
+static void checkRestored(const char* mode, const Workload& work) {
+	const FakeMethodTable& dest = written(work);
+	jint restored = restoreMethods_fnPtr(fake_env(), andfixClass);
+	CHECK((size_t) restored == dest.count, "%s %s: restored %d of %zu",
+			dest.runtime->name, mode, (int) restored, dest.count);
+	CHECK(memcmp(dest.methods, work.original.data(), work.original.size()) == 0,
+			"%s %s: methods differ after restore", dest.runtime->name, mode);
+}
+
+static double runSingle(const Workload& work) {
+	const size_t count = work.targets.count;
+	std::vector<jobject> targets(count);
+	std::vector<jobject> replacements(count);
+	for (size_t i = 0; i < count; ++i) {
+		targets[i] = fake_reflected(work.targets.method(i));
+		replacements[i] = fake_reflected(work.replacements.method(i));
+	}
+
+	double start = nowNs();
+	for (size_t i = 0; i < count; ++i) {
+		replaceMethod_fnPtr(fake_env(), andfixClass, targets[i], replacements[i]);
+	}
+	double elapsed = nowNs() - start;
+
+	checkReplaced("replaceMethod", work);
+	checkRestored("replaceMethod", work);
+	return elapsed / count;
+}
+
+static double runBatch(const Workload& work) {
+	const size_t count = work.targets.count;
+	std::vector<jobject> targets(count);
+	std::vector<jobject> replacements(count);
+	for (size_t i = 0; i < count; ++i) {
+		targets[i] = fake_reflected(work.targets.method(i));
+		replacements[i] = fake_reflected(work.replacements.method(i));
+	}
+	jobjectArray targetArray = fake_objectArray(targets);
+	jobjectArray replacementArray = fake_objectArray(replacements);
+
+	double start = nowNs();
+	jintArray status = replaceMethods_fnPtr(fake_env(), andfixClass, targetArray, replacementArray);
+	double elapsed = nowNs() - start;
+
+	CHECK(status != nullptr, "%s replaceMethods returned null", work.targets.runtime->name);
+	if (status != nullptr) {
+		const std::vector<jint>& values = static_cast<FakeIntArray*>(status)->values;
+		size_t failed = 0;
+		for (jint value : values) {
+			failed += value != 0;
+		}
+		CHECK(values.size() == count && failed == 0, "%s replaceMethods: %zu failed",
+				work.targets.runtime->name, failed);
+	}
+	CHECK(fake_localFrameDepth() == 0, "%s replaceMethods leaked a local frame",
+			work.targets.runtime->name);
+
+	checkReplaced("replaceMethods", work);
+	checkRestored("replaceMethods", work);
+	return elapsed / count;
+}
+
+/**
+ * 按签名替换: 前一半逐个调用 replaceMethodBySignature，后一半一次 replaceMethodsBySignature
+ */
+static void runBySignature(const Workload& work) {
+	const FakeRuntime& runtime = *work.targets.runtime;
+	const size_t count = work.targets.count;
+	FakeClass* target = fake_defineClass((std::string("host/Target_") + runtime.name).c_str());
+	FakeClass* patch = fake_defineClass((std::string("host/Patch_") + runtime.name).c_str());
+	std::vector<std::string> names(count);
+	for (size_t i = 0; i < count; ++i) {
+		names[i] = "m" + std::to_string(i);
+		fake_defineMethod(target, names[i].c_str(), "(I)V", work.targets.method(i));
+		fake_defineMethod(patch, names[i].c_str(), "(I)V", work.replacements.method(i));
+	}
+	jstring sig = fake_string("(I)V");
+
+	size_t half = count / 2;
+	size_t failed = 0;
+	for (size_t i = 0; i < half; ++i) {
+		jstring name = fake_string(names[i].c_str());
+		failed += replaceMethodBySignature_fnPtr(fake_env(), andfixClass, target, name, sig,
+				JNI_FALSE, patch, name, sig) != 0;
+	}
+	CHECK(failed == 0, "%s replaceMethodBySignature: %zu failed", runtime.name, failed);
+
+	std::vector<jobject> targets(count - half, target);
+	std::vector<jobject> patches(count - half, patch);
+	std::vector<jobject> methodNames;
+	std::vector<jobject> sigs(count - half, sig);
+	for (size_t i = half; i < count; ++i) {
+		methodNames.push_back(fake_string(names[i].c_str()));
+	}
+	jobjectArray nameArray = fake_objectArray(methodNames);
+	jobjectArray sigArray = fake_objectArray(sigs);
+	jintArray status = replaceMethodsBySignature_fnPtr(fake_env(), andfixClass,
+			fake_objectArray(targets), nameArray, sigArray,
+			fake_booleanArray(std::vector<jboolean>(count - half, JNI_FALSE)),
+			fake_objectArray(patches), nameArray, sigArray);
+	CHECK(status != nullptr, "%s replaceMethodsBySignature returned null", runtime.name);
+	if (status != nullptr) {
+		failed = 0;
+		for (jint value : static_cast<FakeIntArray*>(status)->values) {
+			failed += value != 0;
+		}
+		CHECK(failed == 0, "%s replaceMethodsBySignature: %zu failed", runtime.name, failed);
+	}
+
+	jint missing = replaceMethodBySignature_fnPtr(fake_env(), andfixClass, target,
+			fake_string("missing"), sig, JNI_FALSE, patch, fake_string("missing"), sig);
+	CHECK(missing == 2 && !fake_env()->ExceptionCheck(),
+			"%s replaceMethodBySignature: missing method status %d", runtime.name, (int) missing);
+
+	checkReplaced("replaceMethodBySignature", work);
+	checkRestored("replaceMethodBySignature", work);
+}
+
+/**
+ * 提交队列: 前一半经 enqueueReplaceMethods 入队，后一半由 QUEUE_PRODUCERS 个线程
+ * 每次 QUEUE_BATCH 个地经 andfix_enqueue_batch 同时入队，全部等待写入后检查
+ */
+static void runQueue(const Workload& work) {
+	const char* name = work.targets.runtime->name;
+	const size_t count = work.targets.count;
+	const size_t half = count / 2;
+	JNIEnv* env = fake_env();
+
+	std::vector<jobject> targets;
+	std::vector<jobject> replacements;
+	for (size_t i = 0; i < half; ++i) {
+		targets.push_back(fake_reflected(work.targets.method(i)));
+		replacements.push_back(fake_reflected(work.replacements.method(i)));
+	}
+	jintArray status = env->NewIntArray((jsize) half);
+	jlong ticket = enqueueReplaceMethods_fnPtr(env, andfixClass, fake_objectArray(targets),
+			fake_objectArray(replacements), status);
+	CHECK(ticket >= 0, "%s enqueueReplaceMethods returned %lld", name, (long long) ticket);
+
+	std::atomic<size_t> failed(0);
+	std::vector<std::thread> producers;
+	for (int p = 0; p < QUEUE_PRODUCERS; ++p) {
+		producers.emplace_back([&, p]() {
+			std::vector<int64_t> tickets;
+			for (size_t begin = half + p * QUEUE_BATCH; begin < count;
+					begin += QUEUE_PRODUCERS * QUEUE_BATCH) {
+				size_t end = std::min(count, begin + QUEUE_BATCH);
+				std::vector<jmethodID> batchTargets;
+				std::vector<jmethodID> batchReplacements;
+				for (size_t i = begin; i < end; ++i) {
+					batchTargets.push_back((jmethodID) work.targets.method(i));
+					batchReplacements.push_back((jmethodID) work.replacements.method(i));
+				}
+				tickets.push_back(andfix_enqueue_batch(batchTargets.data(),
+						batchReplacements.data(), batchTargets.size(), nullptr));
+			}
+			for (int64_t t : tickets) {
+				failed += t <= 0 || !andfix_await(t, -1);
+			}
+		});
+	}
+	for (std::thread& producer : producers) {
+		producer.join();
+	}
+	CHECK(failed == 0, "%s andfix_enqueue_batch: %zu failed", name, failed.load());
+	CHECK(awaitApplied_fnPtr(env, andfixClass, ticket, -1), "%s awaitApplied", name);
+	CHECK(andfix_await(INT64_MAX, 0) == 0, "%s andfix_await: future ticket applied", name);
+
+	checkReplaced("applyQueue", work);
+	checkRestored("applyQueue", work);
+}
+
+/**
+ * andfix.h: 前一半逐个 andfix_replace，后一半一次 andfix_replace_batch，再逐个 andfix_restore
+ */
+static void runCApi(const Workload& work) {
+	const char* name = work.targets.runtime->name;
+	const size_t count = work.targets.count;
+	CHECK(andfix_api_version() == ANDFIX_API_VERSION, "%s andfix_api_version", name);
+
+	size_t half = count / 2;
+	size_t failed = 0;
+	for (size_t i = 0; i < half; ++i) {
+		failed += andfix_replace((jmethodID) work.targets.method(i),
+				(jmethodID) work.replacements.method(i)) != ANDFIX_OK;
+	}
+	CHECK(failed == 0, "%s andfix_replace: %zu failed", name, failed);
+
+	std::vector<jmethodID> targets;
+	std::vector<jmethodID> replacements;
+	for (size_t i = half; i < count; ++i) {
+		targets.push_back((jmethodID) work.targets.method(i));
+		replacements.push_back((jmethodID) work.replacements.method(i));
+	}
+	targets.push_back(nullptr);
+	replacements.push_back(nullptr);
+	std::vector<int> status(targets.size());
+	int replaced = andfix_replace_batch(targets.data(), replacements.data(), targets.size(),
+			status.data());
+	CHECK(replaced == (int) (count - half) && status.back() == ANDFIX_ERROR_NULL,
+			"%s andfix_replace_batch: %d replaced", name, replaced);
+	checkReplaced("andfix_replace", work);
+
+	const FakeMethodTable& dest = written(work);
+	size_t restored = 0;
+	for (size_t i = 0; i < count; ++i) {
+		restored += andfix_restore((jmethodID) dest.method(i));
+	}
+	CHECK(restored == count && andfix_restore_all() == 0, "%s andfix_restore: %zu of %zu",
+			name, restored, count);
+	CHECK(memcmp(dest.methods, work.original.data(), work.original.size()) == 0,
+			"%s andfix_restore: methods differ after restore", name);
+}
+
+/**
+ * 第 round 次写入的镜像中 i 处的字，入口以外每个字都由 round 决定
+ */
+static inline uint32_t swapWord(uint32_t round, size_t i) {
+	return (round + 1) * 2654435761u ^ (uint32_t) i * 40503u;
+}
+
+static inline void* swapEntry(uint32_t round) {
+	return (void*) (uintptr_t) ((round + 1) << 4);
+}
+
+/**
+ * 一个线程反复用 art_writeMethod 写入新的镜像，SWAP_READERS 个线程同时读取.
+ * 读取方按 seqlock 的方式: acquire 读入口、读其余字段、acquire fence、再读入口，两次入口相同
+ * 且不是桥时，读到的字段必须完全属于该入口对应的镜像.
+ */
+static void runSwapStress(const FakeRuntime& runtime) {
+	const ArtMethodLayout& layout = artMethodLayout;
+	void* bridge = art_quickBridge();
+	if (bridge == nullptr) {
+		printf("%-8s swap stress skipped, no bridge on this arch\n", runtime.name);
+		return;
+	}
+	const size_t begin = layout.copy_offset;
+	const size_t end = layout.size;
+	const size_t entryOffset = layout.entry_point_from_quick_compiled_code_offset;
+	char* method = (char*) fake_alloc32(runtime.methodSize);
+	void** entry = (void**) (method + entryOffset);
+
+	std::vector<char> image(end - begin);
+	auto build = [&](uint32_t round) {
+		for (size_t i = begin; i < end; i += sizeof(uint32_t)) {
+			uint32_t word = swapWord(round, i);
+			memcpy(&image[i - begin], &word, sizeof(word));
+		}
+		void* value = swapEntry(round);
+		memcpy(&image[entryOffset - begin], &value, sizeof(value));
+	};
+	build(0);
+	memcpy(method + begin, image.data(), image.size());
+
+	std::atomic<bool> done(false);
+	std::atomic<uint64_t> consistent(0);
+	std::atomic<uint64_t> torn(0);
+	std::vector<std::thread> readers;
+	for (int r = 0; r < SWAP_READERS; ++r) {
+		readers.emplace_back([&]() {
+			std::vector<uint32_t> words((end - begin) / sizeof(uint32_t));
+			uint64_t good = 0;
+			uint64_t bad = 0;
+			while (!done.load(std::memory_order_relaxed)) {
+				void* first = __atomic_load_n(entry, __ATOMIC_ACQUIRE);
+				for (size_t i = begin; i < end; i += sizeof(uint32_t)) {
+					words[(i - begin) / sizeof(uint32_t)] =
+							__atomic_load_n((uint32_t*) (method + i), __ATOMIC_RELAXED);
+				}
+				__atomic_thread_fence(__ATOMIC_ACQUIRE);
+				void* second = __atomic_load_n(entry, __ATOMIC_RELAXED);
+				if (first != second || first == bridge) {
+					continue;
+				}
+				uint32_t round = (uint32_t) (((uintptr_t) first >> 4) - 1);
+				bool match = true;
+				for (size_t i = begin; i < end; i += sizeof(uint32_t)) {
+					if (i >= entryOffset && i < entryOffset + sizeof(void*)) {
+						continue;
+					}
+					match &= words[(i - begin) / sizeof(uint32_t)] == swapWord(round, i);
+				}
+				++(match ? good : bad);
+			}
+			consistent += good;
+			torn += bad;
+		});
+	}
+
+	for (uint32_t round = 1; round <= SWAP_ROUNDS; ++round) {
+		build(round);
+		art_writeMethod(method, image.data(), begin, image.size());
+	}
+	done = true;
+	for (std::thread& reader : readers) {
+		reader.join();
+	}
+	CHECK(torn == 0, "%s swap stress: %llu torn reads of %llu", runtime.name,
+			(unsigned long long) torn.load(), (unsigned long long) (torn + consistent));
+	CHECK(__atomic_load_n(entry, __ATOMIC_RELAXED) == swapEntry(SWAP_ROUNDS),
+			"%s swap stress: final entry %p", runtime.name, *entry);
+}
+
+static long swapTarget(void* method, long value) {
+	return method != nullptr ? value + 1 : -1;
+}
+
+/**
+ * 通过桥调用方法: 桥应当一直等到入口被写为 swapTarget，再带着原参数跳过去
+ */
+static void runBridgeCall(const FakeRuntime& runtime) {
+	void* bridge = art_quickBridge();
+	if (bridge == nullptr) {
+		return;
+	}
+	const size_t entryOffset = artMethodLayout.entry_point_from_quick_compiled_code_offset;
+	char* method = (char*) fake_alloc32(runtime.methodSize);
+	void** entry = (void**) (method + entryOffset);
+	__atomic_store_n(&art_bridgeEntryOffset, (uint32_t) entryOffset, __ATOMIC_RELAXED);
+	__atomic_store_n(entry, bridge, __ATOMIC_RELAXED);
+
+	std::thread writer([&]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		__atomic_store_n(entry, (void*) &swapTarget, __ATOMIC_RELEASE);
+	});
+	long result = ((long (*)(void*, long)) bridge)(method, 41);
+	writer.join();
+	CHECK(result == 42, "%s bridge call returned %ld", runtime.name, result);
+}
+
+static void runFieldFlag(const FakeRuntime& runtime) {
+	void* clazz = fake_alloc32(runtime.classSize);
+	void* field = fake_alloc32(runtime.fieldSize);
+	runtime.initField(field, clazz, 0x0002 | 0x0010); // private final
+	setFieldFlag_fnPtr(fake_env(), andfixClass, fake_reflected(field));
+	CHECK(runtime.fieldFlags(field) == (0x0001 | 0x0010), "%s setFieldFlag: flags 0x%x",
+			runtime.name, runtime.fieldFlags(field));
+}
+
+/**
+ * 与 AndFix.initFields 一样传入类的 getDeclaredFields()
+ */
+static void runFieldsPublic(const FakeRuntime& runtime) {
+	const size_t fieldCount = 8;
+	void* clazz = fake_alloc32(runtime.classSize);
+	void* fields[fieldCount];
+	std::vector<jobject> refs;
+	for (void*& field : fields) {
+		field = fake_alloc32(runtime.fieldSize);
+		runtime.initField(field, clazz, 0x0002 | 0x0010); // private final
+		refs.push_back(fake_reflected(field));
+	}
+	jint count = setFieldsPublic_fnPtr(fake_env(), andfixClass, fake_objectArray(refs));
+	CHECK(count == (jint) fieldCount, "%s setFieldsPublic: %d fields",
+			runtime.name, (int) count);
+	for (void* field : fields) {
+		CHECK(runtime.fieldFlags(field) == (0x0001 | 0x0010),
+				"%s setFieldsPublic: flags 0x%x", runtime.name, runtime.fieldFlags(field));
+	}
+}
+
+static void run(const FakeRuntime& runtime, size_t count) {
+	JNIEnv* env = fake_env();
+	if (runtime.isArt) {
+		fake_defineProbeClass(runtime);
+	}
+	jboolean ok = setup_fnPtr(env, andfixClass, runtime.isArt, runtime.apilevel,
+			fake_string("host/andfix/runner:user/test-keys"), nullptr);
+	// host 上没有 libdvm.so，dalvik_setup 必然失败，但替换本身不依赖它
+	CHECK(ok || !runtime.isArt, "%s setup failed", runtime.name);
+	if (runtime.isArt && runtime.apilevel > 22) {
+		CHECK(artMethodLayout.probed == 1 && artMethodLayout.size == runtime.methodSize,
+				"%s layout probe: probed=%d size=%d", runtime.name,
+				artMethodLayout.probed, artMethodLayout.size);
+	}
+
+	Workload single;
+	newWorkload(runtime, count, &single);
+	double singleNs = runSingle(single);
+
+	Workload batch;
+	newWorkload(runtime, count, &batch);
+	double batchNs = runBatch(batch);
+
+	Workload bySignature;
+	newWorkload(runtime, count, &bySignature);
+	runBySignature(bySignature);
+
+	Workload cApi;
+	newWorkload(runtime, count, &cApi);
+	runCApi(cApi);
+
+	Workload queue;
+	newWorkload(runtime, count, &queue);
+	runQueue(queue);
+
+	runFieldFlag(runtime);
+	runFieldsPublic(runtime);
+	if (runtime.isArt) {
+		runSwapStress(runtime);
+		runBridgeCall(runtime);
+	}
+
+	printf("%-8s method=%3zu bytes  replaceMethod %8.1f ns/method  replaceMethods %8.1f ns/method\n",
+			runtime.name, runtime.methodSize, singleNs, batchNs);
+
+	fake_collect();
+	fake_resetHeap();
+}
+
+static std::string toHex(const uint8_t* bytes, size_t size) {
+	static const char digits[] = "0123456789abcdef";
+	std::string hex;
+	for (size_t i = 0; i < size; ++i) {
+		hex.push_back(digits[bytes[i] >> 4]);
+		hex.push_back(digits[bytes[i] & 0xf]);
+	}
+	return hex;
+}
+
+static void checkSha256(const char* name, const std::string& data, const char* expected) {
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	sha256(data.data(), data.size(), digest);
+	std::string hex = toHex(digest, sizeof(digest));
+	CHECK(hex == expected, "sha256(%s) [%s] = %s", name, sha256_implementation(), hex.c_str());
+}
+
+/**
+ * SHA-256 / HMAC 的标准测试向量(两种实现各跑一遍)，CPU 扩展实现与可移植实现逐长度对比，
+ * 以及 fingerprint 与直接调用 file_hash 的结果一致
+ */
+static void runHash() {
+	for (int portable = 1; portable >= 0; --portable) {
+		sha256_forcePortable(portable != 0);
+		checkSha256("empty", "", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+		checkSha256("abc", "abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+		checkSha256("448 bits", "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+				"248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+		checkSha256("1M a", std::string(1000000, 'a'),
+				"cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+		uint8_t mac[SHA256_DIGEST_SIZE];
+		const char* data = "what do ya want for nothing?";
+		hmac_sha256("Jefe", 4, data, strlen(data), mac);
+		CHECK(toHex(mac, sizeof(mac))
+				== "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843",
+				"hmac_sha256 [%s]", sha256_implementation());
+	}
+	sha256_forcePortable(false);
+
+	std::vector<uint8_t> data(HASH_FILE_SIZE);
+	uint32_t x = 2463534242u;
+	for (size_t i = 0; i < data.size(); ++i) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		data[i] = (uint8_t) x;
+	}
+	if (strcmp(sha256_implementation(), "portable") != 0) {
+		// 覆盖不足一块、恰好一块、跨块缓冲的各种长度
+		for (size_t size = 0; size <= 300; ++size) {
+			uint8_t accelerated[SHA256_DIGEST_SIZE], portable[SHA256_DIGEST_SIZE];
+			sha256(data.data(), size, accelerated);
+			sha256_forcePortable(true);
+			sha256(data.data(), size, portable);
+			sha256_forcePortable(false);
+			CHECK(memcmp(accelerated, portable, sizeof(portable)) == 0,
+					"sha256 %s differs from portable at %zu bytes", sha256_implementation(), size);
+		}
+	}
+
+	const char key[] = "andfix";
+	uint8_t single[SHA256_DIGEST_SIZE], parallel[SHA256_DIGEST_SIZE];
+	buffer_hash(data.data(), data.size(), key, strlen(key), 1, single);
+	buffer_hash(data.data(), data.size(), key, strlen(key), 4, parallel);
+	CHECK(memcmp(single, parallel, sizeof(single)) == 0, "buffer_hash depends on threads");
+
+	char path[] = "/tmp/andfix_hashXXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd >= 0, "mkstemp failed");
+	if (fd < 0) {
+		return;
+	}
+	bool written = write(fd, data.data(), data.size()) == (ssize_t) data.size();
+	close(fd);
+	CHECK(written, "write %s failed", path);
+
+	std::vector<jbyte> keyBytes(key, key + strlen(key));
+	jbyteArray result = fingerprint_fnPtr(fake_env(), andfixClass, fake_string(path),
+			fake_byteArray(keyBytes));
+	CHECK(result != nullptr, "fingerprint(%s) returned null", path);
+	if (result != nullptr) {
+		const std::vector<jbyte>& values = static_cast<FakeByteArray*>(result)->values;
+		CHECK(values.size() == SHA256_DIGEST_SIZE
+				&& memcmp(values.data(), single, sizeof(single)) == 0,
+				"fingerprint differs from buffer_hash");
+	}
+	unlink(path);
+	result = fingerprint_fnPtr(fake_env(), andfixClass, fake_string(path),
+			fake_byteArray(keyBytes));
+	CHECK(result == nullptr, "fingerprint of a missing file");
+	fake_collect();
+	printf("hash: %s, %zu bytes fingerprinted\n", sha256_implementation(), data.size());
+}
+
+/**
+ * 用 ZipReader 读出整个条目，损坏时返回 false
+ */
+static bool readEntry(const ZipArchive* archive, const ZipEntry* entry, std::vector<uint8_t>* out) {
+	ZipReader* reader = zip_openReader(archive, entry);
+	if (reader == nullptr) {
+		return false;
+	}
+	out->clear();
+	uint8_t buffer[97]; // 不是块大小的整数倍，覆盖跨越调用的 inflate 状态
+	ssize_t n;
+	while ((n = zip_read(reader, buffer, sizeof(buffer))) > 0) {
+		out->insert(out->end(), buffer, buffer + n);
+	}
+	zip_closeReader(reader);
+	return n == 0;
+}
+
+/**
+ * 生成 count 个条目的 ZIP，检查排序、查找、stored 视图与流式解压的内容
+ */
+static void checkZip(size_t count, bool zip64, const std::string& comment) {
+	std::vector<FakeZipEntry> entries = fake_zipEntries(count, (uint32_t) count * 2654435761u);
+	char path[] = "/tmp/andfix_zipXXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd >= 0, "mkstemp failed");
+	if (fd < 0) {
+		return;
+	}
+	close(fd);
+	CHECK(fake_writeFile(path, fake_zipBytes(entries, zip64, comment)), "write %s failed", path);
+
+	double start = nowNs();
+	ZipArchive* archive = zip_open(path);
+	double openNs = nowNs() - start;
+	CHECK(archive != nullptr, "zip_open(%zu entries, zip64 %d) failed", count, zip64);
+	if (archive == nullptr) {
+		unlink(path);
+		return;
+	}
+	CHECK(zip_entryCount(archive) == count, "zip %zu entries, indexed %zu", count,
+			zip_entryCount(archive));
+	for (size_t i = 1; i < zip_entryCount(archive); ++i) {
+		const ZipEntry* a = zip_entryAt(archive, i - 1);
+		const ZipEntry* b = zip_entryAt(archive, i);
+		if (std::string(a->name, a->nameLength) >= std::string(b->name, b->nameLength)) {
+			CHECK(false, "zip entries not sorted at %zu", i);
+			break;
+		}
+	}
+
+	std::vector<uint8_t> content;
+	size_t bad = 0;
+	start = nowNs();
+	for (const FakeZipEntry& expect : entries) {
+		const ZipEntry* entry = zip_find(archive, expect.name.data(), expect.name.size());
+		if (entry == nullptr || entry->uncompressedSize != expect.data.size()) {
+			++bad;
+			continue;
+		}
+		const uint8_t* view = zip_storedData(archive, entry);
+		if (expect.deflated ? view != nullptr
+				: (view == nullptr || memcmp(view, expect.data.data(), expect.data.size()) != 0)) {
+			++bad;
+			continue;
+		}
+		if (!readEntry(archive, entry, &content) || content != expect.data) {
+			++bad;
+		}
+	}
+	double readNs = nowNs() - start;
+	CHECK(bad == 0, "zip %zu entries: %zu read wrong", count, bad);
+	CHECK(zip_find(archive, "dir000/missing", 14) == nullptr, "zip found a missing entry");
+	zip_close(archive);
+	unlink(path);
+	printf("zip: %6zu entries%s  open %8.1f us  find+read %6.1f us/entry\n", count,
+			zip64 ? " zip64" : "      ", openNs / 1000, readNs / 1000 / count);
+}
+
+/**
+ * 截断或有同名条目的文件打不开，数据被改动的条目读到最后报错
+ */
+static void checkZipCorrupt() {
+	std::vector<FakeZipEntry> entries(1);
+	entries[0].name = "a";
+	entries[0].data.assign(1000, 'x');
+	entries[0].deflated = true;
+	std::vector<uint8_t> bytes = fake_zipBytes(entries, false, "");
+
+	char path[] = "/tmp/andfix_zipXXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd >= 0, "mkstemp failed");
+	if (fd < 0) {
+		return;
+	}
+	close(fd);
+	std::vector<uint8_t> truncated(bytes.begin(), bytes.end() - 10);
+	fake_writeFile(path, truncated);
+	ZipArchive* archive = zip_open(path);
+	CHECK(archive == nullptr, "zip_open accepted a truncated file");
+	zip_close(archive);
+
+	std::vector<FakeZipEntry> duplicated(3);
+	duplicated[0].name = "classes.dex";
+	duplicated[0].data.assign(10, 'a');
+	duplicated[1].name = "META-INF/PATCH.MF";
+	duplicated[2].name = "classes.dex";
+	duplicated[2].data.assign(10, 'b');
+	fake_writeFile(path, fake_zipBytes(duplicated, false, ""));
+	archive = zip_open(path);
+	CHECK(archive == nullptr, "zip_open accepted duplicate entry names");
+	zip_close(archive);
+
+	// 数据紧跟在 30 字节的 local header 与 1 字节的名字之后，改最后一个字节(deflate 流的尾部)
+	std::vector<uint8_t> changed(bytes);
+	uint32_t compressedSize = changed[18] | (changed[19] << 8);
+	changed[31 + compressedSize - 1] ^= 0x55;
+	fake_writeFile(path, changed);
+	archive = zip_open(path);
+	CHECK(archive != nullptr, "zip_open rejected a valid directory");
+	if (archive != nullptr) {
+		std::vector<uint8_t> content;
+		CHECK(!readEntry(archive, zip_entryAt(archive, 0), &content),
+				"corrupt entry read without error");
+		zip_close(archive);
+	}
+	unlink(path);
+}
+
+/**
+ * 像 Java 的 ZipArchive 一样经 JNI 打开、查找、映射与读取
+ */
+static void checkZipJni() {
+	std::vector<FakeZipEntry> entries = fake_zipEntries(100, 7);
+	char path[] = "/tmp/andfix_zipXXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd >= 0, "mkstemp failed");
+	if (fd < 0) {
+		return;
+	}
+	close(fd);
+	fake_writeFile(path, fake_zipBytes(entries, false, ""));
+
+	JNIEnv* env = fake_env();
+	jlong handle = zipOpen_fnPtr(env, nullptr, fake_string(path));
+	CHECK(handle != 0, "nativeOpen(%s) failed", path);
+	if (handle == 0) {
+		unlink(path);
+		return;
+	}
+	for (const FakeZipEntry& expect : entries) {
+		jint index = zipFind_fnPtr(env, nullptr, handle, fake_string(expect.name.c_str()));
+		CHECK(index >= 0, "nativeFind(%s) failed", expect.name.c_str());
+		if (index < 0) {
+			continue;
+		}
+		jobject view = zipMap_fnPtr(env, nullptr, handle, index);
+		if (expect.deflated) {
+			CHECK(view == nullptr, "nativeMap of deflated %s", expect.name.c_str());
+		} else {
+			FakeDirectBuffer* buffer = static_cast<FakeDirectBuffer*>(view);
+			CHECK(buffer != nullptr && buffer->capacity == (jlong) expect.data.size()
+					&& memcmp(buffer->address, expect.data.data(), expect.data.size()) == 0,
+					"nativeMap(%s) wrong", expect.name.c_str());
+		}
+		jlong reader = zipOpenReader_fnPtr(env, nullptr, handle, index);
+		CHECK(reader != 0, "nativeOpenReader(%s) failed", expect.name.c_str());
+		if (reader == 0) {
+			continue;
+		}
+		FakeByteArray* buffer = fake_byteArray(std::vector<jbyte>(64));
+		// 越界的读取返回 -2，且不取走数据
+		CHECK(zipRead_fnPtr(env, nullptr, reader, buffer, 8, 57) == -2
+				&& zipRead_fnPtr(env, nullptr, reader, buffer, -1, 4) == -2
+				&& zipRead_fnPtr(env, nullptr, reader, buffer, 0, -1) == -2
+				&& zipRead_fnPtr(env, nullptr, reader, nullptr, 0, 4) == -2
+				&& zipRead_fnPtr(env, nullptr, reader, buffer, 64, 0) == 0,
+				"nativeRead(%s) accepted a bad range", expect.name.c_str());
+		std::vector<uint8_t> content;
+		jint n;
+		while ((n = zipRead_fnPtr(env, nullptr, reader, buffer, 8, 56)) > 0) {
+			content.insert(content.end(), buffer->values.begin() + 8, buffer->values.begin() + 8 + n);
+		}
+		zipCloseReader_fnPtr(env, nullptr, reader);
+		CHECK(n == -1 && content == expect.data, "nativeRead(%s) wrong", expect.name.c_str());
+	}
+	CHECK(zipFind_fnPtr(env, nullptr, handle, fake_string("missing")) == -1,
+			"nativeFind found a missing entry");
+	zipClose_fnPtr(env, nullptr, handle);
+	CHECK(zipOpen_fnPtr(env, nullptr, fake_string("/nonexistent.apatch")) == 0,
+			"nativeOpen of a missing file");
+	fake_collect();
+	unlink(path);
+}
+
+static void runZip() {
+	checkZip(10, false, "");
+	checkZip(10, true, "patch comment");
+	checkZip(1000, false, "");
+	checkZip(65535, false, ""); // 条目数恰好填满 EOCD，没有 zip64 记录
+	checkZip(100000, false, ""); // 条目数只在 zip64 EOCD 中
+	checkZipCorrupt();
+	checkZipJni();
+}
+
+/**
+ * 所有布局跑完后，检查 getNativeStats 的计数与实际调用一致
+ */
+static void checkStats(size_t count) {
+	jlongArray array = getStats_fnPtr(fake_env(), andfixClass);
+	CHECK(array != nullptr, "getNativeStats returned null");
+	if (array == nullptr) {
+		return;
+	}
+	const std::vector<jlong>& stats = static_cast<FakeLongArray*>(array)->values;
+	CHECK(stats.size() == STAT_NATIVE_COUNT * STAT_FIELDS, "stats size %zu", stats.size());
+	if (stats.size() != STAT_NATIVE_COUNT * STAT_FIELDS) {
+		return;
+	}
+	size_t layouts = 0;
+	for (const FakeRuntime* const* runtime = fakeRuntimes; *runtime != nullptr; ++runtime) {
+		++layouts;
+	}
+	const jlong* setup = &stats[STAT_SETUP * STAT_FIELDS];
+	const jlong* single = &stats[STAT_REPLACE_METHOD * STAT_FIELDS];
+	const jlong* batch = &stats[STAT_REPLACE_METHODS * STAT_FIELDS];
+	CHECK(setup[STAT_FIELD_CALLS] == (jlong) layouts, "setup calls %lld",
+			(long long) setup[STAT_FIELD_CALLS]);
+	// runSingle、runBySignature 与 runCApi 的前一半，加一次找不到方法的调用；
+	// runBatch、runBySignature 与 runCApi 的后一半，以及 runQueue 经 applier 写入的全部
+	size_t half = count / 2;
+	CHECK(single[STAT_FIELD_CALLS] == (jlong) ((count + 2 * half + 1) * layouts),
+			"replaceMethod calls %lld", (long long) single[STAT_FIELD_CALLS]);
+	CHECK(batch[STAT_FIELD_ITEMS] == (jlong) ((2 * count + 2 * (count - half)) * layouts),
+			"replaceMethods items %lld", (long long) batch[STAT_FIELD_ITEMS]);
+	CHECK(single[STAT_FIELD_MAX_NS] > 0 && single[STAT_FIELD_MAX_NS] <= single[STAT_FIELD_TOTAL_NS],
+			"replaceMethod max %lld total %lld", (long long) single[STAT_FIELD_MAX_NS],
+			(long long) single[STAT_FIELD_TOTAL_NS]);
+	// host 上没有 libart.so，批量替换不挂起，照常写入
+	const jlong* suspend = &stats[STAT_SUSPEND * STAT_FIELDS];
+	CHECK(suspend[STAT_FIELD_CALLS] == 0, "suspend calls %lld",
+			(long long) suspend[STAT_FIELD_CALLS]);
+	CHECK(trace_count() >= 2 * count * layouts, "trace events %llu",
+			(unsigned long long) trace_count());
+	std::string trace = trace_dump();
+	// 最后的事件是 runQueue 的批量恢复
+	CHECK(trace.find(" restoreAll ") != std::string::npos, "trace has no restoreAll event");
+	printf("stats: replaceMethod %.1f ns/call (includes the timer)\n",
+			(double) single[STAT_FIELD_TOTAL_NS] / single[STAT_FIELD_CALLS]);
+}
+
+/**
+ * 7.0 之后的版本没有默认布局，探测成功时 setup 才成功
+ */
+static void checkNewerApi() {
+	fake_defineProbeClass(fakeArt_7_0);
+	jboolean ok = setup_fnPtr(fake_env(), andfixClass, JNI_TRUE, 25,
+			fake_string("host/andfix/runner:user/test-keys"), nullptr);
+	CHECK(ok && artMethodLayout.probed == 1 && artMethodLayout.size == fakeArt_7_0.methodSize,
+			"apilevel 25 setup: ok=%d probed=%d", (int) ok, artMethodLayout.probed);
+}
+
+int main(int argc, char** argv) {
+	size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : DEFAULT_COUNT;
+	if (count == 0) {
+		fprintf(stderr, "usage: %s [count]\n", argv[0]);
+		return 2;
+	}
+	if (!bindNatives()) {
+		fprintf(stderr, "JNI_OnLoad failed\n");
+		return 1;
+	}
+	for (const FakeRuntime* const* runtime = fakeRuntimes; *runtime != nullptr; ++runtime) {
+		run(**runtime, count);
+	}
+	checkStats(count);
+	checkNewerApi();
+	runHash();
+	runZip();
+	if (failures != 0) {
+		fprintf(stderr, "%d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("all layouts passed, %zu methods each\n", count);
+	return 0;
+}
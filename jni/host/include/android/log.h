@@ -0,0 +1,61 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * android/log.h (host)
+ *
+ * host 构建中的 logcat 替身：ANDFIX_HOST_LOG 环境变量非空时打印到 stderr，否则丢弃，
+ * 以免日志本身干扰 benchmark.
+ */
+
+#ifndef HOST_ANDROID_LOG_H_
+#define HOST_ANDROID_LOG_H_
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef enum android_LogPriority {
+	ANDROID_LOG_UNKNOWN = 0,
+	ANDROID_LOG_DEFAULT,
+	ANDROID_LOG_VERBOSE,
+	ANDROID_LOG_DEBUG,
+	ANDROID_LOG_INFO,
+	ANDROID_LOG_WARN,
+	ANDROID_LOG_ERROR,
+	ANDROID_LOG_FATAL,
+	ANDROID_LOG_SILENT,
+} android_LogPriority;
+
+static inline int __android_log_print(int prio, const char* tag, const char* fmt, ...)
+		__attribute__ ((format (printf, 3, 4)));
+
+static inline int __android_log_print(int prio, const char* tag, const char* fmt, ...) {
+	static const char* enabled = getenv("ANDFIX_HOST_LOG");
+	if (enabled == NULL || *enabled == '\0') {
+		return 0;
+	}
+	va_list args;
+	va_start(args, fmt);
+	fprintf(stderr, "%d %s: ", prio, tag);
+	int len = vfprintf(stderr, fmt, args);
+	fputc('\n', stderr);
+	va_end(args);
+	return len;
+}
+
+#endif /* HOST_ANDROID_LOG_H_ */
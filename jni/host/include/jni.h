@@ -0,0 +1,280 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * jni.h (host)
+ *
+ * 只在 host 构建中使用的 jni.h 替身：类型与调用方式和 NDK 的 jni.h 一致，但只包含
+ * libandfix 用到的那部分函数. 函数表由 host/fake_jni_env.cpp 提供.
+ */
+
+#ifndef HOST_JNI_H_
+#define HOST_JNI_H_
+
+#include <stdarg.h>
+#include <stdint.h>
+
+typedef uint8_t  jboolean;
+typedef int8_t   jbyte;
+typedef uint16_t jchar;
+typedef int16_t  jshort;
+typedef int32_t  jint;
+typedef int64_t  jlong;
+typedef float    jfloat;
+typedef double   jdouble;
+typedef jint     jsize;
+
+class _jobject {};
+class _jclass : public _jobject {};
+class _jstring : public _jobject {};
+class _jthrowable : public _jobject {};
+class _jarray : public _jobject {};
+class _jobjectArray : public _jarray {};
+class _jbooleanArray : public _jarray {};
+class _jbyteArray : public _jarray {};
+class _jintArray : public _jarray {};
+class _jlongArray : public _jarray {};
+
+typedef _jobject*       jobject;
+typedef _jclass*        jclass;
+typedef _jstring*       jstring;
+typedef _jthrowable*    jthrowable;
+typedef _jarray*        jarray;
+typedef _jobjectArray*  jobjectArray;
+typedef _jbooleanArray* jbooleanArray;
+typedef _jbyteArray*    jbyteArray;
+typedef _jintArray*     jintArray;
+typedef _jlongArray*    jlongArray;
+
+struct _jfieldID;
+typedef struct _jfieldID* jfieldID;
+struct _jmethodID;
+typedef struct _jmethodID* jmethodID;
+
+typedef struct {
+	const char* name;
+	const char* signature;
+	void* fnPtr;
+} JNINativeMethod;
+
+struct _JNIEnv;
+struct _JavaVM;
+typedef _JNIEnv JNIEnv;
+typedef _JavaVM JavaVM;
+
+#define JNI_FALSE 0
+#define JNI_TRUE  1
+
+#define JNI_VERSION_1_4 0x00010004
+#define JNI_VERSION_1_6 0x00010006
+
+#define JNI_OK        (0)
+#define JNI_ERR       (-1)
+#define JNI_EDETACHED (-2)
+
+#define JNI_COMMIT 1
+#define JNI_ABORT  2
+
+#define JNIEXPORT __attribute__ ((visibility ("default")))
+#define JNICALL
+
+struct JNINativeInterface {
+	jclass (*FindClass)(JNIEnv*, const char*);
+	jmethodID (*FromReflectedMethod)(JNIEnv*, jobject);
+	jfieldID (*FromReflectedField)(JNIEnv*, jobject);
+	jboolean (*ExceptionCheck)(JNIEnv*);
+	void (*ExceptionClear)(JNIEnv*);
+	jint (*PushLocalFrame)(JNIEnv*, jint);
+	jobject (*PopLocalFrame)(JNIEnv*, jobject);
+	jobject (*NewGlobalRef)(JNIEnv*, jobject);
+	void (*DeleteGlobalRef)(JNIEnv*, jobject);
+	void (*DeleteLocalRef)(JNIEnv*, jobject);
+	jmethodID (*GetMethodID)(JNIEnv*, jclass, const char*, const char*);
+	jobject (*CallObjectMethodV)(JNIEnv*, jobject, jmethodID, va_list);
+	jmethodID (*GetStaticMethodID)(JNIEnv*, jclass, const char*, const char*);
+	jstring (*NewStringUTF)(JNIEnv*, const char*);
+	const char* (*GetStringUTFChars)(JNIEnv*, jstring, jboolean*);
+	void (*ReleaseStringUTFChars)(JNIEnv*, jstring, const char*);
+	jsize (*GetArrayLength)(JNIEnv*, jarray);
+	jobject (*GetObjectArrayElement)(JNIEnv*, jobjectArray, jsize);
+	void (*GetBooleanArrayRegion)(JNIEnv*, jbooleanArray, jsize, jsize, jboolean*);
+	void (*GetByteArrayRegion)(JNIEnv*, jbyteArray, jsize, jsize, jbyte*);
+	jbyteArray (*NewByteArray)(JNIEnv*, jsize);
+	jintArray (*NewIntArray)(JNIEnv*, jsize);
+	jlongArray (*NewLongArray)(JNIEnv*, jsize);
+	void (*SetByteArrayRegion)(JNIEnv*, jbyteArray, jsize, jsize, const jbyte*);
+	void (*SetIntArrayRegion)(JNIEnv*, jintArray, jsize, jsize, const jint*);
+	void (*SetLongArrayRegion)(JNIEnv*, jlongArray, jsize, jsize, const jlong*);
+	jobject (*NewDirectByteBuffer)(JNIEnv*, void*, jlong);
+	jint (*RegisterNatives)(JNIEnv*, jclass, const JNINativeMethod*, jint);
+	jint (*GetJavaVM)(JNIEnv*, JavaVM**);
+};
+
+struct _JNIEnv {
+	const struct JNINativeInterface* functions;
+
+	jclass FindClass(const char* name) {
+		return functions->FindClass(this, name);
+	}
+
+	jmethodID FromReflectedMethod(jobject method) {
+		return functions->FromReflectedMethod(this, method);
+	}
+
+	jfieldID FromReflectedField(jobject field) {
+		return functions->FromReflectedField(this, field);
+	}
+
+	jboolean ExceptionCheck() {
+		return functions->ExceptionCheck(this);
+	}
+
+	void ExceptionClear() {
+		functions->ExceptionClear(this);
+	}
+
+	jint PushLocalFrame(jint capacity) {
+		return functions->PushLocalFrame(this, capacity);
+	}
+
+	jobject PopLocalFrame(jobject result) {
+		return functions->PopLocalFrame(this, result);
+	}
+
+	jobject NewGlobalRef(jobject obj) {
+		return functions->NewGlobalRef(this, obj);
+	}
+
+	void DeleteGlobalRef(jobject globalRef) {
+		functions->DeleteGlobalRef(this, globalRef);
+	}
+
+	void DeleteLocalRef(jobject localRef) {
+		functions->DeleteLocalRef(this, localRef);
+	}
+
+	jmethodID GetMethodID(jclass clazz, const char* name, const char* sig) {
+		return functions->GetMethodID(this, clazz, name, sig);
+	}
+
+	jobject CallObjectMethod(jobject obj, jmethodID methodID, ...) {
+		va_list args;
+		va_start(args, methodID);
+		jobject result = functions->CallObjectMethodV(this, obj, methodID, args);
+		va_end(args);
+		return result;
+	}
+
+	jmethodID GetStaticMethodID(jclass clazz, const char* name, const char* sig) {
+		return functions->GetStaticMethodID(this, clazz, name, sig);
+	}
+
+	jstring NewStringUTF(const char* bytes) {
+		return functions->NewStringUTF(this, bytes);
+	}
+
+	const char* GetStringUTFChars(jstring string, jboolean* isCopy) {
+		return functions->GetStringUTFChars(this, string, isCopy);
+	}
+
+	void ReleaseStringUTFChars(jstring string, const char* utf) {
+		functions->ReleaseStringUTFChars(this, string, utf);
+	}
+
+	jsize GetArrayLength(jarray array) {
+		return functions->GetArrayLength(this, array);
+	}
+
+	jobject GetObjectArrayElement(jobjectArray array, jsize index) {
+		return functions->GetObjectArrayElement(this, array, index);
+	}
+
+	void GetBooleanArrayRegion(jbooleanArray array, jsize start, jsize len, jboolean* buf) {
+		functions->GetBooleanArrayRegion(this, array, start, len, buf);
+	}
+
+	void GetByteArrayRegion(jbyteArray array, jsize start, jsize len, jbyte* buf) {
+		functions->GetByteArrayRegion(this, array, start, len, buf);
+	}
+
+	jbyteArray NewByteArray(jsize length) {
+		return functions->NewByteArray(this, length);
+	}
+
+	jintArray NewIntArray(jsize length) {
+		return functions->NewIntArray(this, length);
+	}
+
+	jlongArray NewLongArray(jsize length) {
+		return functions->NewLongArray(this, length);
+	}
+
+	void SetByteArrayRegion(jbyteArray array, jsize start, jsize len, const jbyte* buf) {
+		functions->SetByteArrayRegion(this, array, start, len, buf);
+	}
+
+	void SetIntArrayRegion(jintArray array, jsize start, jsize len, const jint* buf) {
+		functions->SetIntArrayRegion(this, array, start, len, buf);
+	}
+
+	void SetLongArrayRegion(jlongArray array, jsize start, jsize len, const jlong* buf) {
+		functions->SetLongArrayRegion(this, array, start, len, buf);
+	}
+
+	jobject NewDirectByteBuffer(void* address, jlong capacity) {
+		return functions->NewDirectByteBuffer(this, address, capacity);
+	}
+
+	jint RegisterNatives(jclass clazz, const JNINativeMethod* methods, jint nMethods) {
+		return functions->RegisterNatives(this, clazz, methods, nMethods);
+	}
+
+	jint GetJavaVM(JavaVM** vm) {
+		return functions->GetJavaVM(this, vm);
+	}
+};
+
+struct JavaVMAttachArgs {
+	jint version;
+	const char* name;
+	jobject group;
+};
+
+struct JNIInvokeInterface {
+	jint (*DestroyJavaVM)(JavaVM*);
+	jint (*AttachCurrentThread)(JavaVM*, JNIEnv**, void*);
+	jint (*DetachCurrentThread)(JavaVM*);
+	jint (*GetEnv)(JavaVM*, void**, jint);
+};
+
+struct _JavaVM {
+	const struct JNIInvokeInterface* functions;
+
+	jint AttachCurrentThread(JNIEnv** p_env, void* thr_args) {
+		return functions->AttachCurrentThread(this, p_env, thr_args);
+	}
+
+	jint DetachCurrentThread() {
+		return functions->DetachCurrentThread(this);
+	}
+
+	jint GetEnv(void** env, jint version) {
+		return functions->GetEnv(this, env, version);
+	}
+};
+
+#endif /* HOST_JNI_H_ */
@@ -0,0 +1,249 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+#include "snapshot.h"
+#include "common.h"
+
+/*
+ * 每个 arena 块可以放下的快照数
+ */
+#define SNAPSHOTS_PER_CHUNK 256
+
+/*
+ * 哈希表的最小容量，必须是 2 的幂
+ */
+#define TABLE_MIN_CAPACITY 64
+
+struct Snapshot {
+	void* method;
+	uint16_t offset;
+	uint16_t size;
+	uint8_t bytes[0];
+};
+
+struct Chunk {
+	Chunk* next;
+	size_t capacity;
+	size_t used;
+	uint8_t data[0];
+};
+
+static Chunk* chunks;
+/*
+ * restoreAll 可能在挂起窗口内，它换下的块留到下一次 snapshot_reserve 再释放
+ */
+static Chunk* retired;
+static SnapshotWriter writer;
+
+/*
+ * 方法地址到快照的开放寻址哈希表: 线性探测，删除时把后面的项往回移，容量是 2 的幂，
+ * 装载率不超过 1/2. 不用 unordered_map 是因为它每插入一项都要 malloc 一个节点.
+ */
+static Snapshot** table;
+static size_t tableCapacity;
+static size_t tableSize;
+
+static inline size_t alignUp(size_t size) {
+	return (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+}
+
+static void freeChunks(Chunk* chunk) {
+	while (chunk != nullptr) {
+		Chunk* next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+}
+
+static bool newChunk(size_t capacity) {
+	Chunk* chunk = (Chunk*) malloc(sizeof(Chunk) + capacity);
+	if (chunk == nullptr) {
+		return false;
+	}
+	chunk->next = chunks;
+	chunk->capacity = capacity;
+	chunk->used = 0;
+	chunks = chunk;
+	return true;
+}
+
+static void* arenaAlloc(size_t size) {
+	size = alignUp(size);
+	// 块大小按当前方法结构的大小来定，一块放 SNAPSHOTS_PER_CHUNK 个
+	if ((chunks == nullptr || chunks->capacity - chunks->used < size)
+			&& !newChunk(size * SNAPSHOTS_PER_CHUNK)) {
+		return nullptr;
+	}
+	void* ptr = chunks->data + chunks->used;
+	chunks->used += size;
+	return ptr;
+}
+
+static inline size_t hashOf(const void* method) {
+	uint64_t h = (uint64_t) (uintptr_t) method;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return (size_t) h;
+}
+
+/**
+ * @return method 所在的槽，没有时是它应插入的空槽
+ */
+static size_t findSlot(const void* method) {
+	size_t mask = tableCapacity - 1;
+	size_t i = hashOf(method) & mask;
+	while (table[i] != nullptr && table[i]->method != method) {
+		i = (i + 1) & mask;
+	}
+	return i;
+}
+
+/**
+ * 保证再插入到 count 项时不需要扩容
+ */
+static bool ensureCapacity(size_t count) {
+	if (count * 2 <= tableCapacity) {
+		return true;
+	}
+	size_t capacity = tableCapacity > 0 ? tableCapacity : TABLE_MIN_CAPACITY;
+	while (capacity < count * 2) {
+		capacity *= 2;
+	}
+	Snapshot** old = table;
+	size_t oldCapacity = tableCapacity;
+	Snapshot** grown = (Snapshot**) calloc(capacity, sizeof(Snapshot*));
+	if (grown == nullptr) {
+		return false;
+	}
+	table = grown;
+	tableCapacity = capacity;
+	for (size_t i = 0; i < oldCapacity; ++i) {
+		if (old[i] != nullptr) {
+			table[findSlot(old[i]->method)] = old[i];
+		}
+	}
+	free(old);
+	return true;
+}
+
+static void eraseSlot(size_t i) {
+	size_t mask = tableCapacity - 1;
+	for (size_t j = (i + 1) & mask; table[j] != nullptr; j = (j + 1) & mask) {
+		size_t home = hashOf(table[j]->method) & mask;
+		// home 不在 (i, j] 中时，table[j] 可以前移到 i
+		bool between = i < j ? (home > i && home <= j) : (home > i || home <= j);
+		if (!between) {
+			table[i] = table[j];
+			i = j;
+		}
+	}
+	table[i] = nullptr;
+	--tableSize;
+}
+
+bool snapshot_reserve(size_t count, size_t size) {
+	freeChunks(retired);
+	retired = nullptr;
+	if (!ensureCapacity(tableSize + count)) {
+		return false;
+	}
+	size_t need = count * alignUp(sizeof(Snapshot) + size);
+	if (chunks != nullptr && chunks->capacity - chunks->used >= need) {
+		return true;
+	}
+	size_t capacity = alignUp(sizeof(Snapshot) + size) * SNAPSHOTS_PER_CHUNK;
+	return newChunk(need > capacity ? need : capacity);
+}
+
+void snapshot_save(void* method, size_t offset, size_t size) {
+	if (!ensureCapacity(tableSize + 1)) {
+		LOGE("snapshot_save: out of memory, %p can not be restored", method);
+		return;
+	}
+	size_t slot = findSlot(method);
+	if (table[slot] != nullptr) {
+		return; // 只保留最初的实现
+	}
+	Snapshot* snapshot = (Snapshot*) arenaAlloc(sizeof(Snapshot) + size);
+	if (snapshot == nullptr) {
+		LOGE("snapshot_save: out of memory, %p can not be restored", method);
+		return;
+	}
+	snapshot->method = method;
+	snapshot->offset = (uint16_t) offset;
+	snapshot->size = (uint16_t) size;
+	memcpy(snapshot->bytes, (const uint8_t*) method + offset, size);
+	table[slot] = snapshot;
+	++tableSize;
+}
+
+void snapshot_setWriter(SnapshotWriter w) {
+	writer = w;
+}
+
+static void restore(const Snapshot* snapshot) {
+	if (writer != nullptr) {
+		writer(snapshot->method, snapshot->bytes, snapshot->offset, snapshot->size);
+		return;
+	}
+	memcpy((uint8_t*) snapshot->method + snapshot->offset, snapshot->bytes, snapshot->size);
+}
+
+bool snapshot_restore(void* method) {
+	if (tableSize == 0) {
+		return false;
+	}
+	size_t slot = findSlot(method);
+	if (table[slot] == nullptr) {
+		return false;
+	}
+	restore(table[slot]);
+	// arena 中的空间在 restoreAll 时统一回收
+	eraseSlot(slot);
+	return true;
+}
+
+size_t snapshot_restoreAll() {
+	size_t count = tableSize;
+	for (size_t i = 0; i < tableCapacity && tableSize > 0; ++i) {
+		if (table[i] != nullptr) {
+			restore(table[i]);
+			table[i] = nullptr;
+			--tableSize;
+		}
+	}
+	// 不在这里 free，见 retired
+	Chunk* last = chunks;
+	while (last != nullptr && last->next != nullptr) {
+		last = last->next;
+	}
+	if (last != nullptr) {
+		last->next = retired;
+		retired = chunks;
+		chunks = nullptr;
+	}
+	return count;
+}
+
+size_t snapshot_count() {
+	return tableSize;
+}
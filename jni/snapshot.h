@@ -0,0 +1,87 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * snapshot.h
+ *
+ * 被替换方法的原始字节快照，用于撤销替换(AndFix.restoreMethod / restoreAll).
+ *
+ * 每个方法第一次被替换前保存一份原始字节，重复替换不会覆盖，所以恢复的总是最初的实现.
+ * 快照放在按块分配的 bump-pointer arena 里，块大小由方法结构的大小决定；索引是方法地址
+ * 到快照的开放寻址哈希表，恢复是 O(1) 的 memcpy，不经过 Java 反射.
+ *
+ * 不加锁：调用方持有 andfix.cpp 的 replaceLock，批量写入都由 apply_queue 的 applier 线程
+ * 或持锁的 JNI 调用线程完成，快照与方法写入因此是串行的.
+ *
+ * 限制: 快照是原始字节，art 上包含 GC 堆引用 declaring_class_，5.x/6.0 上还有
+ * dex_cache_resolved_methods_ / dex_cache_resolved_types_. 快照不是 GC root，
+ * 5.0 - 7.0 上移动式 GC(后台压缩、分代/并发复制)移动这些对象后，快照里的地址就失效了，
+ * 恢复会把悬空指针写回仍在使用的方法. 原始类在替换后已不能从方法本身读回(declaring_class_
+ * 指向补丁类)，所以这里不做修正：只在 Dalvik 或确认没有发生移动的场景下依赖撤销，
+ * 撤销后应尽快重启进程.
+ */
+
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <stddef.h>
+
+/**
+ * 恢复时写回原始字节的方式，bytes 对应 method 中的 [offset, offset + size)
+ */
+typedef void (*SnapshotWriter)(void* method, const void* bytes, size_t offset, size_t size);
+
+/**
+ * @param writer null 表示直接 memcpy；art 上为 art_writeMethod，与替换使用同样的写入顺序
+ */
+void snapshot_setWriter(SnapshotWriter writer);
+
+/**
+ * 预留 count 个 size 字节的快照的空间. 之后 count 次 snapshot_save 只做查找与 memcpy，
+ * 不再分配内存，批量替换在挂起所有线程之前调用(被挂起的线程可能正持有 malloc 的锁).
+ * 也在这里释放 snapshot_restoreAll 换下的内存.
+ *
+ * @return false 表示内存不足，snapshot_save 仍可用，只是可能在挂起窗口内分配
+ */
+bool snapshot_reserve(size_t count, size_t size);
+
+/**
+ * 保存 method 中 [offset, offset + size) 的原始字节，已保存过则什么也不做
+ */
+void snapshot_save(void* method, size_t offset, size_t size);
+
+/**
+ * 把 method 恢复为保存的原始字节
+ *
+ * @return false 表示没有该方法的快照
+ */
+bool snapshot_restore(void* method);
+
+/**
+ * 恢复所有方法并丢弃全部快照. 不调用 free，可以在挂起窗口内调用，
+ * 快照占用的内存在下一次 snapshot_reserve 时释放
+ *
+ * @return 恢复的方法数
+ */
+size_t snapshot_restoreAll();
+
+/**
+ * @return 当前保存的快照数
+ */
+size_t snapshot_count();
+
+#endif /* SNAPSHOT_H_ */
@@ -0,0 +1,56 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+
+#include "stats.h"
+
+struct alignas(64) Stat {
+	std::atomic<uint64_t> calls;
+	std::atomic<uint64_t> items;
+	std::atomic<uint64_t> totalNs;
+	std::atomic<uint64_t> maxNs;
+};
+
+static Stat stats[STAT_NATIVE_COUNT];
+
+void stats_record(int stat, uint64_t items, uint64_t ns) {
+	if (stat < 0 || stat >= STAT_NATIVE_COUNT) {
+		return;
+	}
+	Stat& s = stats[stat];
+	s.calls.fetch_add(1, std::memory_order_relaxed);
+	s.items.fetch_add(items, std::memory_order_relaxed);
+	s.totalNs.fetch_add(ns, std::memory_order_relaxed);
+	uint64_t max = s.maxNs.load(std::memory_order_relaxed);
+	while (ns > max && !s.maxNs.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+	}
+}
+
+size_t stats_snapshot(int64_t* out, size_t capacity) {
+	if (capacity < STAT_NATIVE_COUNT * STAT_FIELDS) {
+		return 0;
+	}
+	for (int i = 0; i < STAT_NATIVE_COUNT; ++i) {
+		int64_t* fields = out + i * STAT_FIELDS;
+		fields[STAT_FIELD_CALLS] = (int64_t) stats[i].calls.load(std::memory_order_relaxed);
+		fields[STAT_FIELD_ITEMS] = (int64_t) stats[i].items.load(std::memory_order_relaxed);
+		fields[STAT_FIELD_TOTAL_NS] = (int64_t) stats[i].totalNs.load(std::memory_order_relaxed);
+		fields[STAT_FIELD_MAX_NS] = (int64_t) stats[i].maxNs.load(std::memory_order_relaxed);
+	}
+	return STAT_NATIVE_COUNT * STAT_FIELDS;
+}
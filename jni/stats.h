@@ -0,0 +1,104 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * stats.h
+ *
+ * 常开的进程内计数器与纳秒计时，由 AndFix.getStats() 一次取回.
+ *
+ * 每项统计是 4 个 64 位原子量: 调用次数、处理条目数(方法数/字段数)、总耗时、最大耗时，
+ * 都用 relaxed 原子操作更新，不加锁也不打日志，一次记录约为两次 clock_gettime(vDSO)
+ * 加几次原子加法. 各项按 cache line 对齐，互不干扰.
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * native 统计项，下标必须与 AndFix.STAT_* 一致；Java 层的统计项排在 STAT_NATIVE_COUNT 之后
+ */
+enum {
+	STAT_SETUP = 0,
+	STAT_REPLACE_METHOD = 1,    // AndFix.replaceMethod
+	STAT_REPLACE_METHODS = 2,   // AndFix.replaceMethods，条目数为替换的方法数
+	STAT_SET_FIELD_FLAG = 3,
+	STAT_SET_CLASS_FIELDS = 4,  // AndFix.setFieldsPublic，条目数为字段数
+	STAT_RESTORE = 5,           // restore / restoreMethods，条目数为恢复的方法数
+	STAT_SUSPEND = 6,           // 批量替换时挂起所有线程的时长(含挂起与恢复)，条目数为期间写入的方法数
+	STAT_NATIVE_COUNT
+};
+
+/*
+ * getStats 返回的每项统计占的 long 个数及各自的位置
+ */
+enum {
+	STAT_FIELD_CALLS = 0,
+	STAT_FIELD_ITEMS = 1,
+	STAT_FIELD_TOTAL_NS = 2,
+	STAT_FIELD_MAX_NS = 3,
+	STAT_FIELDS
+};
+
+static inline uint64_t stats_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * 记录一次调用
+ *
+ * @param stat  STAT_*
+ * @param items 本次处理的条目数
+ * @param ns    本次耗时
+ */
+void stats_record(int stat, uint64_t items, uint64_t ns);
+
+/**
+ * 按 [stat][STAT_FIELDS] 的顺序把所有 native 统计项写入 out
+ *
+ * @return 写入的个数，即 STAT_NATIVE_COUNT * STAT_FIELDS
+ */
+size_t stats_snapshot(int64_t* out, size_t capacity);
+
+/**
+ * 作用域计时: 析构时记录一次调用，条目数默认为 1
+ */
+class StatScope {
+public:
+	explicit StatScope(int stat) : stat_(stat), items_(1), start_(stats_now()) {
+	}
+
+	~StatScope() {
+		stats_record(stat_, items_, stats_now() - start_);
+	}
+
+	void setItems(uint64_t items) {
+		items_ = items;
+	}
+
+private:
+	int stat_;
+	uint64_t items_;
+	uint64_t start_;
+};
+
+#endif /* STATS_H_ */
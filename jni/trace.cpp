@@ -0,0 +1,121 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+
+#include "stats.h"
+#include "trace.h"
+
+struct TraceEvent {
+	std::atomic<uint64_t> seq; // 写入序号 + 1，0 表示正在写或从未写入
+	uint64_t timeNs;
+	uint32_t type;
+	uint32_t arg;
+	const void* a;
+	const void* b;
+};
+
+static TraceEvent events[TRACE_CAPACITY];
+static std::atomic<uint64_t> head(0);
+
+void trace_record(TraceType type, uint32_t arg, const void* a, const void* b) {
+	uint64_t index = head.fetch_add(1, std::memory_order_relaxed);
+	TraceEvent& event = events[index & (TRACE_CAPACITY - 1)];
+	event.seq.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	event.timeNs = stats_now();
+	event.type = type;
+	event.arg = arg;
+	event.a = a;
+	event.b = b;
+	event.seq.store(index + 1, std::memory_order_release);
+}
+
+uint64_t trace_count() {
+	return head.load(std::memory_order_relaxed);
+}
+
+static void decode(const TraceEvent& event, uint64_t baseNs, std::string* out) {
+	char line[160];
+	double ms = (event.timeNs - baseNs) / 1e6;
+	switch (event.type) {
+	case TRACE_SETUP:
+		snprintf(line, sizeof(line), "%10.3f setup %s apilevel=%" PRIu32 "\n", ms,
+				event.a != nullptr ? "art" : "dalvik", event.arg);
+		break;
+	case TRACE_REPLACE:
+		if (event.arg == 0) {
+			snprintf(line, sizeof(line), "%10.3f replace_dalvik %p <- %p\n", ms, event.a, event.b);
+			break;
+		}
+		snprintf(line, sizeof(line), "%10.3f replace_%" PRIu32 "_%" PRIu32 " %p <- %p\n", ms,
+				event.arg / 10, event.arg % 10, event.a, event.b);
+		break;
+	case TRACE_SET_FIELD_FLAG:
+		snprintf(line, sizeof(line), "%10.3f setFieldFlag %p flags=0x%" PRIx32 "\n", ms,
+				event.a, event.arg);
+		break;
+	case TRACE_RESTORE:
+		snprintf(line, sizeof(line), "%10.3f restore %p %s\n", ms, event.a,
+				event.arg ? "ok" : "no snapshot");
+		break;
+	case TRACE_RESTORE_ALL:
+		snprintf(line, sizeof(line), "%10.3f restoreAll count=%" PRIu32 "\n", ms, event.arg);
+		break;
+	default:
+		snprintf(line, sizeof(line), "%10.3f unknown type=%" PRIu32 "\n", ms, event.type);
+		break;
+	}
+	out->append(line);
+}
+
+std::string trace_dump() {
+	uint64_t end = head.load(std::memory_order_acquire);
+	uint64_t begin = end > TRACE_CAPACITY ? end - TRACE_CAPACITY : 0;
+	std::string out;
+	uint64_t baseNs = 0;
+	uint64_t skipped = 0;
+	for (uint64_t index = begin; index < end; ++index) {
+		const TraceEvent& slot = events[index & (TRACE_CAPACITY - 1)];
+		if (slot.seq.load(std::memory_order_acquire) != index + 1) {
+			++skipped; // 正在写入，或已被更新的事件覆盖
+			continue;
+		}
+		TraceEvent copy;
+		copy.timeNs = slot.timeNs;
+		copy.type = slot.type;
+		copy.arg = slot.arg;
+		copy.a = slot.a;
+		copy.b = slot.b;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.seq.load(std::memory_order_relaxed) != index + 1) {
+			++skipped;
+			continue;
+		}
+		if (baseNs == 0) {
+			baseNs = copy.timeNs;
+		}
+		decode(copy, baseNs, &out);
+	}
+	char summary[96];
+	snprintf(summary, sizeof(summary), "events=%" PRIu64 " dropped=%" PRIu64 " skipped=%" PRIu64 "\n",
+			end, begin, skipped);
+	out.append(summary);
+	return out;
+}
@@ -0,0 +1,65 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * trace.h
+ *
+ * 替换过程中的逐方法事件(替换、改字段权限、恢复)，代替原来每次调用一条 LOGD.
+ *
+ * 事件以定长二进制记录写入固定大小的环形缓冲区，写入是一次 fetch_add 加几次普通写，
+ * 不格式化、不加锁、不分配内存；缓冲区写满后覆盖最早的事件. 只有调用 trace_dump
+ * (AndFix.dumpTrace)时才把事件解码成文本.
+ *
+ * 每个槽位带一个序号，写入前清零、写完后以 release 语义写入，读者据此跳过正在被改写的槽位.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/*
+ * 环形缓冲区的容量(事件数)，必须是 2 的幂
+ */
+#define TRACE_CAPACITY 4096
+
+enum TraceType {
+	TRACE_SETUP = 1,           // arg = apilevel, a 非空表示 art
+	TRACE_REPLACE = 2,         // a = 被改写的方法, b = 提供实现的方法, arg = art 版本(如 60 表示 6.0)，dalvik 为 0
+	TRACE_SET_FIELD_FLAG = 3,  // a = 字段, arg = 修改后的 access flags
+	TRACE_RESTORE = 5,         // a = 方法, arg = 是否恢复
+	TRACE_RESTORE_ALL = 6,     // arg = 恢复的方法数
+};
+
+/**
+ * 记录一个事件
+ */
+void trace_record(TraceType type, uint32_t arg, const void* a, const void* b);
+
+/**
+ * 把缓冲区中仍保留的事件按写入顺序解码为文本，每行一个事件
+ */
+std::string trace_dump();
+
+/**
+ * @return 累计写入的事件数(包括已被覆盖的)
+ */
+uint64_t trace_count();
+
+#endif /* TRACE_H_ */
@@ -0,0 +1,439 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * zip_archive.cpp
+ *
+ * 所有多字节字段都是小端，逐字节读取，不要求映射中的地址对齐.
+ * 中央目录中的每个长度与偏移在使用前都与文件大小比较，损坏或截断的文件只会打开失败.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "zip_archive.h"
+#include "../common.h"
+
+#define EOCD_SIGNATURE         0x06054b50
+#define EOCD_SIZE              22
+#define EOCD_MAX_COMMENT       0xffff
+#define ZIP64_LOCATOR_SIGNATURE 0x07064b50
+#define ZIP64_LOCATOR_SIZE     20
+#define ZIP64_EOCD_SIGNATURE   0x06064b50
+#define ZIP64_EOCD_SIZE        56
+#define CDH_SIGNATURE          0x02014b50
+#define CDH_SIZE               46
+#define LFH_SIGNATURE          0x04034b50
+#define LFH_SIZE               30
+#define ZIP64_EXTRA_ID         0x0001
+
+#define FLAG_ENCRYPTED 0x0001
+
+// z_stream 的 avail_in 是 uInt，超过 4GB 的条目分段喂给 inflate
+#define INFLATE_INPUT_CHUNK (1u << 30)
+
+struct ZipArchive {
+	const uint8_t* base;
+	size_t size;
+	std::vector<ZipEntry> entries;
+};
+
+struct ZipReader {
+	const uint8_t* data;
+	ZipEntry entry;
+	uint64_t consumed; // 已交给 inflate 的压缩数据
+	uint64_t produced; // 已返回的解压数据
+	uint32_t crc;
+	bool done;
+	bool failed;
+	z_stream stream;
+};
+
+static inline uint16_t get16(const uint8_t* p) {
+	return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+static inline uint32_t get32(const uint8_t* p) {
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16)
+			| ((uint32_t) p[3] << 24);
+}
+
+static inline uint64_t get64(const uint8_t* p) {
+	return (uint64_t) get32(p) | ((uint64_t) get32(p + 4) << 32);
+}
+
+/**
+ * @return [offset, offset + length) 是否在文件中
+ */
+static inline bool inFile(const ZipArchive* archive, uint64_t offset, uint64_t length) {
+	return offset <= archive->size && length <= archive->size - offset;
+}
+
+/**
+ * EOCD 在文件末尾，后面只可能跟着最长 64KB 的注释，从后往前找签名
+ */
+static const uint8_t* findEocd(const ZipArchive* archive) {
+	if (archive->size < EOCD_SIZE) {
+		return nullptr;
+	}
+	const uint8_t* end = archive->base + archive->size;
+	size_t maxBack = std::min<size_t>(archive->size - EOCD_SIZE, EOCD_MAX_COMMENT);
+	for (size_t back = 0; back <= maxBack; ++back) {
+		const uint8_t* p = end - EOCD_SIZE - back;
+		if (get32(p) == EOCD_SIGNATURE && get16(p + 20) <= back) {
+			return p;
+		}
+	}
+	return nullptr;
+}
+
+/**
+ * 中央目录中为 0xffffffff 的字段真实值在 zip64 extra field 中，按固定顺序只出现需要的那几项
+ */
+static bool readZip64Extra(const uint8_t* extra, size_t extraLength, ZipEntry* entry,
+		bool needUncompressed, bool needCompressed, bool needOffset) {
+	while (extraLength >= 4) {
+		uint16_t id = get16(extra);
+		uint16_t length = get16(extra + 2);
+		if ((size_t) length + 4 > extraLength) {
+			return false;
+		}
+		if (id == ZIP64_EXTRA_ID) {
+			const uint8_t* p = extra + 4;
+			const uint8_t* end = p + length;
+			if (needUncompressed) {
+				if (end - p < 8) {
+					return false;
+				}
+				entry->uncompressedSize = get64(p);
+				p += 8;
+			}
+			if (needCompressed) {
+				if (end - p < 8) {
+					return false;
+				}
+				entry->compressedSize = get64(p);
+				p += 8;
+			}
+			if (needOffset) {
+				if (end - p < 8) {
+					return false;
+				}
+				entry->localHeaderOffset = get64(p);
+			}
+			return true;
+		}
+		extra += 4 + length;
+		extraLength -= 4 + length;
+	}
+	return false;
+}
+
+static bool nameLess(const ZipEntry& a, const ZipEntry& b) {
+	int cmp = memcmp(a.name, b.name, std::min(a.nameLength, b.nameLength));
+	return cmp != 0 ? cmp < 0 : a.nameLength < b.nameLength;
+}
+
+static bool readDirectory(ZipArchive* archive) {
+	const uint8_t* eocd = findEocd(archive);
+	if (eocd == nullptr) {
+		LOGW("zip: no end of central directory");
+		return false;
+	}
+	uint64_t count = get16(eocd + 10);
+	uint64_t cdSize = get32(eocd + 12);
+	uint64_t cdOffset = get32(eocd + 16);
+	if (count == 0xffff || cdSize == 0xffffffff || cdOffset == 0xffffffff) {
+		size_t eocdOffset = eocd - archive->base;
+		if (eocdOffset < ZIP64_LOCATOR_SIZE
+				|| get32(eocd - ZIP64_LOCATOR_SIZE) != ZIP64_LOCATOR_SIGNATURE) {
+			// 恰好 65535 个条目的普通 ZIP 没有 zip64 记录
+			if (cdSize == 0xffffffff || cdOffset == 0xffffffff) {
+				LOGW("zip: zip64 locator missing");
+				return false;
+			}
+		} else {
+			uint64_t recordOffset = get64(eocd - ZIP64_LOCATOR_SIZE + 8);
+			if (!inFile(archive, recordOffset, ZIP64_EOCD_SIZE)
+					|| get32(archive->base + recordOffset) != ZIP64_EOCD_SIGNATURE) {
+				LOGW("zip: bad zip64 end of central directory");
+				return false;
+			}
+			const uint8_t* record = archive->base + recordOffset;
+			count = get64(record + 32);
+			cdSize = get64(record + 40);
+			cdOffset = get64(record + 48);
+		}
+	}
+	if (!inFile(archive, cdOffset, cdSize) || count > cdSize / CDH_SIZE) {
+		LOGW("zip: bad central directory, %llu entries", (unsigned long long) count);
+		return false;
+	}
+
+	archive->entries.reserve((size_t) count);
+	const uint8_t* p = archive->base + cdOffset;
+	const uint8_t* end = p + cdSize;
+	for (uint64_t i = 0; i < count; ++i) {
+		if (end - p < CDH_SIZE || get32(p) != CDH_SIGNATURE) {
+			LOGW("zip: bad central directory header %llu", (unsigned long long) i);
+			return false;
+		}
+		uint16_t nameLength = get16(p + 28);
+		uint16_t extraLength = get16(p + 30);
+		uint16_t commentLength = get16(p + 32);
+		size_t headerSize = (size_t) CDH_SIZE + nameLength + extraLength + commentLength;
+		if ((size_t) (end - p) < headerSize) {
+			LOGW("zip: central directory header %llu truncated", (unsigned long long) i);
+			return false;
+		}
+		ZipEntry entry;
+		entry.name = (const char*) p + CDH_SIZE;
+		entry.nameLength = nameLength;
+		entry.flags = get16(p + 8);
+		entry.method = get16(p + 10);
+		entry.crc32 = get32(p + 16);
+		entry.compressedSize = get32(p + 20);
+		entry.uncompressedSize = get32(p + 24);
+		entry.localHeaderOffset = get32(p + 42);
+		bool needUncompressed = entry.uncompressedSize == 0xffffffff;
+		bool needCompressed = entry.compressedSize == 0xffffffff;
+		bool needOffset = entry.localHeaderOffset == 0xffffffff;
+		if ((needUncompressed || needCompressed || needOffset)
+				&& !readZip64Extra(p + CDH_SIZE + nameLength, extraLength, &entry,
+						needUncompressed, needCompressed, needOffset)) {
+			LOGW("zip: bad zip64 extra field of entry %llu", (unsigned long long) i);
+			return false;
+		}
+		archive->entries.push_back(entry);
+		p += headerSize;
+	}
+	std::sort(archive->entries.begin(), archive->entries.end(), nameLess);
+	// 与 libziparchive 一样拒绝同名条目: JarFile 校验签名时可能取到另一份
+	for (size_t i = 1; i < archive->entries.size(); ++i) {
+		const ZipEntry& prev = archive->entries[i - 1];
+		const ZipEntry& entry = archive->entries[i];
+		if (prev.nameLength == entry.nameLength
+				&& memcmp(prev.name, entry.name, entry.nameLength) == 0) {
+			LOGW("zip: duplicate entry %.*s", (int) entry.nameLength, entry.name);
+			return false;
+		}
+	}
+	return true;
+}
+
+ZipArchive* zip_open(const char* path) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		LOGW("zip: open %s failed", path);
+		return nullptr;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < EOCD_SIZE) {
+		close(fd);
+		LOGW("zip: %s is too small", path);
+		return nullptr;
+	}
+	size_t size = (size_t) st.st_size;
+	void* base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		LOGW("zip: mmap %s failed", path);
+		return nullptr;
+	}
+	ZipArchive* archive = new ZipArchive();
+	archive->base = (const uint8_t*) base;
+	archive->size = size;
+	if (!readDirectory(archive)) {
+		LOGW("zip: %s is not a valid archive", path);
+		zip_close(archive);
+		return nullptr;
+	}
+	return archive;
+}
+
+void zip_close(ZipArchive* archive) {
+	if (archive == nullptr) {
+		return;
+	}
+	munmap((void*) archive->base, archive->size);
+	delete archive;
+}
+
+size_t zip_entryCount(const ZipArchive* archive) {
+	return archive->entries.size();
+}
+
+const ZipEntry* zip_entryAt(const ZipArchive* archive, size_t index) {
+	return index < archive->entries.size() ? &archive->entries[index] : nullptr;
+}
+
+const ZipEntry* zip_find(const ZipArchive* archive, const char* name, size_t nameLength) {
+	ZipEntry key;
+	key.name = name;
+	key.nameLength = (uint32_t) nameLength;
+	auto it = std::lower_bound(archive->entries.begin(), archive->entries.end(), key, nameLess);
+	if (it == archive->entries.end() || it->nameLength != nameLength
+			|| memcmp(it->name, name, nameLength) != 0) {
+		return nullptr;
+	}
+	return &*it;
+}
+
+/**
+ * 数据紧跟在 local header 之后；local header 中的 extra field 长度可能与中央目录中的不同
+ */
+static const uint8_t* entryData(const ZipArchive* archive, const ZipEntry* entry) {
+	if (!inFile(archive, entry->localHeaderOffset, LFH_SIZE)) {
+		return nullptr;
+	}
+	const uint8_t* header = archive->base + entry->localHeaderOffset;
+	if (get32(header) != LFH_SIGNATURE) {
+		return nullptr;
+	}
+	uint64_t dataOffset = entry->localHeaderOffset + LFH_SIZE + get16(header + 26)
+			+ get16(header + 28);
+	if (!inFile(archive, dataOffset, entry->compressedSize)) {
+		return nullptr;
+	}
+	return archive->base + dataOffset;
+}
+
+const uint8_t* zip_storedData(const ZipArchive* archive, const ZipEntry* entry) {
+	if (entry->method != ZIP_METHOD_STORED || (entry->flags & FLAG_ENCRYPTED) != 0
+			|| entry->compressedSize != entry->uncompressedSize) {
+		return nullptr;
+	}
+	return entryData(archive, entry);
+}
+
+ZipReader* zip_openReader(const ZipArchive* archive, const ZipEntry* entry) {
+	if ((entry->flags & FLAG_ENCRYPTED) != 0) {
+		return nullptr;
+	}
+	if (entry->method == ZIP_METHOD_STORED && entry->compressedSize != entry->uncompressedSize) {
+		return nullptr;
+	}
+	if (entry->method != ZIP_METHOD_STORED && entry->method != ZIP_METHOD_DEFLATED) {
+		return nullptr;
+	}
+	const uint8_t* data = entryData(archive, entry);
+	if (data == nullptr) {
+		return nullptr;
+	}
+	ZipReader* reader = new ZipReader();
+	reader->data = data;
+	reader->entry = *entry;
+	reader->consumed = 0;
+	reader->produced = 0;
+	reader->crc = crc32(0L, Z_NULL, 0);
+	reader->done = false;
+	reader->failed = false;
+	memset(&reader->stream, 0, sizeof(reader->stream));
+	// raw deflate，没有 zlib 头
+	if (entry->method == ZIP_METHOD_DEFLATED && inflateInit2(&reader->stream, -MAX_WBITS) != Z_OK) {
+		delete reader;
+		return nullptr;
+	}
+	return reader;
+}
+
+static ssize_t readStored(ZipReader* reader, uint8_t* buffer, size_t size) {
+	uint64_t left = reader->entry.uncompressedSize - reader->produced;
+	size_t n = (size_t) std::min<uint64_t>(left, size);
+	memcpy(buffer, reader->data + reader->produced, n);
+	return (ssize_t) n;
+}
+
+static ssize_t readDeflated(ZipReader* reader, uint8_t* buffer, size_t size) {
+	z_stream* stream = &reader->stream;
+	stream->next_out = buffer;
+	stream->avail_out = (uInt) std::min<size_t>(size, INFLATE_INPUT_CHUNK);
+	uInt wanted = stream->avail_out;
+	while (stream->avail_out == wanted) {
+		if (stream->avail_in == 0 && reader->consumed < reader->entry.compressedSize) {
+			uint64_t chunk = std::min<uint64_t>(reader->entry.compressedSize - reader->consumed,
+					INFLATE_INPUT_CHUNK);
+			stream->next_in = (Bytef*) (reader->data + reader->consumed);
+			stream->avail_in = (uInt) chunk;
+			reader->consumed += chunk;
+		}
+		int ret = inflate(stream, Z_NO_FLUSH);
+		if (ret == Z_STREAM_END) {
+			reader->done = true;
+			break;
+		}
+		if (ret != Z_OK) {
+			return -1; // 数据损坏，或压缩数据在流结束前用完(Z_BUF_ERROR)
+		}
+	}
+	return (ssize_t) (wanted - stream->avail_out);
+}
+
+ssize_t zip_read(ZipReader* reader, void* buffer, size_t size) {
+	if (reader->failed) {
+		return -1;
+	}
+	if (size == 0 || reader->done) {
+		return 0;
+	}
+	ssize_t n;
+	if (reader->entry.method == ZIP_METHOD_STORED) {
+		n = readStored(reader, (uint8_t*) buffer, size);
+		reader->done = reader->produced + n == reader->entry.uncompressedSize;
+	} else {
+		n = readDeflated(reader, (uint8_t*) buffer, size);
+	}
+	if (n < 0 || reader->produced + n > reader->entry.uncompressedSize) {
+		reader->failed = true;
+		LOGW("zip: %.*s is corrupt", (int) reader->entry.nameLength, reader->entry.name);
+		return -1;
+	}
+	reader->produced += n;
+	// crc32 的长度参数是 uInt，stored 条目一次可能读出更多，分段计算
+	const uint8_t* p = (const uint8_t*) buffer;
+	for (ssize_t left = n; left > 0;) {
+		uInt piece = (uInt) std::min<ssize_t>(left, INFLATE_INPUT_CHUNK);
+		reader->crc = crc32(reader->crc, p, piece);
+		p += piece;
+		left -= piece;
+	}
+	if (reader->done && (reader->produced != reader->entry.uncompressedSize
+			|| reader->crc != reader->entry.crc32)) {
+		reader->failed = true;
+		LOGW("zip: %.*s size or crc mismatch", (int) reader->entry.nameLength,
+				reader->entry.name);
+		return -1;
+	}
+	return n;
+}
+
+void zip_closeReader(ZipReader* reader) {
+	if (reader == nullptr) {
+		return;
+	}
+	if (reader->entry.method == ZIP_METHOD_DEFLATED) {
+		inflateEnd(&reader->stream);
+	}
+	delete reader;
+}
@@ -0,0 +1,97 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * zip_archive.h
+ *
+ * 只读的 ZIP(.apatch/.apk)读取，不经过 JarFile:
+ * 1. 整个文件只读 mmap，从尾部找到 End of Central Directory(条目数或偏移溢出时再读 zip64 的
+ *    EOCD locator / record)；
+ * 2. 中央目录只遍历一次，得到一个按文件名排序的 ZipEntry 数组，名字直接指向映射，不另外分配；
+ * 3. 查找是对这个数组的二分；
+ * 4. stored 条目可以直接拿到映射中的数据(零拷贝)，deflated 条目用 ZipReader 流式解压，
+ *    输入同样直接取自映射. 两种条目经 ZipReader 读完时都会检查长度与 CRC32.
+ * 不支持加密条目与分卷. 与 elf_resolver 一样不加锁，同一个 ZipArchive 的调用方负责串行.
+ */
+
+#ifndef ZIP_ARCHIVE_H_
+#define ZIP_ARCHIVE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define ZIP_METHOD_STORED   0
+#define ZIP_METHOD_DEFLATED 8
+
+struct ZipEntry {
+	const char* name; // 指向映射中的文件名，不以 '\0' 结尾
+	uint32_t nameLength;
+	uint16_t method;
+	uint16_t flags;
+	uint32_t crc32;
+	uint64_t compressedSize;
+	uint64_t uncompressedSize;
+	uint64_t localHeaderOffset;
+};
+
+struct ZipArchive;
+struct ZipReader;
+
+/**
+ * @return null 表示文件无法映射或不是合法的 ZIP(包括有同名条目)
+ */
+ZipArchive* zip_open(const char* path);
+
+/**
+ * 解除映射. 之后 zip_storedData 返回的指针与未关闭的 ZipReader 都不能再用
+ */
+void zip_close(ZipArchive* archive);
+
+size_t zip_entryCount(const ZipArchive* archive);
+
+/**
+ * @return 按文件名(字节序)排序后的第 index 个条目
+ */
+const ZipEntry* zip_entryAt(const ZipArchive* archive, size_t index);
+
+/**
+ * @return 名为 name 的条目，没有则为 null
+ */
+const ZipEntry* zip_find(const ZipArchive* archive, const char* name, size_t nameLength);
+
+/**
+ * stored 条目在映射中的数据，长度为 uncompressedSize，不检查 CRC
+ *
+ * @return null 表示条目不是 stored，或 local header / 数据超出文件
+ */
+const uint8_t* zip_storedData(const ZipArchive* archive, const ZipEntry* entry);
+
+/**
+ * @return null 表示条目加密、压缩方法不支持，或 local header / 数据超出文件
+ */
+ZipReader* zip_openReader(const ZipArchive* archive, const ZipEntry* entry);
+
+/**
+ * @return 读到的字节数(size 为 0 时也返回 0)，0 表示已读完，
+ *         -1 表示数据损坏(解压失败、长度或 CRC32 不符)
+ */
+ssize_t zip_read(ZipReader* reader, void* buffer, size_t size);
+
+void zip_closeReader(ZipReader* reader);
+
+#endif /* ZIP_ARCHIVE_H_ */
@@ -17,8 +17,14 @@
 
 package com.alipay.euler.andfix;
 
+import java.io.File;
 import java.lang.reflect.Field;
 import java.lang.reflect.Method;
+import java.util.Collections;
+import java.util.Map;
+import java.util.WeakHashMap;
+import java.util.concurrent.Future;
+import java.util.concurrent.atomic.AtomicLongArray;
 
 import android.os.Build;
 import android.util.Log;
@@ -26,18 +32,124 @@ import android.util.Log;
 public class AndFix {
 	private static final String TAG = "AndFix";
 
+	/**
+	 * status of {@link #addReplaceMethods(Method[], Method[])}, must match common.h
+	 */
+	public static final int REPLACE_OK = 0;
+	public static final int REPLACE_NULL = 1;
+	public static final int REPLACE_UNRESOLVED = 2;
+
+	/**
+	 * stats of {@link #getStats()}, the native ones must match stats.h
+	 */
+	public static final int STAT_SETUP = 0;
+	public static final int STAT_REPLACE_METHOD = 1;
+	public static final int STAT_REPLACE_METHODS = 2;
+	public static final int STAT_SET_FIELD_FLAG = 3;
+	public static final int STAT_SET_CLASS_FIELDS = 4;
+	public static final int STAT_RESTORE = 5;
+	/**
+	 * batches written while every other thread was suspended (ART, when libart exports
+	 * ScopedSuspendAll or Dbg::SuspendVM), items = methods written, ns = whole window;
+	 * compare STAT_FIELD_MAX_NS against the pause budget
+	 */
+	public static final int STAT_SUSPEND = 6;
+	private static final int STAT_NATIVE_COUNT = 7;
+	public static final int STAT_VERIFY = 7;
+	public static final int STAT_LOAD_DEX = 8;
+	public static final int STAT_LOAD_CLASS = 9;
+	public static final int STAT_REPLACE = 10;
+	public static final int STAT_FIX = 11;
+	public static final int STAT_PREPARE = 12;
+	public static final int STAT_COMMIT = 13;
+	/**
+	 * enumerating the patch dex and scanning annotations, items = methods found
+	 */
+	public static final int STAT_DISCOVER = 14;
+	/**
+	 * resolving a plan from the plan cache instead, items = methods
+	 */
+	public static final int STAT_PLAN_CACHE = 15;
+	/**
+	 * per plan cache hit: discovery time saved against the launch that wrote the cache
+	 */
+	public static final int STAT_PLAN_CACHE_SAVED = 16;
+	/**
+	 * per load of several patches: replacements skipped because a later patch
+	 * replaces the same method, items = replacements avoided
+	 */
+	public static final int STAT_COALESCE = 17;
+	/**
+	 * per fix that reused the verified, loaded dex of an earlier fix of the same
+	 * patch file, skipping verification and loadDex
+	 */
+	public static final int STAT_DEX_CACHE = 18;
+	/**
+	 * per prepare: classes of the patch dex that were never loaded because the
+	 * manifest or the Patch-Methods index names the classes to fix,
+	 * items = classes skipped
+	 */
+	public static final int STAT_CLASS_SKIPPED = 19;
+	public static final int STAT_COUNT = 20;
+
+	/**
+	 * each stat is STAT_FIELDS longs in {@link #getStats()}: [calls, items, total ns, max ns]
+	 */
+	public static final int STAT_FIELD_CALLS = 0;
+	public static final int STAT_FIELD_ITEMS = 1;
+	public static final int STAT_FIELD_TOTAL_NS = 2;
+	public static final int STAT_FIELD_MAX_NS = 3;
+	public static final int STAT_FIELDS = 4;
+
+	private static final boolean sLoaded;
+
 	static {
+		boolean loaded = false;
 		try {
 			Runtime.getRuntime().loadLibrary("andfix");
+			loaded = true;
 		} catch (Throwable e) {
 			Log.e(TAG, "loadLibrary", e);
 		}
+		sLoaded = loaded;
 	}
 
-	private static native boolean setup(boolean isArt, int apilevel);
+	/**
+	 * file that caches the probed ArtMethod layout, keyed by build fingerprint
+	 */
+	private static volatile String sLayoutCache;
+
+	/**
+	 * classes whose fields are already public, weak so patch classes can be unloaded
+	 */
+	private static final Map<Class<?>, Boolean> sPublicClasses = Collections
+			.synchronizedMap(new WeakHashMap<Class<?>, Boolean>());
+
+	/**
+	 * stats recorded in java, from STAT_NATIVE_COUNT on
+	 */
+	private static final AtomicLongArray sStats = new AtomicLongArray(
+			(STAT_COUNT - STAT_NATIVE_COUNT) * STAT_FIELDS);
+
+	private static native boolean setup(boolean isArt, int apilevel, String fingerprint, String layoutCache);
 	// dest 替换 src
 	private static native void replaceMethod(Method method1, Method method2);
+	private static native int[] replaceMethods(Method[] targets, Method[] replacements);
+	private static native long enqueueReplaceMethods(Method[] targets, Method[] replacements,
+			int[] status);
+	private static native boolean awaitApplied(long ticket, long timeoutNs);
+	private static native int replaceMethodBySignature(Class<?> target, String name, String sig,
+			boolean isStatic, Class<?> patch, String patchName, String patchSig);
+	private static native int[] replaceMethodsBySignature(Class<?>[] targets, String[] names,
+			String[] sigs, boolean[] isStatic, Class<?>[] patches, String[] patchNames,
+			String[] patchSigs);
 	private static native void setFieldFlag(Field field);
+	private static native int setFieldsPublic(Field[] fields);
+	private static native boolean restore(Method method);
+	private static native int restoreMethods();
+	private static native long[] getNativeStats();
+	private static native String dumpTrace();
+	private static native byte[] fingerprint(String path, byte[] key);
 
 	/**
 	 * replace method's body: arg1 替换 arg2.
@@ -56,6 +168,169 @@ public class AndFix {
 		}
 	}
 
+	/**
+	 * replace methods in one native call: targets[i] is replaced by replacements[i].
+	 * 
+	 * @param targets source methods
+	 * @param replacements target methods
+	 * @return per-entry status (REPLACE_*), or null if the batch failed as a whole
+	 */
+	public static int[] addReplaceMethods(Method[] targets, Method[] replacements) {
+		try {
+			int[] status = replaceMethods(targets, replacements);
+			if (status == null) {
+				return null;
+			}
+			for (int i = 0; i < status.length; i++) {
+				if (status[i] == REPLACE_OK) {
+					initFields(replacements[i].getDeclaringClass());
+				}
+			}
+			return status;
+		} catch (Throwable e) {
+			Log.e(TAG, "addReplaceMethods", e);
+			return null;
+		}
+	}
+
+	/**
+	 * same as {@link #addReplaceMethods(Method[], Method[])}, but only the methods
+	 * are resolved on the calling thread. the native applier thread writes them,
+	 * together with the batches other threads submit at the same time, so callers
+	 * do not block each other.
+	 * 
+	 * @param targets source methods
+	 * @param replacements target methods
+	 * @return future of the per-entry status (REPLACE_*), its value is null if the
+	 *         batch failed as a whole
+	 */
+	public static Future<int[]> addReplaceMethodsAsync(Method[] targets, Method[] replacements) {
+		try {
+			int[] status = new int[targets.length];
+			long ticket = enqueueReplaceMethods(targets, replacements, status);
+			if (ticket < 0) {
+				return new ApplyFuture(0, null);
+			}
+			for (int i = 0; i < status.length; i++) {
+				if (status[i] == REPLACE_OK) {
+					initFields(replacements[i].getDeclaringClass());
+				}
+			}
+			return new ApplyFuture(ticket, status);
+		} catch (Throwable e) {
+			Log.e(TAG, "addReplaceMethodsAsync", e);
+			return new ApplyFuture(0, null);
+		}
+	}
+
+	/**
+	 * @param ticket ticket of {@link #addReplaceMethodsAsync(Method[], Method[])}
+	 * @param timeoutNs less than 0 to wait forever, 0 to only check
+	 * @return true if the batch has been written
+	 */
+	static boolean isApplied(long ticket, long timeoutNs) {
+		try {
+			return awaitApplied(ticket, timeoutNs);
+		} catch (Throwable e) {
+			Log.e(TAG, "isApplied", e);
+			return true;
+		}
+	}
+
+	/**
+	 * replace a method resolved by its JNI signature, no reflective Method is
+	 * created: target.name(sig) is replaced by patch.patchName(patchSig).
+	 * 
+	 * @param target class of the method that will be replaced
+	 * @param name name of the method that will be replaced
+	 * @param sig JNI signature, e.g. (ILjava/lang/String;)V
+	 * @param isStatic whether both methods are static
+	 * @param patch class of the patch method
+	 * @param patchName name of the patch method
+	 * @param patchSig JNI signature of the patch method
+	 * @return status (REPLACE_*), REPLACE_UNRESOLVED if a method is not found
+	 */
+	public static int addReplaceMethodBySignature(Class<?> target, String name, String sig,
+			boolean isStatic, Class<?> patch, String patchName, String patchSig) {
+		try {
+			int status = replaceMethodBySignature(target, name, sig, isStatic, patch, patchName,
+					patchSig);
+			if (status == REPLACE_OK) {
+				initFields(target);
+				initFields(patch);
+			}
+			return status;
+		} catch (Throwable e) {
+			Log.e(TAG, "addReplaceMethodBySignature", e);
+			return REPLACE_UNRESOLVED;
+		}
+	}
+
+	/**
+	 * {@link #addReplaceMethodBySignature} for several methods in one native call,
+	 * entry i of every array describes one replacement.
+	 * 
+	 * @return per-entry status (REPLACE_*), or null if the batch failed as a whole
+	 */
+	public static int[] addReplaceMethodsBySignature(Class<?>[] targets, String[] names,
+			String[] sigs, boolean[] isStatic, Class<?>[] patches, String[] patchNames,
+			String[] patchSigs) {
+		try {
+			int[] status = replaceMethodsBySignature(targets, names, sigs, isStatic, patches,
+					patchNames, patchSigs);
+			if (status == null) {
+				return null;
+			}
+			for (int i = 0; i < status.length; i++) {
+				if (status[i] == REPLACE_OK) {
+					initFields(targets[i]);
+					initFields(patches[i]);
+				}
+			}
+			return status;
+		} catch (Throwable e) {
+			Log.e(TAG, "addReplaceMethodsBySignature", e);
+			return null;
+		}
+	}
+
+	/**
+	 * undo the replacement of a method, it runs its original body again
+	 * <p>
+	 * The original bytes are saved raw, including the GC heap references the
+	 * method holds (its declaring class, and on 5.x/6.0 the dex cache arrays).
+	 * The snapshot is not a GC root: on 5.0 - 7.0 a moving collection may
+	 * relocate those objects after the replacement, and restoring then writes
+	 * stale pointers back into a live method. Only rely on it on Dalvik or as a
+	 * last resort before restarting the process.
+	 * 
+	 * @param method replaced method
+	 * @return true if the method was replaced and has been restored
+	 */
+	public static boolean restoreMethod(Method method) {
+		try {
+			return restore(method);
+		} catch (Throwable e) {
+			Log.e(TAG, "restoreMethod", e);
+			return false;
+		}
+	}
+
+	/**
+	 * undo all replacements, with the same limitation as
+	 * {@link #restoreMethod(Method)}
+	 * 
+	 * @return count of restored methods
+	 */
+	public static int restoreAll() {
+		try {
+			return restoreMethods();
+		} catch (Throwable e) {
+			Log.e(TAG, "restoreAll", e);
+			return 0;
+		}
+	}
+
 	/**
 	 * initialize the target class, and modify access flag of class’ fields to public
 	 * 
@@ -73,19 +348,138 @@ public class AndFix {
 		return null;
 	}
 
+	/**
+	 * modify access flag of the fields of several classes to public, classes
+	 * already handled are skipped
+	 * 
+	 * @param classes classes
+	 */
+	public static void initClassFields(Class<?>[] classes) {
+		try {
+			for (Class<?> clazz : classes) {
+				initFields(clazz);
+			}
+		} catch (Throwable e) {
+			Log.e(TAG, "initClassFields", e);
+		}
+	}
+
 	/**
 	 * modify access flag of class’ fields to public
 	 *
 	 * @param clazz class
 	 */
 	private static void initFields(Class<?> clazz) {
-		Field[] srcFields = clazz.getDeclaredFields();
-		for (Field srcField : srcFields) {
-			Log.i(TAG, "modify:" + clazz.getName() + "." + srcField.getName() + " flag:");
-			setFieldFlag(srcField);
+		if (sPublicClasses.containsKey(clazz)) {
+			return;
+		}
+		// one native call for all fields, each resolved through FromReflectedField
+		int count = setFieldsPublic(clazz.getDeclaredFields());
+		Log.i(TAG, "modify:" + clazz.getName() + " fields:" + count);
+		sPublicClasses.put(clazz, Boolean.TRUE);
+	}
+
+	/**
+	 * record one call of a java stat, lock free
+	 * 
+	 * @param stat STAT_VERIFY .. STAT_FIX
+	 * @param items items handled by the call
+	 * @param ns time spent, from {@link System#nanoTime()}
+	 */
+	static void recordStat(int stat, long items, long ns) {
+		if (stat < STAT_NATIVE_COUNT || stat >= STAT_COUNT) {
+			return;
+		}
+		int base = (stat - STAT_NATIVE_COUNT) * STAT_FIELDS;
+		sStats.incrementAndGet(base + STAT_FIELD_CALLS);
+		sStats.addAndGet(base + STAT_FIELD_ITEMS, items);
+		sStats.addAndGet(base + STAT_FIELD_TOTAL_NS, ns);
+		long max;
+		do {
+			max = sStats.get(base + STAT_FIELD_MAX_NS);
+		} while (ns > max && !sStats.compareAndSet(base + STAT_FIELD_MAX_NS, max, ns));
+	}
+
+	/**
+	 * counters and timings of the patch path, STAT_FIELDS longs per stat.
+	 * e.g. the total time of DexFile.loadDex is
+	 * stats[STAT_LOAD_DEX * STAT_FIELDS + STAT_FIELD_TOTAL_NS].
+	 * native stats stay 0 when the library is not loaded.
+	 * 
+	 * @return STAT_COUNT * STAT_FIELDS longs
+	 */
+	public static long[] getStats() {
+		long[] stats = new long[STAT_COUNT * STAT_FIELDS];
+		try {
+			long[] nativeStats = getNativeStats();
+			if (nativeStats != null) {
+				System.arraycopy(nativeStats, 0, stats, 0,
+						Math.min(nativeStats.length, STAT_NATIVE_COUNT * STAT_FIELDS));
+			}
+		} catch (Throwable e) {
+			Log.e(TAG, "getStats", e);
+		}
+		for (int i = 0; i < sStats.length(); i++) {
+			stats[STAT_NATIVE_COUNT * STAT_FIELDS + i] = sStats.get(i);
+		}
+		return stats;
+	}
+
+	/**
+	 * decode the recent native events (replacements, field flags, restores).
+	 * they are recorded in a fixed size binary ring buffer instead of logcat,
+	 * only this call formats them.
+	 * 
+	 * @return one event per line, or null if the library is not loaded
+	 */
+	public static String getTrace() {
+		try {
+			return dumpTrace();
+		} catch (Throwable e) {
+			Log.e(TAG, "getTrace", e);
+			return null;
+		}
+	}
+
+	/**
+	 * @return true if libandfix is loaded, which also registers the natives of
+	 *         {@link ZipArchive}
+	 */
+	static boolean isLoaded() {
+		return sLoaded;
+	}
+
+	/**
+	 * keyed fingerprint of a patch or optimize file, computed in native code:
+	 * the file is mapped, its 1MB chunks are hashed with SHA-256 on several
+	 * threads (with the CPU's SHA instructions when it has them) and the chunk
+	 * digests are combined with HMAC-SHA256 under key. does not need
+	 * {@link #setup()}.
+	 * 
+	 * @param file file to hash
+	 * @param key HMAC key, may be empty
+	 * @return 32 bytes, or null if the file can not be read or the library is
+	 *         not loaded
+	 */
+	public static byte[] fingerprint(File file, byte[] key) {
+		try {
+			return fingerprint(file.getAbsolutePath(), key);
+		} catch (Throwable e) {
+			Log.e(TAG, "fingerprint", e);
+			return null;
 		}
 	}
 
+	/**
+	 * set the file in which the probed ArtMethod layout is persisted, so that
+	 * later launches skip probing. must be called before {@link #setup()}.
+	 * 
+	 * @param file layout cache file
+	 */
+	public static void setLayoutCache(File file) {
+		sLayoutCache = file == null ? null : file.getAbsolutePath();
+	}
+
 	/**
 	 * initialize
 	 * 
@@ -96,10 +490,26 @@ public class AndFix {
 			final String vmVersion = System.getProperty("java.vm.version");
 			boolean isArt = vmVersion != null && vmVersion.startsWith("2");
 			int apilevel = Build.VERSION.SDK_INT;
-			return setup(isArt, apilevel);
+			return setup(isArt, apilevel, Build.FINGERPRINT, sLayoutCache);
 		} catch (Exception e) {
 			Log.e(TAG, "setup", e);
 			return false;
 		}
 	}
+
+	/**
+	 * used by native setup to probe the ArtMethod layout, see jni/art/art_layout.cpp.
+	 * a() and b() are adjacent in the methods array and have known access flags,
+	 * n() is registered to a known native function.
+	 */
+	@SuppressWarnings("unused")
+	private static class LayoutProbe {
+		public static final void a() {
+		}
+
+		private static void b() {
+		}
+
+		private static native void n();
+	}
 }
@@ -20,15 +20,23 @@ package com.alipay.euler.andfix;
 import java.io.File;
 import java.io.IOException;
 import java.lang.reflect.Method;
-import java.util.Enumeration;
+import java.util.ArrayList;
+import java.util.Collection;
+import java.util.HashMap;
+import java.util.LinkedHashSet;
 import java.util.List;
 import java.util.Map;
+import java.util.Set;
 import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.Future;
 
 import android.content.Context;
+import android.content.pm.PackageInfo;
 import android.util.Log;
 
 import com.alipay.euler.andfix.annotation.MethodReplace;
+import com.alipay.euler.andfix.patch.PatchMethod;
 import com.alipay.euler.andfix.security.SecurityChecker;
 
 import dalvik.system.DexFile;
@@ -82,15 +90,17 @@ public class AndFixManager {
 
 	private static final String DIR = "apatch_opt";
 
+	private static final String LAYOUT_CACHE = "andfix_layout";
+
 	/**
 	 * context
 	 */
 	private final Context mContext;
 
 	/**
-	 * classes will be fixed
+	 * method tables of the classes will be fixed, keyed by className@classLoader
 	 */
-	private static final Map<String, Class<?>> mFixedClass = new ConcurrentHashMap<>();
+	private static final Map<String, MethodTable> mFixedClass = new ConcurrentHashMap<>();
 
 	/**
 	 * whether support AndFix
@@ -107,8 +117,21 @@ public class AndFixManager {
 	 */
 	private File mOptDir;
 
+	/**
+	 * version code and update time of the app, part of the plan cache key
+	 */
+	private long mAppVersion;
+	private long mAppUpdateTime;
+
+	/**
+	 * one lock per patch file: prepares of the same patch share the optimize file,
+	 * prepares of different patches run in parallel
+	 */
+	private final ConcurrentHashMap<String, Object> mPrepareLocks = new ConcurrentHashMap<String, Object>();
+
 	public AndFixManager(Context context) {
 		mContext = context;
+		AndFix.setLayoutCache(new File(mContext.getFilesDir(), LAYOUT_CACHE));
 		mSupport = Compat.isSupport();
 		if (mSupport) {
 			mSecurityChecker = new SecurityChecker(mContext); // 检查patch包的签名安全
@@ -121,6 +144,14 @@ public class AndFixManager {
 				Log.i(TAG, "mOptDir.delete(): " + ret);
 				mSupport = false;
 			}
+			try {
+				PackageInfo info = mContext.getPackageManager().getPackageInfo(
+						mContext.getPackageName(), 0);
+				mAppVersion = info.versionCode;
+				mAppUpdateTime = info.lastUpdateTime;
+			} catch (Exception e) {
+				Log.e(TAG, "getPackageInfo", e);
+			}
 		}
 	}
 
@@ -135,6 +166,19 @@ public class AndFixManager {
 		if (optfile.exists() && !optfile.delete()) {
 			Log.e(TAG, optfile.getName() + " delete error.");
 		}
+		PlanCache.delete(mOptDir, file);
+		DexCache.remove(file);
+	}
+
+	/**
+	 * undo all replaced methods of this process
+	 */
+	public synchronized void restoreAll() {
+		if (!mSupport) {
+			return;
+		}
+		int count = AndFix.restoreAll();
+		Log.i(TAG, "restoreAll: " + count);
 	}
 
 	/**
@@ -142,12 +186,26 @@ public class AndFixManager {
 	 * @param patchPath patch path
 	 */
 	@SuppressWarnings("unused")
-	public synchronized void fix(String patchPath) {
+	public void fix(String patchPath) {
 		fix(new File(patchPath), mContext.getClassLoader(), null);
 	}
 
 	/**
-	 * FIX
+	 * FIX: {@link #prepare(File, ClassLoader, List)} then {@link #commit(ReplacePlan)}
+	 * 
+	 * @param pathFile
+	 *            patch file
+	 * @param classLoader
+	 *            classloader of class that will be fixed
+	 * @param classNames
+	 *            classes will be fixed
+	 */
+	public void fix(File pathFile, ClassLoader classLoader, List<String> classNames) {
+		fix(pathFile, classLoader, classNames, null);
+	}
+
+	/**
+	 * FIX with the Patch-Methods index of the patch
 	 * 
 	 * @param pathFile
 	 *            patch file
@@ -155,40 +213,84 @@ public class AndFixManager {
 	 *            classloader of class that will be fixed
 	 * @param classNames
 	 *            classes will be fixed
+	 * @param methods
+	 *            Patch-Methods index, null to scan @MethodReplace annotations
 	 */
-	public synchronized void fix(File pathFile, ClassLoader classLoader, List<String> classNames) {
+	public void fix(File pathFile, ClassLoader classLoader, List<String> classNames,
+			List<PatchMethod> methods) {
 		if (!mSupport) {
 			return;
 		}
+		long fixStart = System.nanoTime();
+		try {
+			ReplacePlan plan = prepare(pathFile, classLoader, classNames, methods);
+			if (plan != null) {
+				commit(plan);
+			}
+		} finally {
+			AndFix.recordStat(AndFix.STAT_FIX, 1, System.nanoTime() - fixStart);
+		}
+	}
 
-		if (!mSecurityChecker.verifyApk(pathFile)) { // security check fail
-			return;
+	/**
+	 * verify the patch, load its dex and classes, and resolve the methods that
+	 * will be replaced, without touching the runtime. can run on any thread,
+	 * it does not block {@link #commit(ReplacePlan)}.
+	 * 
+	 * @param pathFile
+	 *            patch file
+	 * @param classLoader
+	 *            classloader of class that will be fixed
+	 * @param classNames
+	 *            classes will be fixed, null for all classes of the patch
+	 * @return plan to commit, or null if the patch can not be applied
+	 */
+	public ReplacePlan prepare(File pathFile, ClassLoader classLoader, List<String> classNames) {
+		return prepare(pathFile, classLoader, classNames, null);
+	}
+
+	/**
+	 * same as {@link #prepare(File, ClassLoader, List)}, but resolves the methods
+	 * listed in the Patch-Methods index instead of scanning annotations
+	 * 
+	 * @param methods
+	 *            Patch-Methods index, null to scan @MethodReplace annotations
+	 */
+	public ReplacePlan prepare(File pathFile, ClassLoader classLoader, List<String> classNames,
+			List<PatchMethod> methods) {
+		if (!mSupport) {
+			return null;
 		}
+		long prepareStart = System.nanoTime();
+		ReplacePlan plan = null;
+		synchronized (prepareLock(pathFile)) {
+			try {
+				plan = prepareInternal(pathFile, classLoader, classNames, methods);
+			} finally {
+				AndFix.recordStat(AndFix.STAT_PREPARE, plan != null ? plan.size() : 0,
+						System.nanoTime() - prepareStart);
+			}
+		}
+		return plan;
+	}
 
+	private ReplacePlan prepareInternal(File pathFile, ClassLoader classLoader, List<String> classNames,
+			List<PatchMethod> methods) {
 		try {
-			File optfile = new File(mOptDir, pathFile.getName());
-			boolean saveFingerprint = true;
-			if (optfile.exists()) {
-				// need to verify fingerprint when the optimize file exist,
-				// prevent someone attack on jailbreak device with
-				// Vulnerability-Parasyte.
-				// btw:exaggerated android Vulnerability-Parasyte
-				// http://secauo.com/Exaggerated-Android-Vulnerability-Parasyte.html
-
-				if (mSecurityChecker.verifyOpt(optfile)) {
-					saveFingerprint = false;
-				} else if (!optfile.delete()) {
-					return;
+			long start = System.nanoTime();
+			DexCache.Entry dex = DexCache.get(pathFile);
+			if (dex != null) {
+				// 同一个补丁已在本进程中校验并加载过，只需加载类与替换
+				AndFix.recordStat(AndFix.STAT_DEX_CACHE, 1, System.nanoTime() - start);
+			} else {
+				dex = loadVerified(pathFile);
+				if (dex == null) {
+					return null;
 				}
 			}
-
-			final DexFile dexFile = DexFile.loadDex(pathFile.getAbsolutePath(),
-													optfile.getAbsolutePath(),
-													Context.MODE_PRIVATE);
-
-			if (saveFingerprint) {
-				mSecurityChecker.saveOptSig(optfile);
-			}
+			final DexFile dexFile = dex.dexFile;
+			// Patch-Classes 给出了要修复的类时只加载这些类，不枚举整个 dex
+			Set<String> fixClasses = classNames == null ? null : new LinkedHashSet<String>(classNames);
 
 			// 双亲机制，这里也是关键点之1/2，classLoader 决定的是该 补丁.apk 中被加载到内存中的class，
 			// 是否能够被原apk识别。
@@ -209,32 +311,353 @@ public class AndFixManager {
 				}
 			};
 
-			Enumeration<String> entrys = dexFile.entries();
-			Class<?> clazz;
-			while (entrys.hasMoreElements()) {
-				String entry = entrys.nextElement();
-				if (classNames != null && !classNames.contains(entry)) {
-					continue;// skip, not need fix
+			// 只收集需要替换的方法与需要修改字段权限的类，由 commit 一次性写入
+			List<Method> targets = new ArrayList<Method>();
+			List<Method> replacements = new ArrayList<Method>();
+			Set<Class<?>> fieldClasses = new LinkedHashSet<Class<?>>();
+			if (methods != null) {
+				// 有 Patch-Methods 索引时直接定位方法，不加载无关的类也不扫描注解.
+				// 索引在 PATCH.MF 中，verifyApk 已校验过它的签名
+				int loaded = resolveMethods(methods, false, dexFile, patchClassLoader, classLoader,
+						fixClasses, targets, replacements, fieldClasses);
+				recordSkipped(dex, loaded);
+				return new ReplacePlan(pathFile.getName(), targets, replacements, fieldClasses);
+			}
+
+			// 上次启动保存的 plan 与补丁内容、app 版本一致时，直接按它解析方法.
+			// plan 文件由本机的 hash key 做 HMAC，每一对方法仍要与补丁方法上的 @MethodReplace 相符
+			start = System.nanoTime();
+			byte[] planMacKey = mSecurityChecker.getHashKey();
+			PlanCache.Key key = new PlanCache.Key(pathFile, dex.fingerprint, mAppVersion,
+					mAppUpdateTime, classNames);
+			File planFile = PlanCache.file(mOptDir, pathFile, key);
+			PlanCache.Entry cached = PlanCache.load(planFile, key, planMacKey);
+			if (cached != null) {
+				int loaded = resolveMethods(cached.methods, true, dexFile, patchClassLoader,
+						classLoader, fixClasses, targets, replacements, fieldClasses);
+				long ns = System.nanoTime() - start;
+				if (targets.size() == cached.methods.size()) {
+					recordSkipped(dex, loaded);
+					AndFix.recordStat(AndFix.STAT_PLAN_CACHE, targets.size(), ns);
+					AndFix.recordStat(AndFix.STAT_PLAN_CACHE_SAVED, 1,
+							Math.max(0, cached.discoverNs - ns));
+					return new ReplacePlan(pathFile.getName(), targets, replacements, fieldClasses);
 				}
+				// 有方法解析失败或与注解不符，缓存已不可信，丢弃后重新扫描
+				Log.e(TAG, "stale plan cache: " + planFile.getName());
+				targets.clear();
+				replacements.clear();
+				fieldClasses.clear();
+				PlanCache.delete(mOptDir, pathFile);
+			}
+
+			long discoverStart = System.nanoTime();
+			Collection<String> candidates = fixClasses != null ? fixClasses : dex.classNames();
+			int loaded = 0;
+			Class<?> clazz;
+			for (String entry : candidates) {
+				start = System.nanoTime();
 				clazz = dexFile.loadClass(entry, patchClassLoader);
+				AndFix.recordStat(AndFix.STAT_LOAD_CLASS, clazz != null ? 1 : 0,
+						System.nanoTime() - start);
 				if (clazz != null) {
-					fixClass(clazz, classLoader);
+					loaded++;
+					fixClass(clazz, classLoader, targets, replacements, fieldClasses);
 				}
 			}
+			if (fixClasses != null) {
+				recordSkipped(dex, loaded);
+			}
+			long discoverNs = System.nanoTime() - discoverStart;
+			AndFix.recordStat(AndFix.STAT_DISCOVER, targets.size(), discoverNs);
+			if (!targets.isEmpty()) {
+				List<PatchMethod> resolved = new ArrayList<PatchMethod>(targets.size());
+				for (int i = 0; i < targets.size(); i++) {
+					resolved.add(PatchMethod.of(targets.get(i), replacements.get(i)));
+				}
+				PlanCache.save(planFile, key, planMacKey, resolved, discoverNs);
+			}
+			return new ReplacePlan(pathFile.getName(), targets, replacements, fieldClasses);
 		} catch (IOException e) {
 			Log.e(TAG, "pacth", e);
+			return null;
 		}
 	}
 
+	/**
+	 * verify the patch and its optimize file, load the dex and remember it in
+	 * {@link DexCache}
+	 * 
+	 * @return null if the patch or the optimize file can not be trusted
+	 */
+	private DexCache.Entry loadVerified(File pathFile) throws IOException {
+		long start = System.nanoTime();
+		// 校验签名时得到的摘要即补丁内容的指纹，plan cache 用它而不再对补丁做一次 hash
+		String fingerprint = mSecurityChecker.verifyApkDigest(pathFile);
+		AndFix.recordStat(AndFix.STAT_VERIFY, 1, System.nanoTime() - start);
+		if (fingerprint == null) { // security check fail
+			return null;
+		}
+
+		File optfile = new File(mOptDir, pathFile.getName());
+		boolean saveFingerprint = true;
+		if (optfile.exists()) {
+			// need to verify fingerprint when the optimize file exist,
+			// prevent someone attack on jailbreak device with
+			// Vulnerability-Parasyte.
+			// btw:exaggerated android Vulnerability-Parasyte
+			// http://secauo.com/Exaggerated-Android-Vulnerability-Parasyte.html
+
+			start = System.nanoTime();
+			boolean verified = mSecurityChecker.verifyOpt(optfile);
+			AndFix.recordStat(AndFix.STAT_VERIFY, 1, System.nanoTime() - start);
+			if (verified) {
+				saveFingerprint = false;
+			} else if (!optfile.delete()) {
+				return null;
+			}
+		}
+
+		start = System.nanoTime();
+		DexFile dexFile = DexFile.loadDex(pathFile.getAbsolutePath(),
+										  optfile.getAbsolutePath(),
+										  Context.MODE_PRIVATE);
+		AndFix.recordStat(AndFix.STAT_LOAD_DEX, 1, System.nanoTime() - start);
+
+		if (saveFingerprint) {
+			mSecurityChecker.saveOptSig(optfile);
+		}
+		return DexCache.put(pathFile, dexFile, fingerprint);
+	}
+
+	/**
+	 * plan a load of several patches before touching the runtime: when a later
+	 * patch replaces the same target method, the replacements of the earlier
+	 * patches are dropped, only the last one is applied. the patches are still
+	 * applied in the given order, so the result is the same as applying every
+	 * patch fully.
+	 * 
+	 * a patch without Patch-Methods index (null) is applied as is, it does not
+	 * shadow the others because its methods are unknown until its dex is loaded.
+	 * 
+	 * @param indices Patch-Methods index of each patch, in apply order
+	 * @return per patch, the entries still to apply: null for a patch without
+	 *         index, empty if every method is shadowed and the patch can be skipped
+	 */
+	public List<List<PatchMethod>> coalesce(List<List<PatchMethod>> indices) {
+		long start = System.nanoTime();
+		// target method -> index of the patch whose replacement wins
+		Map<String, Integer> winners = new HashMap<String, Integer>();
+		for (int i = 0; i < indices.size(); i++) {
+			List<PatchMethod> methods = indices.get(i);
+			if (methods != null) {
+				for (PatchMethod method : methods) {
+					winners.put(targetKey(method), i);
+				}
+			}
+		}
+
+		List<List<PatchMethod>> result = new ArrayList<List<PatchMethod>>(indices.size());
+		int avoided = 0;
+		int skipped = 0;
+		for (int i = 0; i < indices.size(); i++) {
+			List<PatchMethod> methods = indices.get(i);
+			if (methods == null) {
+				result.add(null);
+				continue;
+			}
+			List<PatchMethod> kept = new ArrayList<PatchMethod>(methods.size());
+			for (PatchMethod method : methods) {
+				if (winners.get(targetKey(method)) == i) {
+					kept.add(method);
+				}
+			}
+			avoided += methods.size() - kept.size();
+			if (kept.isEmpty() && !methods.isEmpty()) {
+				skipped++;
+			}
+			result.add(kept);
+		}
+		AndFix.recordStat(AndFix.STAT_COALESCE, avoided, System.nanoTime() - start);
+		if (avoided > 0) {
+			Log.d(TAG, "coalesce: " + avoided + " replacements avoided, " + skipped
+					+ " patches shadowed");
+		}
+		return result;
+	}
+
+	private static String targetKey(PatchMethod method) {
+		return method.getTargetClass() + '.' + method.getTargetMethod()
+				+ method.getParameterDescriptor();
+	}
+
+	private Object prepareLock(File pathFile) {
+		String name = pathFile.getName();
+		Object lock = mPrepareLocks.get(name);
+		if (lock == null) {
+			Object created = new Object();
+			lock = mPrepareLocks.putIfAbsent(name, created);
+			if (lock == null) {
+				lock = created;
+			}
+		}
+		return lock;
+	}
+
+	/**
+	 * apply a prepared plan: make the fields public, then replace all methods in
+	 * one batch and wait until it is written.
+	 * 
+	 * @param plan plan from {@link #prepare(File, ClassLoader, List)}
+	 */
+	public void commit(ReplacePlan plan) {
+		if (!mSupport || plan == null || plan.isEmpty()) {
+			return;
+		}
+		long commitStart = System.nanoTime();
+		AndFix.initClassFields(plan.fieldClasses());
+		long start = System.nanoTime();
+		Future<int[]> future = AndFix.addReplaceMethodsAsync(plan.targets(), plan.replacements()); // 前者 替换 后者
+		int[] status = null;
+		try {
+			status = future.get();
+		} catch (InterruptedException e) {
+			Thread.currentThread().interrupt();
+		} catch (ExecutionException e) {
+			Log.e(TAG, "commit", e);
+		}
+		long end = System.nanoTime();
+		AndFix.recordStat(AndFix.STAT_REPLACE, plan.size(), end - start);
+		AndFix.recordStat(AndFix.STAT_COMMIT, plan.size(), end - commitStart);
+
+		if (status == null) {
+			Log.e(TAG, "commit failed: " + plan);
+			return;
+		}
+		Method[] targets = plan.targets();
+		for (int i = 0; i < status.length; i++) {
+			if (status[i] != AndFix.REPLACE_OK) {
+				Log.e(TAG, "replaceMethod " + targets[i] + " status=" + status[i]);
+			}
+		}
+	}
+
+	/**
+	 * same as {@link #commit(ReplacePlan)} without waiting: the native applier
+	 * thread writes the plan, merged with the plans other threads commit at the
+	 * same time.
+	 * 
+	 * @param plan plan from {@link #prepare(File, ClassLoader, List)}
+	 * @return future of the per-method status (AndFix.REPLACE_*), null if there is
+	 *         nothing to apply
+	 */
+	public Future<int[]> commitAsync(ReplacePlan plan) {
+		if (!mSupport || plan == null || plan.isEmpty()) {
+			return null;
+		}
+		AndFix.initClassFields(plan.fieldClasses());
+		return AndFix.addReplaceMethodsAsync(plan.targets(), plan.replacements());
+	}
+
+	/**
+	 * resolve the entries of the Patch-Methods index
+	 * 
+	 * @param methods Patch-Methods index
+	 * @param checkAnnotation true when the entries come from outside the
+	 *            patch (plan cache): each patch method must carry a
+	 *            @MethodReplace naming the entry's target, or the entry is
+	 *            skipped. the Patch-Methods index itself is in PATCH.MF, whose
+	 *            signature verifyApk checks
+	 * @param dexFile dex of the patch
+	 * @param patchClassLoader loads the patch classes
+	 * @param classLoader classloader of class that will be fixed
+	 * @param classNames patch classes will be used, null for all
+	 * @param targets collects methods that will be replaced
+	 * @param replacements collects the patch methods, in the same order as targets
+	 * @param fieldClasses collects classes whose fields will be made public
+	 * @return count of patch classes loaded
+	 */
+	private int resolveMethods(List<PatchMethod> methods, boolean checkAnnotation, DexFile dexFile,
+			ClassLoader patchClassLoader, ClassLoader classLoader, Set<String> classNames,
+			List<Method> targets, List<Method> replacements, Set<Class<?>> fieldClasses) {
+		Map<String, MethodTable> patchClasses = new HashMap<String, MethodTable>();
+		long start;
+		for (PatchMethod entry : methods) {
+			String patchClassName = entry.getPatchClass();
+			if (classNames != null && !classNames.contains(patchClassName)) {
+				continue;// skip, not need fix
+			}
+			MethodTable patchTable = patchClasses.get(patchClassName);
+			if (patchTable == null) {
+				start = System.nanoTime();
+				Class<?> patchClass = dexFile.loadClass(patchClassName, patchClassLoader);
+				AndFix.recordStat(AndFix.STAT_LOAD_CLASS, patchClass != null ? 1 : 0,
+						System.nanoTime() - start);
+				if (patchClass == null) {
+					Log.e(TAG, "patch class not found: " + entry);
+					continue;
+				}
+				patchTable = new MethodTable(patchClass);
+				patchClasses.put(patchClassName, patchTable);
+			}
+			String parameters = entry.getParameterDescriptor();
+			Method replacement = patchTable.get(entry.getPatchMethod(), parameters);
+			if (replacement == null) {
+				Log.e(TAG, "patch method not found: " + entry);
+				continue;
+			}
+			if (checkAnnotation && !isAnnotatedFor(replacement, entry)) {
+				Log.e(TAG, "patch method does not replace the target: " + entry);
+				continue;
+			}
+			Method target = findTargetMethod(classLoader, entry.getTargetClass(),
+					entry.getTargetMethod(), parameters);
+			if (target != null) {
+				targets.add(target);
+				replacements.add(replacement);
+				fieldClasses.add(target.getDeclaringClass());
+				fieldClasses.add(patchTable.getDeclaringClass());
+			}
+		}
+		return patchClasses.size();
+	}
+
+	/**
+	 * report the classes of the patch dex that were never loaded
+	 * 
+	 * @param loaded count of classes loaded from the dex
+	 */
+	private static void recordSkipped(DexCache.Entry dex, int loaded) {
+		if (dex.classCount >= 0) {
+			AndFix.recordStat(AndFix.STAT_CLASS_SKIPPED, Math.max(0, dex.classCount - loaded), 0);
+		}
+	}
+
+	/**
+	 * @return true if the @MethodReplace of the patch method names the target
+	 *         class and method of the entry
+	 */
+	private static boolean isAnnotatedFor(Method replacement, PatchMethod entry) {
+		MethodReplace methodReplace = replacement.getAnnotation(MethodReplace.class);
+		return methodReplace != null
+				&& entry.getTargetClass().equals(methodReplace.clazz())
+				&& entry.getTargetMethod().equals(methodReplace.method());
+	}
+
 	/**
 	 * fix class
 	 * @param clazz class
+	 * @param targets collects methods that will be replaced
+	 * @param replacements collects the patch methods, in the same order as targets
+	 * @param fieldClasses collects classes whose fields will be made public
 	 */
-	private void fixClass(Class<?> clazz, ClassLoader classLoader) {
+	private void fixClass(Class<?> clazz, ClassLoader classLoader, List<Method> targets,
+						  List<Method> replacements, Set<Class<?>> fieldClasses) {
 		Method[] methods = clazz.getDeclaredMethods();
 		MethodReplace methodReplace;
 		String className;
 		String methodName;
+		Method target;
 		for (Method method : methods) {
 			methodReplace = method.getAnnotation(MethodReplace.class);
 			if (methodReplace == null) {
@@ -243,36 +666,48 @@ public class AndFixManager {
 			className = methodReplace.clazz();
 			methodName = methodReplace.method();
 			if (!isEmpty(className) && !isEmpty(methodName)) {
-				replaceMethod(classLoader, className, methodName, method);
+				target = findTargetMethod(classLoader, className, methodName,
+						PatchMethod.getParameterDescriptor(method));
+				if (target != null) {
+					targets.add(target);
+					replacements.add(method);
+					fieldClasses.add(target.getDeclaringClass());
+					fieldClasses.add(clazz);
+				}
 			}
 		}
 	}
 
 	/**
-	 * replace method
+	 * find the method that will be replaced, its class is initialized but its
+	 * fields are left to commit
 	 * 
 	 * @param classLoader classloader
 	 * @param className name of target class
 	 * @param methodname name of target method
-	 * @param method2 source method
+	 * @param parameters parameter descriptor of the source method, e.g. (ILjava/lang/String;)
+	 * @return target method, or null if not found
 	 */
-	private void replaceMethod(ClassLoader classLoader, String className, String methodname, Method method2) {
+	private Method findTargetMethod(ClassLoader classLoader, String className, String methodname,
+			String parameters) {
 		try {
 			String key = className + "@" + classLoader.toString();
-			Class<?> clazz = mFixedClass.get(key);
-			if (clazz == null) { // class not load
-				Class<?> class1 = classLoader.loadClass(className);
-				// initialize target class
-				clazz = AndFix.initTargetClass(class1);
+			MethodTable table = mFixedClass.get(key);
+			if (table == null) { // class not load
+				// initialize target class, its methods are listed once for all patched methods
+				table = new MethodTable(Class.forName(className, true, classLoader));
+				mFixedClass.put(key, table);
 			}
-			if (clazz != null) { // initialize class OK
-				mFixedClass.put(key, clazz);
-				Method method1 = clazz.getDeclaredMethod(methodname, method2.getParameterTypes());
-				AndFix.addReplaceMethod(method1, method2); // 前者 替换 后者
+			Method target = table.get(methodname, parameters);
+			if (target == null) {
+				Log.e(TAG, "findTargetMethod: " + className + "." + methodname + parameters
+						+ " not found");
 			}
+			return target;
 		} catch (Exception e) {
-			Log.e(TAG, "replaceMethod", e);
+			Log.e(TAG, "findTargetMethod", e);
 		}
+		return null;
 	}
 
 	private static boolean isEmpty(String string) {
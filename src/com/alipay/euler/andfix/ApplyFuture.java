@@ -0,0 +1,83 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.alipay.euler.andfix;
+
+import java.util.concurrent.Future;
+import java.util.concurrent.TimeUnit;
+import java.util.concurrent.TimeoutException;
+
+/**
+ * completion of a batch handed to the native applier thread, see
+ * {@link AndFix#addReplaceMethodsAsync(java.lang.reflect.Method[], java.lang.reflect.Method[])}.
+ *
+ * the status is known when the batch is enqueued (methods are resolved on the
+ * calling thread), the future only waits for the write. the wait happens in
+ * native code and is not interruptible; a batch can not be cancelled.
+ */
+final class ApplyFuture implements Future<int[]> {
+	private final long mTicket;
+	private final int[] mStatus;
+	private volatile boolean mDone;
+
+	/**
+	 * @param ticket ticket of the native queue, 0 if nothing was enqueued
+	 * @param status per-entry status, null if the batch failed as a whole
+	 */
+	ApplyFuture(long ticket, int[] status) {
+		mTicket = ticket;
+		mStatus = status;
+		mDone = ticket <= 0;
+	}
+
+	@Override
+	public boolean cancel(boolean mayInterruptIfRunning) {
+		return false;
+	}
+
+	@Override
+	public boolean isCancelled() {
+		return false;
+	}
+
+	@Override
+	public boolean isDone() {
+		if (!mDone) {
+			mDone = AndFix.isApplied(mTicket, 0);
+		}
+		return mDone;
+	}
+
+	@Override
+	public int[] get() {
+		if (!mDone) {
+			mDone = AndFix.isApplied(mTicket, -1);
+		}
+		return mStatus;
+	}
+
+	@Override
+	public int[] get(long timeout, TimeUnit unit) throws TimeoutException {
+		if (!mDone) {
+			mDone = AndFix.isApplied(mTicket, Math.max(0, unit.toNanos(timeout)));
+		}
+		if (!mDone) {
+			throw new TimeoutException();
+		}
+		return mStatus;
+	}
+}
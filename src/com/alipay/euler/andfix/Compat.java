@@ -63,9 +63,10 @@ public class Compat {
 				|| (version != null && version.trim().length() > 0);
 	}
 
-	// from android 2.3 to android 7.0
+	// from android 2.3 to android 8.1. above 7.0 there is no built-in ArtMethod
+	// layout, AndFix.setup fails unless the layout is probed at runtime
 	private static boolean isSupportSDKVersion() {
-		if (android.os.Build.VERSION.SDK_INT >= 8 && android.os.Build.VERSION.SDK_INT <= 24) {
+		if (android.os.Build.VERSION.SDK_INT >= 8 && android.os.Build.VERSION.SDK_INT <= 27) {
 			return true;
 		}
 		return false;
@@ -0,0 +1,193 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.alipay.euler.andfix;
+
+import java.io.DataInputStream;
+import java.io.File;
+import java.io.IOException;
+import java.io.InputStream;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.util.ArrayList;
+import java.util.Collections;
+import java.util.Enumeration;
+import java.util.List;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.zip.ZipEntry;
+import java.util.zip.ZipFile;
+
+import dalvik.system.DexFile;
+
+/**
+ * the verified, opened dex of each patch file, kept for the life of the
+ * process. a patch is fixed once per patch name and again whenever a plugin
+ * loads; only the first fix verifies the patch and its optimize file and
+ * loads the dex, the later ones reuse the DexFile and its class list.
+ * the class list is only built when a fix has to enumerate the dex, a fix
+ * with a class list from the manifest never needs it.
+ *
+ * an entry is valid while the patch file keeps its length and modification
+ * time, otherwise the patch is verified and loaded again. the DexFile is never
+ * closed, classes loaded from it may still be in use.
+ */
+final class DexCache {
+	static final class Entry {
+		final long length;
+		final long lastModified;
+		final DexFile dexFile;
+		/**
+		 * class_defs_size of classes.dex, -1 if the header could not be read
+		 */
+		final int classCount;
+		/**
+		 * fingerprint of the patch content from its verification
+		 */
+		final String fingerprint;
+		private List<String> mClassNames;
+
+		Entry(File patch, DexFile dexFile, String fingerprint) {
+			this.length = patch.length();
+			this.lastModified = patch.lastModified();
+			this.dexFile = dexFile;
+			this.fingerprint = fingerprint;
+			this.classCount = readClassCount(patch);
+		}
+
+		/**
+		 * @return classes of the dex, in the order of {@link DexFile#entries()}
+		 */
+		synchronized List<String> classNames() {
+			if (mClassNames == null) {
+				List<String> names = new ArrayList<String>();
+				Enumeration<String> entries = dexFile.entries();
+				while (entries.hasMoreElements()) {
+					names.add(entries.nextElement());
+				}
+				mClassNames = Collections.unmodifiableList(names);
+			}
+			return mClassNames;
+		}
+	}
+
+	private static final String DEX_ENTRY = "classes.dex";
+	private static final int DEX_HEADER_SIZE = 0x70;
+	private static final int CLASS_DEFS_SIZE_OFFSET = 0x60;
+
+	private static final ConcurrentHashMap<String, Entry> sEntries = new ConcurrentHashMap<String, Entry>();
+
+	private DexCache() {
+	}
+
+	/**
+	 * @return the cached dex of the patch, null if it has not been loaded or
+	 *         the file changed since
+	 */
+	static Entry get(File patch) {
+		String key = patch.getAbsolutePath();
+		Entry entry = sEntries.get(key);
+		if (entry == null) {
+			return null;
+		}
+		if (entry.length != patch.length() || entry.lastModified != patch.lastModified()) {
+			sEntries.remove(key, entry);
+			return null;
+		}
+		return entry;
+	}
+
+	/**
+	 * remember a verified, loaded dex
+	 * 
+	 * @param fingerprint fingerprint of the patch content from its verification
+	 */
+	static Entry put(File patch, DexFile dexFile, String fingerprint) {
+		Entry entry = new Entry(patch, dexFile, fingerprint);
+		sEntries.put(patch.getAbsolutePath(), entry);
+		return entry;
+	}
+
+	/**
+	 * read class_defs_size from the dex header: mapped when classes.dex is
+	 * stored, otherwise only the header is inflated
+	 */
+	private static int readClassCount(File patch) {
+		ZipArchive zip = ZipArchive.open(patch);
+		if (zip == null) {
+			return readClassCountFromZipFile(patch);
+		}
+		try {
+			ByteBuffer header = zip.map(DEX_ENTRY);
+			if (header == null) {
+				InputStream in = zip.getInputStream(DEX_ENTRY);
+				if (in == null) {
+					return -1;
+				}
+				header = readHeader(in);
+			}
+			if (header.remaining() < DEX_HEADER_SIZE) {
+				return -1;
+			}
+			return header.order(ByteOrder.LITTLE_ENDIAN).getInt(CLASS_DEFS_SIZE_OFFSET);
+		} catch (IOException e) {
+			return -1;
+		} finally {
+			zip.close();
+		}
+	}
+
+	private static int readClassCountFromZipFile(File patch) {
+		ZipFile zip = null;
+		try {
+			zip = new ZipFile(patch);
+			ZipEntry entry = zip.getEntry(DEX_ENTRY);
+			if (entry == null) {
+				return -1;
+			}
+			return readHeader(zip.getInputStream(entry)).order(ByteOrder.LITTLE_ENDIAN)
+					.getInt(CLASS_DEFS_SIZE_OFFSET);
+		} catch (IOException e) {
+			return -1;
+		} finally {
+			if (zip != null) {
+				try {
+					zip.close();
+				} catch (IOException e) {
+					// ignore
+				}
+			}
+		}
+	}
+
+	private static ByteBuffer readHeader(InputStream in) throws IOException {
+		DataInputStream din = new DataInputStream(in);
+		try {
+			byte[] header = new byte[DEX_HEADER_SIZE];
+			din.readFully(header);
+			return ByteBuffer.wrap(header);
+		} finally {
+			din.close();
+		}
+	}
+
+	/**
+	 * forget the dex of the patch, the next fix verifies and loads it again
+	 */
+	static void remove(File patch) {
+		sEntries.remove(patch.getAbsolutePath());
+	}
+}
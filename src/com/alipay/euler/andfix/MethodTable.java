@@ -0,0 +1,70 @@
+/*
+ * 
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.alipay.euler.andfix;
+
+import java.lang.reflect.Method;
+import java.util.HashMap;
+import java.util.Map;
+
+import com.alipay.euler.andfix.patch.PatchMethod;
+
+/**
+ * the declared methods of a class, keyed by name and parameter descriptor.
+ * built with one getDeclaredMethods() the first time the class is touched,
+ * every later lookup is a hash lookup instead of getDeclaredMethod(), which
+ * searches the methods and compares parameter arrays each time.
+ */
+final class MethodTable {
+	private final Class<?> mClass;
+	private final Map<String, Method> mMethods;
+
+	MethodTable(Class<?> clazz) {
+		mClass = clazz;
+		Method[] methods = clazz.getDeclaredMethods();
+		mMethods = new HashMap<String, Method>(methods.length * 2);
+		for (Method method : methods) {
+			String key = key(method.getName(), PatchMethod.getParameterDescriptor(method));
+			Method existing = mMethods.put(key, method);
+			// 同名同参数的只有编译器生成的 bridge 方法，与 getDeclaredMethod 一样取非 bridge 的那个
+			if (existing != null && !existing.isBridge() && method.isBridge()) {
+				mMethods.put(key, existing);
+			}
+		}
+	}
+
+	Class<?> getDeclaringClass() {
+		return mClass;
+	}
+
+	/**
+	 * @param name method name
+	 * @param parameterDescriptor e.g. (I[Ljava/lang/String;)
+	 * @return declared method, or null
+	 */
+	Method get(String name, String parameterDescriptor) {
+		return mMethods.get(key(name, parameterDescriptor));
+	}
+
+	int size() {
+		return mMethods.size();
+	}
+
+	private static String key(String name, String parameterDescriptor) {
+		return name + parameterDescriptor;
+	}
+}
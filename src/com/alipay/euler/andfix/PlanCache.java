@@ -0,0 +1,295 @@
+/*
+ * 
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.alipay.euler.andfix;
+
+import java.io.ByteArrayOutputStream;
+import java.io.DataOutputStream;
+import java.io.File;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.io.RandomAccessFile;
+import java.io.UnsupportedEncodingException;
+import java.nio.ByteBuffer;
+import java.nio.channels.FileChannel;
+import java.security.GeneralSecurityException;
+import java.security.MessageDigest;
+import java.util.ArrayList;
+import java.util.List;
+
+import javax.crypto.Mac;
+import javax.crypto.spec.SecretKeySpec;
+
+import android.util.Log;
+
+import com.alipay.euler.andfix.patch.PatchMethod;
+
+/**
+ * the resolved methods of a patch, persisted in apatch_opt after the first
+ * apply, so later launches resolve them directly instead of enumerating the
+ * dex and scanning annotations.
+ * 
+ * <pre>
+ * file: u4 magic, u4 version, Key, u8 discover ns, u4 count,
+ *       count * 5 strings (u2 length + UTF-8 bytes), HMAC-SHA256 of all before
+ * Key:  u8 patch length, u8 patch mtime, u8 app version code, u8 app update time,
+ *       u4 hash of the fixed class names, string fingerprint of the patch
+ * </pre>
+ * 
+ * apatch_opt may be writable by others (see Vulnerability-Parasyte in
+ * AndFixManager), so the file is authenticated with the per-install hash key of
+ * {@link com.alipay.euler.andfix.security.SecurityChecker}, and the key binds
+ * it to the content of the patch, not only to its length and mtime.
+ * 
+ * the file is read through a MappedByteBuffer, written to a temporary file and
+ * renamed. any mismatch of the key, version or HMAC is a miss.
+ */
+final class PlanCache {
+	private static final String TAG = "PlanCache";
+
+	private static final int MAGIC = 0x4146504c; // "AFPL"
+	private static final int VERSION = 2;
+	private static final String SUFFIX = ".plan";
+	private static final String CHARSET = "UTF-8";
+	private static final String MAC = "HmacSHA256";
+	private static final int MAC_SIZE = 32;
+
+	/**
+	 * what the cached plan depends on
+	 */
+	static final class Key {
+		final long patchLength;
+		final long patchTime;
+		final long appVersion;
+		final long appUpdateTime;
+		final int classNamesHash;
+		final String patchFingerprint;
+
+		/**
+		 * @param patchFingerprint fingerprint of the patch content, from its
+		 *            verification ({@link DexCache.Entry#fingerprint})
+		 */
+		Key(File patch, String patchFingerprint, long appVersion, long appUpdateTime,
+				List<String> classNames) {
+			this.patchLength = patch.length();
+			this.patchTime = patch.lastModified();
+			this.appVersion = appVersion;
+			this.appUpdateTime = appUpdateTime;
+			this.classNamesHash = classNames == null ? 0 : classNames.hashCode();
+			this.patchFingerprint = patchFingerprint;
+		}
+	}
+
+	/**
+	 * a loaded plan
+	 */
+	static final class Entry {
+		final List<PatchMethod> methods;
+		/**
+		 * time the discovery took when the plan was saved
+		 */
+		final long discoverNs;
+
+		Entry(List<PatchMethod> methods, long discoverNs) {
+			this.methods = methods;
+			this.discoverNs = discoverNs;
+		}
+	}
+
+	private PlanCache() {
+	}
+
+	/**
+	 * @param dir apatch_opt
+	 * @param patch patch file
+	 * @param key key
+	 * @return cache file of the patch, one per set of fixed class names
+	 */
+	static File file(File dir, File patch, Key key) {
+		return new File(dir, patch.getName() + "." + Integer.toHexString(key.classNamesHash) + SUFFIX);
+	}
+
+	/**
+	 * delete all cached plans of the patch
+	 */
+	static void delete(File dir, File patch) {
+		String[] names = dir == null ? null : dir.list();
+		if (names == null) {
+			return;
+		}
+		String prefix = patch.getName() + ".";
+		for (String name : names) {
+			if (name.startsWith(prefix) && name.endsWith(SUFFIX)) {
+				File file = new File(dir, name);
+				if (!file.delete()) {
+					Log.e(TAG, name + " delete error.");
+				}
+			}
+		}
+	}
+
+	/**
+	 * @param macKey per-install key the file was saved with
+	 * @return cached plan, or null if there is none for the key or the file
+	 *         was not written with macKey
+	 */
+	static Entry load(File file, Key key, byte[] macKey) {
+		if (!file.isFile() || macKey == null || key.patchFingerprint == null) {
+			return null;
+		}
+		RandomAccessFile raf = null;
+		try {
+			raf = new RandomAccessFile(file, "r");
+			FileChannel channel = raf.getChannel();
+			ByteBuffer buffer = channel.map(FileChannel.MapMode.READ_ONLY, 0, channel.size());
+			return read(buffer, key, macKey);
+		} catch (Exception e) {
+			Log.e(TAG, "load " + file.getName(), e);
+			return null;
+		} finally {
+			if (raf != null) {
+				try {
+					raf.close();
+				} catch (IOException e) {
+					Log.e(TAG, "load", e);
+				}
+			}
+		}
+	}
+
+	private static Entry read(ByteBuffer buffer, Key key, byte[] macKey)
+			throws UnsupportedEncodingException, GeneralSecurityException {
+		int end = buffer.limit() - MAC_SIZE;
+		if (end < 0) {
+			return null;
+		}
+		byte[] content = new byte[end];
+		buffer.get(content);
+		byte[] mac = new byte[MAC_SIZE];
+		buffer.get(mac);
+		if (!MessageDigest.isEqual(mac(macKey, content, end), mac)) {
+			return null;
+		}
+		buffer.position(0);
+		buffer.limit(end);
+		if (buffer.getInt() != MAGIC || buffer.getInt() != VERSION) {
+			return null;
+		}
+		if (buffer.getLong() != key.patchLength || buffer.getLong() != key.patchTime
+				|| buffer.getLong() != key.appVersion || buffer.getLong() != key.appUpdateTime
+				|| buffer.getInt() != key.classNamesHash
+				|| !key.patchFingerprint.equals(readString(buffer, content))) {
+			return null;
+		}
+		long discoverNs = buffer.getLong();
+		int count = buffer.getInt();
+		List<PatchMethod> methods = new ArrayList<PatchMethod>(count);
+		String[] parts = new String[5];
+		for (int i = 0; i < count; i++) {
+			for (int j = 0; j < parts.length; j++) {
+				parts[j] = readString(buffer, content);
+			}
+			methods.add(new PatchMethod(parts[0], parts[1], parts[2], parts[3], parts[4]));
+		}
+		return new Entry(methods, discoverNs);
+	}
+
+	private static String readString(ByteBuffer buffer, byte[] content)
+			throws UnsupportedEncodingException {
+		int length = buffer.getShort() & 0xffff;
+		String value = new String(content, buffer.position(), length, CHARSET);
+		buffer.position(buffer.position() + length);
+		return value;
+	}
+
+	private static byte[] mac(byte[] macKey, byte[] content, int length)
+			throws GeneralSecurityException {
+		Mac mac = Mac.getInstance(MAC);
+		mac.init(new SecretKeySpec(macKey, MAC));
+		mac.update(content, 0, length);
+		return mac.doFinal();
+	}
+
+	/**
+	 * persist the plan, errors are logged and ignored
+	 * 
+	 * @param macKey per-install key, nothing is saved without it
+	 */
+	static void save(File file, Key key, byte[] macKey, List<PatchMethod> methods,
+			long discoverNs) {
+		if (macKey == null || key.patchFingerprint == null) {
+			return;
+		}
+		File tmp = new File(file.getPath() + ".tmp");
+		FileOutputStream out = null;
+		try {
+			ByteArrayOutputStream bytes = new ByteArrayOutputStream();
+			DataOutputStream data = new DataOutputStream(bytes);
+			data.writeInt(MAGIC);
+			data.writeInt(VERSION);
+			data.writeLong(key.patchLength);
+			data.writeLong(key.patchTime);
+			data.writeLong(key.appVersion);
+			data.writeLong(key.appUpdateTime);
+			data.writeInt(key.classNamesHash);
+			writeString(data, key.patchFingerprint);
+			data.writeLong(discoverNs);
+			data.writeInt(methods.size());
+			for (PatchMethod method : methods) {
+				writeString(data, method.getTargetClass());
+				writeString(data, method.getTargetMethod());
+				writeString(data, method.getDescriptor());
+				writeString(data, method.getPatchClass());
+				writeString(data, method.getPatchMethod());
+			}
+			data.flush();
+			data.write(mac(macKey, bytes.toByteArray(), bytes.size()));
+			data.flush();
+
+			out = new FileOutputStream(tmp);
+			bytes.writeTo(out);
+			out.close();
+			out = null;
+			if (!tmp.renameTo(file)) {
+				Log.e(TAG, "rename " + tmp.getName() + " failed");
+				tmp.delete();
+			}
+		} catch (IOException e) {
+			Log.e(TAG, "save " + file.getName(), e);
+			tmp.delete();
+		} catch (GeneralSecurityException e) {
+			Log.e(TAG, "save " + file.getName(), e);
+		} finally {
+			if (out != null) {
+				try {
+					out.close();
+				} catch (IOException e) {
+					Log.e(TAG, "save", e);
+				}
+			}
+		}
+	}
+
+	private static void writeString(DataOutputStream data, String value) throws IOException {
+		byte[] bytes = value.getBytes(CHARSET);
+		if (bytes.length > 0xffff) {
+			throw new IOException("string too long: " + bytes.length);
+		}
+		data.writeShort(bytes.length);
+		data.write(bytes);
+	}
+}
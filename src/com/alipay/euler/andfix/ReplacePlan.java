@@ -0,0 +1,93 @@
+/*
+ * 
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.alipay.euler.andfix;
+
+import java.lang.reflect.Method;
+import java.util.List;
+import java.util.Set;
+
+/**
+ * resolved, not yet applied work of one patch: targets[i] will be replaced by
+ * replacements[i], and the fields of {@link #getFieldClasses()} will be made public.
+ * 
+ * built by {@link AndFixManager#prepare(java.io.File, ClassLoader, List)} on any
+ * thread, applied by {@link AndFixManager#commit(ReplacePlan)}. immutable.
+ */
+public final class ReplacePlan {
+	private final String mName;
+	private final Method[] mTargets;
+	private final Method[] mReplacements;
+	private final Class<?>[] mFieldClasses;
+
+	ReplacePlan(String name, List<Method> targets, List<Method> replacements,
+			Set<Class<?>> fieldClasses) {
+		mName = name;
+		mTargets = targets.toArray(new Method[targets.size()]);
+		mReplacements = replacements.toArray(new Method[replacements.size()]);
+		mFieldClasses = fieldClasses.toArray(new Class<?>[fieldClasses.size()]);
+	}
+
+	/**
+	 * @return name of the patch file
+	 */
+	public String getName() {
+		return mName;
+	}
+
+	/**
+	 * @return count of methods that will be replaced
+	 */
+	public int size() {
+		return mTargets.length;
+	}
+
+	public boolean isEmpty() {
+		return mTargets.length == 0;
+	}
+
+	public Method[] getTargets() {
+		return mTargets.clone();
+	}
+
+	public Method[] getReplacements() {
+		return mReplacements.clone();
+	}
+
+	public Class<?>[] getFieldClasses() {
+		return mFieldClasses.clone();
+	}
+
+	// package-private, no copy on the commit path
+	Method[] targets() {
+		return mTargets;
+	}
+
+	Method[] replacements() {
+		return mReplacements;
+	}
+
+	Class<?>[] fieldClasses() {
+		return mFieldClasses;
+	}
+
+	@Override
+	public String toString() {
+		return "ReplacePlan{" + mName + ", methods=" + mTargets.length + ", classes="
+				+ mFieldClasses.length + "}";
+	}
+}
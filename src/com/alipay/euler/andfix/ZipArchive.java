@@ -0,0 +1,220 @@
+/*
+ *
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.alipay.euler.andfix;
+
+import java.io.Closeable;
+import java.io.File;
+import java.io.IOException;
+import java.io.InputStream;
+import java.nio.ByteBuffer;
+import java.util.ArrayList;
+import java.util.HashSet;
+import java.util.List;
+import java.util.Set;
+import java.util.zip.ZipException;
+
+import android.util.Log;
+
+/**
+ * a patch (ZIP) file read through libandfix, see jni/zip/zip_archive.h. the
+ * file is mapped once and its central directory, zip64 included, is indexed
+ * into one sorted array: looking an entry up allocates nothing. stored entries
+ * can be mapped without copying, deflated ones are inflated while they are
+ * read, and both are checked against their CRC32 when read to the end.
+ *
+ * streams of {@link #getInputStream(String)} fail once the archive is closed;
+ * buffers of {@link #map(String)} point into the mapping and must not be read
+ * after {@link #close()}.
+ */
+public final class ZipArchive implements Closeable {
+	private static final String TAG = "ZipArchive";
+
+	private long mHandle;
+	private final Set<EntryStream> mStreams = new HashSet<EntryStream>();
+
+	private static native long nativeOpen(String path);
+	private static native void nativeClose(long handle);
+	private static native int nativeCount(long handle);
+	private static native String nativeName(long handle, int index);
+	private static native int nativeFind(long handle, String name);
+	private static native long nativeSize(long handle, int index);
+	private static native ByteBuffer nativeMap(long handle, int index);
+	private static native long nativeOpenReader(long handle, int index);
+	private static native int nativeRead(long reader, byte[] buffer, int offset, int length);
+	private static native void nativeCloseReader(long reader);
+
+	private ZipArchive(long handle) {
+		mHandle = handle;
+	}
+
+	/**
+	 * @param file ZIP file
+	 * @return null if the library is not loaded or the file is not a valid
+	 *         ZIP, read it with {@link java.util.zip.ZipFile} then
+	 */
+	public static ZipArchive open(File file) {
+		if (!AndFix.isLoaded()) {
+			return null;
+		}
+		try {
+			long handle = nativeOpen(file.getAbsolutePath());
+			return handle == 0 ? null : new ZipArchive(handle);
+		} catch (Throwable e) {
+			Log.e(TAG, "open", e);
+			return null;
+		}
+	}
+
+	/**
+	 * @return number of entries
+	 */
+	public synchronized int size() {
+		checkOpen();
+		return nativeCount(mHandle);
+	}
+
+	/**
+	 * @return names of the entries, sorted by their UTF-8 bytes
+	 */
+	public synchronized List<String> names() {
+		checkOpen();
+		int count = nativeCount(mHandle);
+		List<String> names = new ArrayList<String>(count);
+		for (int i = 0; i < count; i++) {
+			names.add(nativeName(mHandle, i));
+		}
+		return names;
+	}
+
+	public synchronized boolean contains(String name) {
+		checkOpen();
+		return nativeFind(mHandle, name) >= 0;
+	}
+
+	/**
+	 * @return uncompressed size of the entry, -1 if there is none
+	 */
+	public synchronized long getSize(String name) {
+		checkOpen();
+		int index = nativeFind(mHandle, name);
+		return index < 0 ? -1 : nativeSize(mHandle, index);
+	}
+
+	/**
+	 * @return read-only view of a stored entry, null if there is no such entry
+	 *         or it is compressed. the CRC32 is not checked.
+	 */
+	public synchronized ByteBuffer map(String name) {
+		checkOpen();
+		int index = nativeFind(mHandle, name);
+		if (index < 0) {
+			return null;
+		}
+		ByteBuffer buffer = nativeMap(mHandle, index);
+		return buffer == null ? null : buffer.asReadOnlyBuffer();
+	}
+
+	/**
+	 * @return stream of the uncompressed entry, null if there is no such entry
+	 * @throws ZipException if the entry is encrypted, uses another method than
+	 *             stored or deflated, or lies outside the file
+	 */
+	public synchronized InputStream getInputStream(String name) throws IOException {
+		checkOpen();
+		int index = nativeFind(mHandle, name);
+		if (index < 0) {
+			return null;
+		}
+		long reader = nativeOpenReader(mHandle, index);
+		if (reader == 0) {
+			throw new ZipException("can not read " + name);
+		}
+		EntryStream stream = new EntryStream(reader);
+		mStreams.add(stream);
+		return stream;
+	}
+
+	@Override
+	public synchronized void close() {
+		if (mHandle == 0) {
+			return;
+		}
+		for (EntryStream stream : mStreams) {
+			stream.closeReader();
+		}
+		mStreams.clear();
+		nativeClose(mHandle);
+		mHandle = 0;
+	}
+
+	private void checkOpen() {
+		if (mHandle == 0) {
+			throw new IllegalStateException("ZipArchive is closed");
+		}
+	}
+
+	private final class EntryStream extends InputStream {
+		private long mReader;
+
+		EntryStream(long reader) {
+			mReader = reader;
+		}
+
+		@Override
+		public int read() throws IOException {
+			byte[] b = new byte[1];
+			int n = read(b, 0, 1);
+			return n == -1 ? -1 : b[0] & 0xff;
+		}
+
+		@Override
+		public int read(byte[] b, int off, int len) throws IOException {
+			if (off < 0 || len < 0 || off > b.length - len) {
+				throw new IndexOutOfBoundsException();
+			}
+			synchronized (ZipArchive.this) {
+				if (mReader == 0) {
+					throw new IOException("stream closed");
+				}
+				if (len == 0) {
+					return 0;
+				}
+				int n = nativeRead(mReader, b, off, len);
+				if (n == -2) {
+					throw new ZipException("corrupt entry");
+				}
+				return n;
+			}
+		}
+
+		@Override
+		public void close() {
+			synchronized (ZipArchive.this) {
+				closeReader();
+				mStreams.remove(this);
+			}
+		}
+
+		void closeReader() {
+			if (mReader != 0) {
+				nativeCloseReader(mReader);
+				mReader = 0;
+			}
+		}
+	}
+}
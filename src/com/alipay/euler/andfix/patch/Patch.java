@@ -31,12 +31,15 @@ import java.util.jar.JarEntry;
 import java.util.jar.JarFile;
 import java.util.jar.Manifest;
 
+import com.alipay.euler.andfix.ZipArchive;
+
 public class Patch implements Comparable<Patch> {
 	private static final String ENTRY_NAME = "META-INF/PATCH.MF";
 	private static final String CLASSES = "-Classes";
 	private static final String PATCH_CLASSES = "Patch-Classes";
 	private static final String CREATED_TIME = "Created-Time";
 	private static final String PATCH_NAME = "Patch-Name";
+	private static final String PATCH_METHODS = "Patch-Methods";
 
 	/**
 	 * patch file
@@ -56,6 +59,10 @@ public class Patch implements Comparable<Patch> {
 	 * 所有需要修复的类名之后保存到这个列表中，后面会通过修复包名称获取到他的修复类名称列表
 	 */
 	private Map<String, List<String>> mClassesMap;
+	/**
+	 * Patch-Methods index, null if the patch has none (or it is malformed)
+	 */
+	private List<PatchMethod> mMethods;
 
 	public Patch(File file) throws IOException {
 		mFile = file;
@@ -72,36 +79,72 @@ public class Patch implements Comparable<Patch> {
 	 * To-File: app-release-online.apk
 	 * Patch-Classes: cn.wjdiankong.andfix.Utils_CF
 	 * Created-By: 1.0(ApkPatch)
+	 * 可选的 Patch-Methods 直接列出每个补丁方法与被替换的方法(格式见 PatchMethod)，
+	 * 有它时加载补丁不再扫描 @MethodReplace 注解.
 	 */
 	private void init() throws IOException {
+		Manifest manifest = readManifest();
+		Attributes mainAttributes = manifest.getMainAttributes();
+		mName = mainAttributes.getValue(PATCH_NAME); // 补丁包名：app-release-fix
+		mTime = new Date(mainAttributes.getValue(CREATED_TIME)); // 9 Nov 2020 01:53:27 GMT
+
+		mClassesMap = new HashMap<String, List<String>>();
+
+		String methods = mainAttributes.getValue(PATCH_METHODS);
+		if (methods != null) {
+			mMethods = PatchMethod.parseList(methods); // 格式错误时为 null，退回扫描注解
+		}
+
+		Attributes.Name attrName;
+		String name;
+		List<String> strings;
+		for (Object attr : mainAttributes.keySet()) {
+			attrName = (Attributes.Name) attr;
+			name = attrName.toString();
+			if (name.endsWith(CLASSES)) { // -Classes，说明是类
+				strings = Arrays.asList(mainAttributes.getValue(attrName).split(","));
+				if (name.equalsIgnoreCase(PATCH_CLASSES)) { // Patch-Classes
+					mClassesMap.put(mName, strings); // 补丁(patch)包中包含的需要素有修复类
+				} else { // remove count(-Classes)
+					mClassesMap.put(name.trim().substring(0, name.length() - 8), strings);
+				}
+			}
+		}
+	}
+
+	/**
+	 * read PATCH.MF through the native {@link ZipArchive}, which maps the patch
+	 * and indexes its central directory without creating entry objects; through
+	 * JarFile when the library is not loaded or can not parse the file
+	 */
+	private Manifest readManifest() throws IOException {
+		ZipArchive zip = ZipArchive.open(mFile);
+		if (zip == null) {
+			return readManifestFromJar();
+		}
+		try {
+			InputStream inputStream = zip.getInputStream(ENTRY_NAME);
+			if (inputStream == null) {
+				throw new IOException(ENTRY_NAME + " not found in " + mFile);
+			}
+			try {
+				return new Manifest(inputStream);
+			} finally {
+				inputStream.close();
+			}
+		} finally {
+			zip.close();
+		}
+	}
+
+	private Manifest readManifestFromJar() throws IOException {
 		JarFile jarFile = null;
 		InputStream inputStream = null;
 		try {
 			jarFile = new JarFile(mFile);
 			JarEntry entry = jarFile.getJarEntry(ENTRY_NAME);
 			inputStream = jarFile.getInputStream(entry);
-			Manifest manifest = new Manifest(inputStream);
-			Attributes mainAttributes = manifest.getMainAttributes();
-			mName = mainAttributes.getValue(PATCH_NAME); // 补丁包名：app-release-fix
-			mTime = new Date(mainAttributes.getValue(CREATED_TIME)); // 9 Nov 2020 01:53:27 GMT
-
-			mClassesMap = new HashMap<String, List<String>>();
-
-			Attributes.Name attrName;
-			String name;
-			List<String> strings;
-			for (Object attr : mainAttributes.keySet()) {
-				attrName = (Attributes.Name) attr;
-				name = attrName.toString();
-				if (name.endsWith(CLASSES)) { // -Classes，说明是类
-					strings = Arrays.asList(mainAttributes.getValue(attrName).split(","));
-					if (name.equalsIgnoreCase(PATCH_CLASSES)) { // Patch-Classes
-						mClassesMap.put(mName, strings); // 补丁(patch)包中包含的需要素有修复类
-					} else { // remove count(-Classes)
-						mClassesMap.put(name.trim().substring(0, name.length() - 8), strings);
-					}
-				}
-			}
+			return new Manifest(inputStream);
 		} finally {
 			if (jarFile != null) {
 				jarFile.close();
@@ -110,7 +153,6 @@ public class Patch implements Comparable<Patch> {
 				inputStream.close();
 			}
 		}
-
 	}
 
 	public String getName() {
@@ -129,6 +171,14 @@ public class Patch implements Comparable<Patch> {
 		return mClassesMap.get(patchName);
 	}
 
+	/**
+	 * @return entries of the Patch-Methods index, or null if the annotations
+	 *         of the patch classes have to be scanned
+	 */
+	public List<PatchMethod> getMethods() {
+		return mMethods;
+	}
+
 	public Date getTime() {
 		return mTime;
 	}
@@ -27,6 +27,7 @@ import com.alipay.euler.andfix.util.FileUtil;
 import java.io.File;
 import java.io.FileNotFoundException;
 import java.io.IOException;
+import java.util.ArrayList;
 import java.util.List;
 import java.util.Map;
 import java.util.Set;
@@ -165,10 +166,12 @@ public class PatchManager {
     }
 
     /**
-     * remove all patchs
+     * remove all patchs, replaced methods are restored at once
      */
     @SuppressWarnings("unused")
     public void removeAllPatch() {
+        mAndFixManager.restoreAll();
+        mPatchs.clear();
         cleanPatch();
         SharedPreferences sp = mContext.getSharedPreferences(SP_NAME, Context.MODE_PRIVATE);
         sp.edit().clear().apply();
@@ -184,15 +187,13 @@ public class PatchManager {
     @SuppressWarnings("unused")
     public void loadPatch(String patchName, ClassLoader classLoader) {
         mClassLoaderMap.put(patchName, classLoader);
-        Set<String> patchNames;
-        List<String> classes;
+        List<FixUnit> units = new ArrayList<FixUnit>();
         for (Patch patch : mPatchs) {
-            patchNames = patch.getPatchNames();
-            if (patchNames.contains(patchName)) {
-                classes = patch.getClasses(patchName);
-                mAndFixManager.fix(patch.getFile(), classLoader, classes);
+            if (patch.getPatchNames().contains(patchName)) {
+                units.add(new FixUnit(patch, classLoader, patch.getClasses(patchName)));
             }
         }
+        fixAll(units);
     }
 
     /**
@@ -201,14 +202,67 @@ public class PatchManager {
     @SuppressWarnings("unused")
     public void loadPatch() {
         mClassLoaderMap.put("*", mContext.getClassLoader());// wildcard
-        Set<String> patchNames;
-        List<String> classes;
+        List<FixUnit> units = new ArrayList<FixUnit>();
         for (Patch patch : mPatchs) {
-            patchNames = patch.getPatchNames();
-            for (String patchName : patchNames) {
-                classes = patch.getClasses(patchName);
-                mAndFixManager.fix(patch.getFile(), mContext.getClassLoader(), classes);
+            for (String patchName : patch.getPatchNames()) {
+                units.add(new FixUnit(patch, mContext.getClassLoader(),
+                        patch.getClasses(patchName)));
+            }
+        }
+        fixAll(units);
+    }
+
+    /**
+     * one {@link AndFixManager#fix} call: the classes of a patch loaded by a classloader
+     */
+    private static final class FixUnit {
+        final Patch patch;
+        final ClassLoader classLoader;
+        final List<String> classes;
+
+        FixUnit(Patch patch, ClassLoader classLoader, List<String> classes) {
+            this.patch = patch;
+            this.classLoader = classLoader;
+            this.classes = classes;
+        }
+
+        /**
+         * @return entries of the Patch-Methods index this call applies, null without index
+         */
+        List<PatchMethod> methods() {
+            List<PatchMethod> methods = patch.getMethods();
+            if (methods == null || classes == null) {
+                return methods;
+            }
+            List<PatchMethod> result = new ArrayList<PatchMethod>(methods.size());
+            for (PatchMethod method : methods) {
+                if (classes.contains(method.getPatchClass())) {
+                    result.add(method);
+                }
+            }
+            return result;
+        }
+    }
+
+    /**
+     * apply the units in order, but only the last replacement of each target
+     * method: a unit whose every method is replaced again by a later patch is
+     * skipped, its dex is not even loaded
+     */
+    private void fixAll(List<FixUnit> units) {
+        List<List<PatchMethod>> indices = new ArrayList<List<PatchMethod>>(units.size());
+        for (FixUnit unit : units) {
+            indices.add(unit.methods());
+        }
+        List<List<PatchMethod>> winners = mAndFixManager.coalesce(indices);
+        for (int i = 0; i < units.size(); i++) {
+            FixUnit unit = units.get(i);
+            List<PatchMethod> methods = winners.get(i);
+            if (methods != null && methods.isEmpty()) {
+                Log.d(TAG, "skip shadowed patch " + unit.patch.getName());
+                continue;
             }
+            mAndFixManager.fix(unit.patch.getFile(), unit.classLoader, unit.classes, methods);
         }
     }
 
@@ -228,7 +282,7 @@ public class PatchManager {
             }
             if (classLoader != null) {
                 classes = patch.getClasses(patchName);
-                mAndFixManager.fix(patch.getFile(), classLoader, classes);
+                mAndFixManager.fix(patch.getFile(), classLoader, classes, patch.getMethods());
             }
         }
     }
@@ -0,0 +1,193 @@
+/*
+ * 
+ * Copyright (c) 2015, alipay.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.alipay.euler.andfix.patch;
+
+import java.lang.reflect.Method;
+import java.util.ArrayList;
+import java.util.List;
+
+/**
+ * one entry of the Patch-Methods index in META-INF/PATCH.MF, it tells which
+ * patch method replaces which target method, so the annotations of the patch
+ * classes need not be scanned:
+ * 
+ * <pre>
+ * Patch-Methods: targetClass:targetMethod:descriptor:patchClass:patchMethod,...
+ * e.g. cn.wjdiankong.andfix.Utils:getName:(ILjava/lang/String;)Ljava/lang/String;:cn.wjdiankong.andfix.Utils_CF:getName
+ * </pre>
+ * 
+ * the descriptor is the JVM method descriptor, the target and the patch method
+ * take the same parameters.
+ */
+public final class PatchMethod {
+	private static final char SEPARATOR = ':';
+
+	private final String mTargetClass;
+	private final String mTargetMethod;
+	private final String mDescriptor;
+	private final String mPatchClass;
+	private final String mPatchMethod;
+
+	public PatchMethod(String targetClass, String targetMethod, String descriptor,
+			String patchClass, String patchMethod) {
+		mTargetClass = targetClass;
+		mTargetMethod = targetMethod;
+		mDescriptor = descriptor;
+		mPatchClass = patchClass;
+		mPatchMethod = patchMethod;
+	}
+
+	/**
+	 * @param target method that will be replaced
+	 * @param replacement patch method
+	 * @return entry describing the pair
+	 */
+	public static PatchMethod of(Method target, Method replacement) {
+		return new PatchMethod(target.getDeclaringClass().getName(), target.getName(),
+				getDescriptor(target), replacement.getDeclaringClass().getName(),
+				replacement.getName());
+	}
+
+	/**
+	 * @return JVM descriptor of the method, e.g. (I[Ljava/lang/String;)V
+	 */
+	public static String getDescriptor(Method method) {
+		StringBuilder builder = new StringBuilder();
+		appendParameters(builder, method);
+		appendDescriptor(builder, method.getReturnType());
+		return builder.toString();
+	}
+
+	/**
+	 * @return JVM descriptor of the parameters of the method, e.g. (I[Ljava/lang/String;)
+	 */
+	public static String getParameterDescriptor(Method method) {
+		StringBuilder builder = new StringBuilder();
+		appendParameters(builder, method);
+		return builder.toString();
+	}
+
+	private static void appendParameters(StringBuilder builder, Method method) {
+		builder.append('(');
+		for (Class<?> type : method.getParameterTypes()) {
+			appendDescriptor(builder, type);
+		}
+		builder.append(')');
+	}
+
+	private static void appendDescriptor(StringBuilder builder, Class<?> type) {
+		while (type.isArray()) {
+			builder.append('[');
+			type = type.getComponentType();
+		}
+		if (type == void.class) {
+			builder.append('V');
+		} else if (type == boolean.class) {
+			builder.append('Z');
+		} else if (type == byte.class) {
+			builder.append('B');
+		} else if (type == char.class) {
+			builder.append('C');
+		} else if (type == short.class) {
+			builder.append('S');
+		} else if (type == int.class) {
+			builder.append('I');
+		} else if (type == long.class) {
+			builder.append('J');
+		} else if (type == float.class) {
+			builder.append('F');
+		} else if (type == double.class) {
+			builder.append('D');
+		} else {
+			builder.append('L').append(type.getName().replace('.', '/')).append(';');
+		}
+	}
+
+	/**
+	 * @param value value of the Patch-Methods attribute
+	 * @return entries, or null if any entry is malformed
+	 */
+	public static List<PatchMethod> parseList(String value) {
+		List<PatchMethod> methods = new ArrayList<PatchMethod>();
+		for (String item : value.split(",")) {
+			item = item.trim();
+			if (item.length() == 0) {
+				continue;
+			}
+			PatchMethod method = parse(item);
+			if (method == null) {
+				return null;
+			}
+			methods.add(method);
+		}
+		return methods;
+	}
+
+	/**
+	 * @param item targetClass:targetMethod:descriptor:patchClass:patchMethod
+	 * @return entry, or null if malformed
+	 */
+	public static PatchMethod parse(String item) {
+		String[] parts = item.split(String.valueOf(SEPARATOR), -1);
+		if (parts.length != 5) {
+			return null;
+		}
+		for (String part : parts) {
+			if (part.length() == 0) {
+				return null;
+			}
+		}
+		if (parts[2].charAt(0) != '(' || parts[2].indexOf(')') < 0) {
+			return null;
+		}
+		return new PatchMethod(parts[0], parts[1], parts[2], parts[3], parts[4]);
+	}
+
+	public String getTargetClass() {
+		return mTargetClass;
+	}
+
+	public String getTargetMethod() {
+		return mTargetMethod;
+	}
+
+	public String getDescriptor() {
+		return mDescriptor;
+	}
+
+	public String getPatchClass() {
+		return mPatchClass;
+	}
+
+	public String getPatchMethod() {
+		return mPatchMethod;
+	}
+
+	/**
+	 * @return the parameter part of the descriptor, e.g. (I[Ljava/lang/String;)
+	 */
+	public String getParameterDescriptor() {
+		return mDescriptor.substring(0, mDescriptor.indexOf(')') + 1);
+	}
+
+	@Override
+	public String toString() {
+		return mTargetClass + SEPARATOR + mTargetMethod + SEPARATOR + mDescriptor + SEPARATOR
+				+ mPatchClass + SEPARATOR + mPatchMethod;
+	}
+}
@@ -22,16 +22,22 @@ import java.io.File;
 import java.io.FileInputStream;
 import java.io.IOException;
 import java.io.InputStream;
+import java.io.RandomAccessFile;
 import java.math.BigInteger;
+import java.security.GeneralSecurityException;
 import java.security.MessageDigest;
 import java.security.PublicKey;
+import java.security.SecureRandom;
 import java.security.cert.Certificate;
 import java.security.cert.CertificateException;
 import java.security.cert.CertificateFactory;
 import java.security.cert.X509Certificate;
+import java.util.jar.Attributes;
 import java.util.jar.JarEntry;
 import java.util.jar.JarFile;
 
+import javax.crypto.Mac;
+import javax.crypto.spec.SecretKeySpec;
 import javax.security.auth.x500.X500Principal;
 
 import android.content.Context;
@@ -40,18 +46,68 @@ import android.content.SharedPreferences.Editor;
 import android.content.pm.PackageInfo;
 import android.content.pm.PackageManager;
 import android.content.pm.PackageManager.NameNotFoundException;
+import android.os.Build;
 import android.text.TextUtils;
+import android.util.Base64;
 import android.util.Log;
 
+import com.alipay.euler.andfix.AndFix;
+
+/**
+ * verifies the signature of patches and the fingerprints of their optimize
+ * files.
+ * 
+ * the optimize files live in apatch_opt, which other apps may be able to
+ * write, so by default {@link #verifyOpt(File)} hashes the whole file
+ * ({@link #OPT_POLICY_FULL_HASH}). {@link #OPT_POLICY_TIERED} trades that for
+ * a check of the metadata and of the head and tail of the file: it notices
+ * stale files and accidental changes, but does not detect tampering that keeps
+ * the size, mtime, inode and both ends of the file, only the sampled audits
+ * would.
+ */
 public class SecurityChecker {
 	private static final String TAG = "SecurityChecker";
 
 	private static final String SP_NAME = "_andfix_";
 	private static final String SP_MD5 = "-md5";
+	private static final String SP_META = "-meta";
+	private static final String SP_HASH_KEY = "_hash_key";
+	/**
+	 * prefix of fingerprints computed by {@link AndFix#fingerprint(File, byte[])},
+	 * the ones without it are MD5s
+	 */
+	private static final String FINGERPRINT_PREFIX = "t256:";
+	private static final int HASH_KEY_SIZE = 32;
 	private static final String CLASSES_DEX = "classes.dex";
+	private static final String PATCH_MF = "META-INF/PATCH.MF";
+	private static final String DIGEST_PREFIX = "jar:";
+	private static final String[] DIGEST_ATTRIBUTES = { "SHA-256-Digest", "SHA1-Digest", "MD5-Digest" };
 
 	private static final X500Principal DEBUG_DN = new X500Principal("CN=Android Debug,O=Android,C=US");
 
+	/**
+	 * {@link #verifyOpt(File)} compares the saved metadata of the optimize file
+	 * (size, mtime, inode, keyed MAC of its head and tail) and hashes the whole
+	 * file only when they differ, or as a sampled audit. does not detect
+	 * tampering in the middle of the file
+	 */
+	public static final int OPT_POLICY_TIERED = 0;
+	/**
+	 * {@link #verifyOpt(File)} always hashes the whole optimize file, the
+	 * default
+	 */
+	public static final int OPT_POLICY_FULL_HASH = 1;
+
+	private static final float DEFAULT_AUDIT_RATE = 0.05f;
+	/**
+	 * bytes of the head and of the tail of the optimize file covered by the MAC
+	 */
+	private static final int META_SAMPLE = 4096;
+	private static final String META_MAC = "HmacSHA256";
+
+	private static volatile int sOptPolicy = OPT_POLICY_FULL_HASH;
+	private static volatile float sAuditRate = DEFAULT_AUDIT_RATE;
+
 	private final Context mContext;
 	/**
 	 * host publickey
@@ -61,21 +117,65 @@ public class SecurityChecker {
 	 * host debuggable
 	 */
 	private boolean mDebuggable;
+	/**
+	 * HMAC key of the fingerprints, random per install
+	 */
+	private byte[] mHashKey;
 
 	public SecurityChecker(Context context) {
 		mContext = context;
 		init(mContext);
 	}
 
+	/**
+	 * how {@link #verifyOpt(File)} checks the optimize file, for all checkers of
+	 * the process. OPT_POLICY_TIERED is faster on cold start but does not
+	 * detect tampering, see the class documentation.
+	 * 
+	 * @param policy OPT_POLICY_TIERED or OPT_POLICY_FULL_HASH
+	 */
+	public static void setOptPolicy(int policy) {
+		sOptPolicy = policy;
+	}
+
+	/**
+	 * @param rate share of OPT_POLICY_TIERED checks that hash the whole file
+	 *            even though the metadata matches, 0 to 1
+	 */
+	public static void setOptAuditRate(float rate) {
+		sAuditRate = Math.max(0f, Math.min(1f, rate));
+	}
+
 	/**
 	 * @param file
 	 *            Dex file
 	 * @return true if verify fingerprint success
 	 */
 	public boolean verifyOpt(File file) {
-		String fingerprint = getFileMD5(file);
+		if (sOptPolicy == OPT_POLICY_TIERED) {
+			String meta = getFileMeta(file);
+			if (meta != null && TextUtils.equals(meta, getMeta(file.getName()))
+					&& Math.random() >= sAuditRate) {
+				return true;
+			}
+		}
 		String saved = getFingerprint(file.getName());
-		return fingerprint != null && TextUtils.equals(fingerprint, saved);
+		boolean verified;
+		if (saved != null && saved.startsWith(FINGERPRINT_PREFIX)) {
+			verified = TextUtils.equals(getFileFingerprint(file), saved);
+		} else {
+			// saved by an older version or without the native library
+			String md5 = getFileMD5(file);
+			verified = md5 != null && TextUtils.equals(md5, saved);
+			if (verified) {
+				saveFingerprint(file.getName(), getFileFingerprint(file));
+			}
+		}
+		if (verified) {
+			// 内容未变而元数据变了(如备份恢复后 inode 不同)，更新元数据，下次走快速路径
+			saveMeta(file.getName(), getFileMeta(file));
+		}
+		return verified;
 	}
 
 	/**
@@ -83,19 +183,39 @@ public class SecurityChecker {
 	 *            Dex file
 	 */
 	public void saveOptSig(File file) {
-		String fingerprint = getFileMD5(file);
+		String fingerprint = getFileFingerprint(file);
 		saveFingerprint(file.getName(), fingerprint);
+		saveMeta(file.getName(), getFileMeta(file));
 	}
 
 	/**
+	 * both classes.dex and PATCH.MF must be signed by the app's key: PATCH.MF
+	 * carries the Patch-Classes and Patch-Methods index, which decide what gets
+	 * replaced
+	 * 
 	 * @param path
 	 *            Apk file
 	 * @return true if verify apk success
 	 */
 	public boolean verifyApk(File path) {
+		return verifyApkDigest(path) != null;
+	}
+
+	/**
+	 * same as {@link #verifyApk(File)}, and identifies the verified content by
+	 * the digests of classes.dex and PATCH.MF from the signed manifest, which
+	 * the verification has just checked, so the patch is not hashed again
+	 * 
+	 * @param path
+	 *            Apk file
+	 * @return digest of the signed entries, the fingerprint of the whole file
+	 *         when debuggable or the manifest has no digest, null if verify
+	 *         fails
+	 */
+	public String verifyApkDigest(File path) {
 		if (mDebuggable) {
 			Log.d(TAG, "mDebuggable = true");
-			return true;
+			return getFileFingerprint(path);
 		}
 
 		JarFile jarFile = null;
@@ -104,17 +224,27 @@ public class SecurityChecker {
 
 			JarEntry jarEntry = jarFile.getJarEntry(CLASSES_DEX);
 			if (null == jarEntry) {// no code
-				return false;
+				return null;
+			}
+			if (!checkEntry(path, jarFile, jarEntry)) {
+				return null;
+			}
+			JarEntry manifestEntry = jarFile.getJarEntry(PATCH_MF);
+			if (null == manifestEntry) {
+				return null;
 			}
-			loadDigestes(jarFile, jarEntry);
-			Certificate[] certs = jarEntry.getCertificates();
-			if (certs == null) {
-				return false;
+			if (!checkEntry(path, jarFile, manifestEntry)) {
+				return null;
 			}
-			return check(path, certs);
+			String dexDigest = getEntryDigest(jarEntry);
+			String manifestDigest = getEntryDigest(manifestEntry);
+			if (dexDigest == null || manifestDigest == null) {
+				return getFileFingerprint(path);
+			}
+			return DIGEST_PREFIX + dexDigest + ":" + manifestDigest;
 		} catch (IOException e) {
 			Log.e(TAG, path.getAbsolutePath(), e);
-			return false;
+			return null;
 		} finally {
 			try {
 				if (jarFile != null) {
@@ -126,6 +256,34 @@ public class SecurityChecker {
 		}
 	}
 
+	/**
+	 * @return the strongest digest of the entry in the manifest, null if none
+	 */
+	private static String getEntryDigest(JarEntry je) throws IOException {
+		Attributes attributes = je.getAttributes();
+		if (attributes == null) {
+			return null;
+		}
+		for (String name : DIGEST_ATTRIBUTES) {
+			String digest = attributes.getValue(name);
+			if (digest != null) {
+				return digest;
+			}
+		}
+		return null;
+	}
+
+	// certificates of an entry are known only after it has been read through
+	private boolean checkEntry(File path, JarFile jarFile, JarEntry je) throws IOException {
+		loadDigestes(jarFile, je);
+		Certificate[] certs = je.getCertificates();
+		if (certs == null) {
+			Log.e(TAG, je.getName() + " is not signed: " + path.getAbsolutePath());
+			return false;
+		}
+		return check(path, certs);
+	}
+
 	private void loadDigestes(JarFile jarFile, JarEntry je) throws IOException {
 		InputStream is = null;
 		try {
@@ -155,6 +313,56 @@ public class SecurityChecker {
 		return false;
 	}
 
+	/**
+	 * keyed native fingerprint of the whole file, the MD5 of the file when the
+	 * native library is not loaded
+	 * 
+	 * @return null if the file does not exist
+	 */
+	public String getFileFingerprint(File file) {
+		if (!file.isFile()) {
+			return null;
+		}
+		byte[] hash = AndFix.fingerprint(file, getHashKey());
+		if (hash == null) {
+			return getFileMD5(file);
+		}
+		StringBuilder sb = new StringBuilder(FINGERPRINT_PREFIX);
+		for (byte b : hash) {
+			sb.append(Character.forDigit((b >> 4) & 0xf, 16));
+			sb.append(Character.forDigit(b & 0xf, 16));
+		}
+		return sb.toString();
+	}
+
+	/**
+	 * @return per-install secret key of the fingerprints, created on first use.
+	 *         also authenticates other files AndFix keeps in apatch_opt
+	 */
+	public synchronized byte[] getHashKey() {
+		if (mHashKey != null) {
+			return mHashKey;
+		}
+		SharedPreferences sp = mContext.getSharedPreferences(SP_NAME, Context.MODE_PRIVATE);
+		String saved = sp.getString(SP_HASH_KEY, null);
+		if (saved != null) {
+			try {
+				mHashKey = Base64.decode(saved, Base64.NO_WRAP);
+			} catch (IllegalArgumentException e) {
+				Log.e(TAG, "getHashKey", e);
+			}
+		}
+		if (mHashKey == null || mHashKey.length != HASH_KEY_SIZE) {
+			// fingerprints saved under an older key no longer match, the optimize files are made again
+			mHashKey = new byte[HASH_KEY_SIZE];
+			new SecureRandom().nextBytes(mHashKey);
+			Editor editor = sp.edit();
+			editor.putString(SP_HASH_KEY, Base64.encodeToString(mHashKey, Base64.NO_WRAP));
+			editor.commit();
+		}
+		return mHashKey;
+	}
+
 	private String getFileMD5(File file) {
 		if (!file.isFile()) {
 			return null;
@@ -185,11 +393,83 @@ public class SecurityChecker {
 		return bigInt.toString();
 	}
 
-	// md5 as fingerprint
-	private void saveFingerprint(String fileName, String md5) {
+	/**
+	 * O(1) identity of the file: size, mtime, inode and an HMAC-SHA256 keyed
+	 * with {@link #getHashKey()} over them and the first and last META_SAMPLE
+	 * bytes (the odex/oat headers sit at the head)
+	 */
+	private String getFileMeta(File file) {
+		if (!file.isFile()) {
+			return null;
+		}
+		RandomAccessFile raf = null;
+		try {
+			raf = new RandomAccessFile(file, "r");
+			long length = raf.length();
+			String meta = length + ":" + file.lastModified() + ":" + getInode(file);
+			Mac mac = Mac.getInstance(META_MAC);
+			mac.init(new SecretKeySpec(getHashKey(), META_MAC));
+			mac.update(meta.getBytes("UTF-8"));
+			byte[] buffer = new byte[META_SAMPLE];
+			int head = (int) Math.min(length, META_SAMPLE);
+			raf.readFully(buffer, 0, head);
+			mac.update(buffer, 0, head);
+			if (length > META_SAMPLE) {
+				int tail = (int) Math.min(length - META_SAMPLE, META_SAMPLE);
+				raf.seek(length - tail);
+				raf.readFully(buffer, 0, tail);
+				mac.update(buffer, 0, tail);
+			}
+			return meta + ":" + Base64.encodeToString(mac.doFinal(), Base64.NO_WRAP);
+		} catch (GeneralSecurityException e) {
+			Log.e(TAG, "getFileMeta", e);
+			return null;
+		} catch (IOException e) {
+			Log.e(TAG, "getFileMeta", e);
+			return null;
+		} finally {
+			try {
+				if (raf != null) {
+					raf.close();
+				}
+			} catch (IOException e) {
+				Log.e(TAG, "getFileMeta", e);
+			}
+		}
+	}
+
+	/**
+	 * @return inode of the file, 0 before API 21 where Os.stat is not available
+	 */
+	private static long getInode(File file) {
+		if (Build.VERSION.SDK_INT < 21) {
+			return 0;
+		}
+		try {
+			return android.system.Os.stat(file.getAbsolutePath()).st_ino;
+		} catch (Exception e) {
+			return 0;
+		}
+	}
+
+	private void saveMeta(String fileName, String meta) {
+		SharedPreferences sp = mContext.getSharedPreferences(SP_NAME, Context.MODE_PRIVATE);
+		Editor editor = sp.edit();
+		editor.putString(fileName + SP_META, meta);
+		editor.commit();
+	}
+
+	private String getMeta(String fileName) {
+		SharedPreferences sharedPreferences = mContext.getSharedPreferences(
+				SP_NAME, Context.MODE_PRIVATE);
+		return sharedPreferences.getString(fileName + SP_META, null);
+	}
+
+	// keyed fingerprint, or md5 without the native library
+	private void saveFingerprint(String fileName, String fingerprint) {
 		SharedPreferences sp = mContext.getSharedPreferences(SP_NAME, Context.MODE_PRIVATE);
 		Editor editor = sp.edit();
-		editor.putString(fileName + SP_MD5, md5);
+		editor.putString(fileName + SP_MD5, fingerprint);
 		editor.commit();
 	}
 